@@ -2,11 +2,19 @@
 
 BrickDialog::BrickDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 BrickDialog::BrickDialog(const BrickDialog& brickDialog) :
     LegoDialog(brickDialog) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void BrickDialog::createWidgets(void) {
     // Brick type
     _brickTypeComboBox = new QComboBox(this);
     QStringList brickTypeList;
@@ -25,6 +25,8 @@ public slots:
     virtual void updateMaxWidth(int brickType);
 
 private:
+    void createWidgets(void);
+
     QSpinBox* _widthSpinBox;
     QSpinBox* _lengthSpinBox;
     QComboBox* _brickTypeComboBox;
@@ -1,4 +1,5 @@
 #include "BrickNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Material>
@@ -19,11 +20,14 @@ BrickNode::BrickNode(const BrickNode& brickNode) :
 }
 
 void BrickNode::createGeode(void) {
+    PROFILE_SCOPE("BrickNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
 
     // Create geode
     osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    geode->setName(bodyName);
     addChild(geode);
     geode->addDrawable(createBrick());
 
@@ -2,11 +2,19 @@
 
 CharacterDialog::CharacterDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 CharacterDialog::CharacterDialog(const CharacterDialog& characterDialog) :
     LegoDialog(characterDialog) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void CharacterDialog::createWidgets(void) {
     // Character type
     _characterTypeComboBox = new QComboBox(this);
     QStringList characterTypeList;
@@ -1,5 +1,7 @@
 #include "CharacterNode.h"
+#include "Profiler.h"
 #include "Character.h"
+#include "ModelCache.h"
 
 #include <osg/MatrixTransform>
 #include <osg/Texture2D>
@@ -19,6 +21,8 @@ CharacterNode::CharacterNode(const CharacterNode& characterNode) :
 }
 
 void CharacterNode::createGeode(void) {
+    PROFILE_SCOPE("CharacterNode::createGeode");
+
     // Remove previous children
     removeChildren(0, getNumChildren());
 
@@ -34,8 +38,10 @@ void CharacterNode::createGeode(void) {
     m.makeTranslate(0, 0, -height*Lego::height_unit/2);
     mt->postMult(m);
 
-    // Create node from file
-    mt->addChild(osgDB::readNodeFile("../LEGO_CREATOR/OSG/LegoGuy/LegoGuy.osg"));
+    // Every character shares the same model, read and optimized once
+    osg::Node* model = ModelCache::get("../LEGO_CREATOR/OSG/LegoGuy/LegoGuy.osg");
+    if (model)
+        mt->addChild(model);
 
     // Add matrix transform
     addChild(mt);
@@ -0,0 +1,420 @@
+#include "CityGenerator.h"
+
+#include "Profiler.h"
+#include "RoadGenerator.h"
+#include "BrickNode.h"
+#include "CornerNode.h"
+#include "WindowNode.h"
+#include "DoorNode.h"
+#include "TileNode.h"
+#include "RoadNode.h"
+#include "World.h"
+
+#include <QtConcurrentMap>
+
+#include <cmath>
+
+// Blocks are BLOCK_CELLS x BLOCK_CELLS road cells, road cells are 32 studs wide
+#define BLOCK_CELLS 2
+#define CELL_SIZE 32
+
+// Lots are split until smaller than MAX_LOT studs, never below MIN_LOT
+#define MIN_LOT 14
+#define MAX_LOT 28
+// Garden around houses, in studs
+#define LOT_MARGIN 2
+
+// Houses: studs on the ground, brick layers high, the door needs 8 studs long fronts
+#define MIN_HOUSE_LENGTH 8
+#define MIN_HOUSE_WIDTH 6
+#define MAX_HOUSE_LENGTH 12
+#define MAX_HOUSE_WIDTH 10
+#define NB_LAYERS 6
+#define LAYER_HEIGHT 3
+
+// Openings, in studs and brick layers
+#define OPENING_SIZE 4
+#define WINDOW_FIRST_LAYER 2
+#define WINDOW_LAYERS 3
+
+namespace {
+    // xorshift32, so that a city only depends on its seed, whatever thread builds its blocks
+    quint32 nextRandom(quint32& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    int randomInt(quint32& state, int min, int max) {
+        return min + nextRandom(state) % (max-min+1);
+    }
+
+    QColor randomColor(quint32& state, const QColor* colors, int nbColors) {
+        return colors[nextRandom(state) % nbColors];
+    }
+
+    // Roads run on every (BLOCK_CELLS+1)th row and column, and go on towards neighbour road cells
+    int roadSideMask(int i, int j, int nbCellsX, int nbCellsY) {
+        int sideMask = 0;
+        if (i%(BLOCK_CELLS+1) != 0 && j%(BLOCK_CELLS+1) != 0)
+            return sideMask;
+
+        if (i > 0 && j%(BLOCK_CELLS+1) == 0)
+            sideMask |= 1 << RoadGenerator::left;
+        if (j < nbCellsY-1 && i%(BLOCK_CELLS+1) == 0)
+            sideMask |= 1 << RoadGenerator::top;
+        if (i < nbCellsX-1 && j%(BLOCK_CELLS+1) == 0)
+            sideMask |= 1 << RoadGenerator::right;
+        if (j > 0 && i%(BLOCK_CELLS+1) == 0)
+            sideMask |= 1 << RoadGenerator::bottom;
+        return sideMask;
+    }
+
+    const QColor WALL_COLORS[] = { QColor(Qt::red), QColor(Qt::white), QColor(Qt::yellow), QColor(Qt::blue), QColor(222, 198, 156) };
+    const QColor ROOF_COLORS[] = { QColor(120, 0, 0), QColor(80, 80, 80), QColor(Qt::black) };
+
+    // Window, door... hole within a wall
+    struct Opening {
+        int offset;
+        int firstLayer;
+        int lastLayer;
+    };
+
+    // Builds a house within its own coordinates: studs on x and y, plates on z, front wall on y = 0
+    class HouseBuilder {
+    public:
+        HouseBuilder(const osg::Matrix& houseMatrix, QVector<CityGenerator::Piece>& pieces) :
+            _houseMatrix(houseMatrix),
+            _pieces(pieces) {
+        }
+
+        void build(int length, int width, quint32& state);
+
+    private:
+        void add(Lego* lego, LegoNode* legoNode, int x, int y, int z, int sizeX, int sizeY, int sizeZ, int nbQuarterTurns);
+        QVector<Opening> createOpenings(int size, bool hasDoor, quint32& state) const;
+        void addWall(int x, int y, bool alongX, int size, const QVector<Opening>& openings);
+        void addBricks(int x, int y, bool alongX, int from, int to, int layer);
+
+    private:
+        osg::Matrix _houseMatrix;
+        QVector<CityGenerator::Piece>& _pieces;
+        QColor _wallColor;
+    };
+
+    void HouseBuilder::add(Lego* lego, LegoNode* legoNode, int x, int y, int z, int sizeX, int sizeY, int sizeZ, int nbQuarterTurns) {
+        // No command holds the Lego of generated pieces, the node does
+        legoNode->setUserData(lego);
+
+        // Pieces are centered on their origin: turn them, then move their center
+        osg::Vec3 center((x + sizeX/2.0)*Lego::length_unit, (y + sizeY/2.0)*Lego::length_unit, (z + sizeZ/2.0)*Lego::height_unit);
+
+        CityGenerator::Piece piece;
+        piece.legoNode = legoNode;
+        piece.matrix = osg::Matrix::rotate(nbQuarterTurns*M_PI/2, osg::Vec3(0, 0, 1)) * osg::Matrix::translate(center) * _houseMatrix;
+        _pieces << piece;
+    }
+
+    QVector<Opening> HouseBuilder::createOpenings(int size, bool hasDoor, quint32& state) const {
+        QVector<Opening> openings;
+
+        // Openings are centered, one stud apart
+        int nbSlots = (size+1) / (OPENING_SIZE+1);
+        if (nbSlots == 0)
+            return openings;
+        int margin = (size - nbSlots*(OPENING_SIZE+1) + 1) / 2;
+        int doorSlot = hasDoor ? randomInt(state, 0, nbSlots-1) : -1;
+
+        for (int k = 0; k < nbSlots; k++) {
+            Opening opening;
+            opening.offset = margin + k*(OPENING_SIZE+1);
+            if (k == doorSlot) {
+                opening.firstLayer = 0;
+                opening.lastLayer = NB_LAYERS-1;
+            } else {
+                // Some walls stay blind
+                if (nextRandom(state) % 3 == 0)
+                    continue;
+                opening.firstLayer = WINDOW_FIRST_LAYER;
+                opening.lastLayer = WINDOW_FIRST_LAYER + WINDOW_LAYERS-1;
+            }
+            openings << opening;
+        }
+
+        return openings;
+    }
+
+    void HouseBuilder::addBricks(int x, int y, bool alongX, int from, int to, int layer) {
+        int pos = from;
+
+        // Joints of odd layers fall in the middle of the bricks below
+        if (layer%2 == 1 && to-from > 2) {
+            addBricks(x, y, alongX, pos, pos+2, 0);
+            pos += 2;
+        }
+
+        while (pos < to) {
+            int size = qMin(4, to-pos);
+            osg::ref_ptr<Brick> brick = new Brick(1, size, Brick::classic, _wallColor);
+            LegoNode* brickNode = new BrickNode(brick.get());
+            if (alongX)
+                add(brick.get(), brickNode, x+pos, y, layer*LAYER_HEIGHT, size, 1, LAYER_HEIGHT, 0);
+            else
+                add(brick.get(), brickNode, x, y+pos, layer*LAYER_HEIGHT, 1, size, LAYER_HEIGHT, 1);
+            pos += size;
+        }
+    }
+
+    void HouseBuilder::addWall(int x, int y, bool alongX, int size, const QVector<Opening>& openings) {
+        // Doors and windows
+        for (int k = 0; k < openings.size(); k++) {
+            const Opening& opening = openings.at(k);
+            int z = opening.firstLayer*LAYER_HEIGHT;
+            int ox = alongX ? x+opening.offset : x;
+            int oy = alongX ? y : y+opening.offset;
+            int sx = alongX ? OPENING_SIZE : 1;
+            int sy = alongX ? 1 : OPENING_SIZE;
+            int nbQuarterTurns = alongX ? 0 : 1;
+
+            if (opening.firstLayer == 0) {
+                osg::ref_ptr<Door> door = new Door;
+                add(door.get(), new DoorNode(door.get()), ox, oy, z, sx, sy, NB_LAYERS*LAYER_HEIGHT, nbQuarterTurns);
+            } else {
+                osg::ref_ptr<Window> window = new Window(Window::classic, true, true, QColor(Qt::white));
+                add(window.get(), new WindowNode(window.get()), ox, oy, z, sx, sy, WINDOW_LAYERS*LAYER_HEIGHT, nbQuarterTurns);
+            }
+        }
+
+        // Bricks around them, layer per layer
+        for (int layer = 0; layer < NB_LAYERS; layer++) {
+            int from = 0;
+            for (int k = 0; k < openings.size(); k++) {
+                const Opening& opening = openings.at(k);
+                if (layer < opening.firstLayer || layer > opening.lastLayer)
+                    continue;
+                addBricks(x, y, alongX, from, opening.offset, layer);
+                from = opening.offset + OPENING_SIZE;
+            }
+            addBricks(x, y, alongX, from, size, layer);
+        }
+    }
+
+    void HouseBuilder::build(int length, int width, quint32& state) {
+        _wallColor = randomColor(state, WALL_COLORS, sizeof(WALL_COLORS)/sizeof(QColor));
+        QColor roofColor = randomColor(state, ROOF_COLORS, sizeof(ROOF_COLORS)/sizeof(QColor));
+
+        // Corners, turned so that their elbow is the house corner
+        for (int layer = 0; layer < NB_LAYERS; layer++) {
+            int z = layer*LAYER_HEIGHT;
+            int corners[4][2] = { { length-2, 0 }, { length-2, width-2 }, { 0, width-2 }, { 0, 0 } };
+            for (int k = 0; k < 4; k++) {
+                osg::ref_ptr<Corner> corner = new Corner(Corner::brick, _wallColor);
+                add(corner.get(), new CornerNode(corner.get()), corners[k][0], corners[k][1], z, 2, 2, LAYER_HEIGHT, k);
+            }
+        }
+
+        // Walls between corners, the door is on the front one
+        addWall(2, 0, true, length-4, createOpenings(length-4, true, state));
+        addWall(2, width-1, true, length-4, createOpenings(length-4, false, state));
+        addWall(0, 2, false, width-4, createOpenings(width-4, false, state));
+        addWall(length-1, 2, false, width-4, createOpenings(width-4, false, state));
+
+        // Roof: slopes on front and back, bricks between them
+        int z = NB_LAYERS*LAYER_HEIGHT;
+        for (int x = 0; x < length; x += 4) {
+            int size = qMin(4, length-x);
+
+            osg::ref_ptr<Tile> frontTile = new Tile(2, size, Tile::classic, roofColor);
+            add(frontTile.get(), new TileNode(frontTile.get()), x, 0, z, size, 2, LAYER_HEIGHT, 3);
+
+            osg::ref_ptr<Tile> backTile = new Tile(2, size, Tile::classic, roofColor);
+            add(backTile.get(), new TileNode(backTile.get()), x, width-2, z, size, 2, LAYER_HEIGHT, 1);
+
+            osg::ref_ptr<Brick> brick = new Brick(width-4, size, Brick::classic, roofColor);
+            add(brick.get(), new BrickNode(brick.get()), x, 2, z, size, width-4, LAYER_HEIGHT, 0);
+        }
+    }
+
+    struct Lot {
+        int x;
+        int y;
+        int length;
+        int width;
+    };
+
+    // Split lots along their longest side, on even studs so that houses match plots
+    void subdivide(const Lot& lot, quint32& state, QVector<Lot>& lots) {
+        bool alongX = lot.length >= lot.width;
+        int size = alongX ? lot.length : lot.width;
+        if (size <= MAX_LOT) {
+            lots << lot;
+            return;
+        }
+
+        int split = 2*randomInt(state, MIN_LOT/2, (size-MIN_LOT)/2);
+        Lot first = lot;
+        Lot second = lot;
+        if (alongX) {
+            first.length = split;
+            second.x += split;
+            second.length -= split;
+        } else {
+            first.width = split;
+            second.y += split;
+            second.width -= split;
+        }
+        subdivide(first, state, lots);
+        subdivide(second, state, lots);
+    }
+}
+
+CityGenerator::CityGenerator(int nbBlocksX, int nbBlocksY, quint32 seed) :
+    _nbBlocksX(nbBlocksX),
+    _nbBlocksY(nbBlocksY),
+    _seed(seed) {
+}
+
+QVector<CityGenerator::Piece> CityGenerator::buildBlock(const Block& block) {
+    PROFILE_SCOPE("CityGenerator::buildBlock");
+
+    QVector<Piece> pieces;
+    quint32 state = block.seed;
+
+    // The block covers its own cells and the roads on its left and bottom, last blocks the closing roads too
+    int firstI = block.i*(BLOCK_CELLS+1);
+    int firstJ = block.j*(BLOCK_CELLS+1);
+    int lastI = (firstI+BLOCK_CELLS+2 == block.nbCellsX) ? block.nbCellsX : firstI+BLOCK_CELLS+1;
+    int lastJ = (firstJ+BLOCK_CELLS+2 == block.nbCellsY) ? block.nbCellsY : firstJ+BLOCK_CELLS+1;
+
+    // City is centered on the origin
+    int originX = -CELL_SIZE*(block.nbCellsX/2);
+    int originY = -CELL_SIZE*(block.nbCellsY/2);
+
+    // Roads, and grass under houses
+    for (int i = firstI; i < lastI; i++) {
+        for (int j = firstJ; j < lastJ; j++) {
+            Road::RoadType roadType;
+            int nbRotations;
+            RoadGenerator::tile(roadSideMask(i, j, block.nbCellsX, block.nbCellsY), roadType, nbRotations);
+
+            osg::ref_ptr<Road> road = new Road(roadType);
+            Piece piece;
+            piece.legoNode = new RoadNode(road.get());
+            piece.legoNode->setUserData(road.get());
+            piece.matrix = osg::Matrix::rotate(-nbRotations*M_PI/2, osg::Vec3(0, 0, 1))
+                * osg::Matrix::translate(Lego::length_unit*(originX + CELL_SIZE*i + CELL_SIZE/2),
+                                         Lego::length_unit*(originY + CELL_SIZE*j + CELL_SIZE/2),
+                                         Lego::height_unit*World::minHeight);
+            pieces << piece;
+        }
+    }
+
+    // Split block into lots
+    Lot blockLot;
+    blockLot.x = originX + CELL_SIZE*(firstI+1);
+    blockLot.y = originY + CELL_SIZE*(firstJ+1);
+    blockLot.length = CELL_SIZE*BLOCK_CELLS;
+    blockLot.width = CELL_SIZE*BLOCK_CELLS;
+    QVector<Lot> lots;
+    subdivide(blockLot, state, lots);
+
+    // One house per lot, looking at the nearest street
+    for (int k = 0; k < lots.size(); k++) {
+        const Lot& lot = lots.at(k);
+        int distances[4] = { lot.y - blockLot.y,
+                             blockLot.x+blockLot.length - (lot.x+lot.length),
+                             blockLot.y+blockLot.width - (lot.y+lot.width),
+                             lot.x - blockLot.x };
+        int facing = 0;
+        for (int side = 1; side < 4; side++) {
+            if (distances[side] < distances[facing])
+                facing = side;
+        }
+
+        // Front is along the street
+        int along = (facing%2 == 0) ? lot.length : lot.width;
+        int depth = (facing%2 == 0) ? lot.width : lot.length;
+        int maxLength = qMin(MAX_HOUSE_LENGTH, along-2*LOT_MARGIN) / 2;
+        int maxWidth = qMin(MAX_HOUSE_WIDTH, depth-2*LOT_MARGIN) / 2;
+        if (2*maxLength < MIN_HOUSE_LENGTH || 2*maxWidth < MIN_HOUSE_WIDTH)
+            continue;
+        int length = 2*randomInt(state, MIN_HOUSE_LENGTH/2, maxLength);
+        int width = 2*randomInt(state, MIN_HOUSE_WIDTH/2, maxWidth);
+
+        // House centered on its lot, turned towards the street
+        osg::Matrix houseMatrix = osg::Matrix::translate(-length*Lego::length_unit/2, -width*Lego::length_unit/2, Lego::height_unit*World::minHeight)
+            * osg::Matrix::rotate(facing*M_PI/2, osg::Vec3(0, 0, 1))
+            * osg::Matrix::translate((lot.x + lot.length/2)*Lego::length_unit, (lot.y + lot.width/2)*Lego::length_unit, 0);
+
+        HouseBuilder(houseMatrix, pieces).build(length, width, state);
+    }
+
+    return pieces;
+}
+
+const QVector<CityGenerator::Piece>& CityGenerator::generate(void) {
+    PROFILE_SCOPE("CityGenerator::generate");
+
+    _pieces.clear();
+    if (_nbBlocksX <= 0 || _nbBlocksY <= 0)
+        return _pieces;
+
+    // Every block has its own random numbers, so that the city doesn't depend on thread scheduling
+    QList<Block> blocks;
+    for (int i = 0; i < _nbBlocksX; i++) {
+        for (int j = 0; j < _nbBlocksY; j++) {
+            Block block;
+            block.i = i;
+            block.j = j;
+            block.nbCellsX = _nbBlocksX*(BLOCK_CELLS+1) + 1;
+            block.nbCellsY = _nbBlocksY*(BLOCK_CELLS+1) + 1;
+            block.seed = _seed ^ (0x9e3779b9 * (blocks.size()+1));
+            if (block.seed == 0)
+                block.seed = 0x9e3779b9;
+            blocks << block;
+        }
+    }
+
+    // Blocks are built within the global thread pool, pieces geometry included
+    QList<QVector<Piece> > blockPieces = QtConcurrent::blockingMapped(blocks, buildBlock);
+    for (int k = 0; k < blockPieces.size(); k++)
+        _pieces += blockPieces.at(k);
+
+    return _pieces;
+}
+
+RoadGenerator::RoadGrid CityGenerator::getRoadGrid(void) const {
+    RoadGenerator::RoadGrid roadGrid;
+    roadGrid.width = qMax(0, _nbBlocksX*(BLOCK_CELLS+1) + 1);
+    roadGrid.length = qMax(0, _nbBlocksY*(BLOCK_CELLS+1) + 1);
+
+    // Same cells as buildBlock, the city being centered on the origin
+    roadGrid.origin = osg::Vec3(Lego::length_unit*(-CELL_SIZE*(roadGrid.width/2) + CELL_SIZE/2),
+                                Lego::length_unit*(-CELL_SIZE*(roadGrid.length/2) + CELL_SIZE/2),
+                                Lego::height_unit*World::minHeight);
+
+    roadGrid.sideMasks.reserve(roadGrid.width*roadGrid.length);
+    for (int i = 0; i < roadGrid.width; i++) {
+        for (int j = 0; j < roadGrid.length; j++)
+            roadGrid.sideMasks << roadSideMask(i, j, roadGrid.width, roadGrid.length);
+    }
+
+    return roadGrid;
+}
+
+const QVector<CityGenerator::Piece>& CityGenerator::generateHouse(int length, int width) {
+    PROFILE_SCOPE("CityGenerator::generateHouse");
+
+    _pieces.clear();
+
+    quint32 state = _seed ? _seed : 0x9e3779b9;
+
+    // Single house centered on the origin
+    length = qMax(MIN_HOUSE_LENGTH, length & ~1);
+    width = qMax(MIN_HOUSE_WIDTH, width & ~1);
+    osg::Matrix houseMatrix = osg::Matrix::translate(-length*Lego::length_unit/2, -width*Lego::length_unit/2, Lego::height_unit*World::minHeight);
+    HouseBuilder(houseMatrix, _pieces).build(length, width, state);
+
+    return _pieces;
+}
@@ -0,0 +1,50 @@
+#ifndef CITYGENERATOR_H
+#define CITYGENERATOR_H
+
+#include <QVector>
+
+#include <osg/Matrix>
+#include <osg/ref_ptr>
+
+#include "LegoNode.h"
+#include "RoadGenerator.h"
+
+class CityGenerator {
+
+public:
+    // A generated piece, with its matrix within the world
+    struct Piece {
+        osg::ref_ptr<LegoNode> legoNode;
+        osg::Matrix matrix;
+    };
+
+    // Blocks are square, and share their road with their neighbours
+    struct Block {
+        int i;
+        int j;
+        int nbCellsX;
+        int nbCellsY;
+        quint32 seed;
+    };
+
+public:
+    CityGenerator(int nbBlocksX, int nbBlocksY, quint32 seed);
+
+    const QVector<Piece>& generate(void);
+    const QVector<Piece>& generateHouse(int length, int width);
+
+    const QVector<Piece>& getPieces(void) const { return _pieces; }
+    RoadGenerator::RoadGrid getRoadGrid(void) const;
+
+private:
+    static QVector<Piece> buildBlock(const Block& block);
+
+private:
+    int _nbBlocksX;
+    int _nbBlocksY;
+    quint32 _seed;
+
+    QVector<Piece> _pieces;
+};
+
+#endif // CITYGENERATOR_H
@@ -2,11 +2,19 @@
 
 ClampDialog::ClampDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 ClampDialog::ClampDialog(const ClampDialog& clampDialog) :
     LegoDialog(clampDialog) {
-    
+
+    // Build dialog widgets
+    createWidgets();
+}
+
+void ClampDialog::createWidgets(void) {
     // Main Layout
     QVBoxLayout* mainLayout = new QVBoxLayout;
     
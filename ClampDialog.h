@@ -18,6 +18,8 @@ public:
     virtual void setLego(int) {}
     
 private:
+    void createWidgets(void);
+
     
 };
 
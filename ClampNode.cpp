@@ -1,4 +1,5 @@
 #include "ClampNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Material>
@@ -22,6 +23,8 @@ ClampNode::ClampNode(const ClampNode& clampNode) :
 }
 
 void ClampNode::createGeode(void) {
+    PROFILE_SCOPE("ClampNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
     
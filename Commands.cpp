@@ -1,6 +1,7 @@
 #include "Commands.h"
 
 #include "World.h"
+#include "Profiler.h"
 
 #include <QDebug>
 
@@ -24,10 +25,12 @@ AddLegoCommand::AddLegoCommand(World* world, osg::ref_ptr<LegoNode> legoNode, QU
 }
 
 void AddLegoCommand::undo(void) {
+    PROFILE_SCOPE("AddLegoCommand::undo");
     _world->deleteLego(_matrixName);
 }
 
 void AddLegoCommand::redo(void) {
+    PROFILE_SCOPE("AddLegoCommand::redo");
     _matrixName = _world->addBrick(_currLegoNode.get(), _currLego.get());
 }
 
@@ -50,10 +53,12 @@ DeleteLegoCommand::DeleteLegoCommand(World* world, osg::ref_ptr<LegoNode> legoNo
 }
 
 void DeleteLegoCommand::undo(void) {
+    PROFILE_SCOPE("DeleteLegoCommand::undo");
     _matrixName = _world->addBrick(_currLegoNode.get(), _currLego.get());
 }
 
 void DeleteLegoCommand::redo(void) {
+    PROFILE_SCOPE("DeleteLegoCommand::redo");
     _world->deleteLego(_matrixName);
 }
 
@@ -84,3 +89,133 @@ void MoveLegoCommand::undo(void) {
 void MoveLegoCommand::redo(void) {
     //_world->translation(_matTransIndex);
 }
+
+
+// /////////////////////////////////////////////////////////////////
+// DeleteSelectionCommand
+// /////////////////////////////////////////////////////////////////
+
+DeleteSelectionCommand::DeleteSelectionCommand(World* world, const World::PieceList& pieces, QUndoCommand* parent) :
+    QUndoCommand(parent),
+    _world(world),
+    _pieces(pieces) {
+
+    setText(QString("Del %1 pieces").arg(_pieces.size()));
+}
+
+void DeleteSelectionCommand::undo(void) {
+    PROFILE_SCOPE("DeleteSelectionCommand::undo");
+    // Matrix transforms are kept alive by _pieces, so they come back untouched
+    _world->restorePieces(_pieces);
+}
+
+void DeleteSelectionCommand::redo(void) {
+    PROFILE_SCOPE("DeleteSelectionCommand::redo");
+    _world->removePieces(_pieces);
+}
+
+
+// /////////////////////////////////////////////////////////////////
+// MoveSelectionCommand
+// /////////////////////////////////////////////////////////////////
+
+MoveSelectionCommand::MoveSelectionCommand(World* world, const World::PieceList& pieces, int x, int y, int z, QUndoCommand* parent) :
+    QUndoCommand(parent),
+    _world(world),
+    _pieces(pieces),
+    _x(x),
+    _y(y),
+    _z(z) {
+
+    setText(QString("Move %1 pieces").arg(_pieces.size()));
+}
+
+void MoveSelectionCommand::undo(void) {
+    PROFILE_SCOPE("MoveSelectionCommand::undo");
+    _world->movePieces(_pieces, -_x, -_y, -_z);
+}
+
+void MoveSelectionCommand::redo(void) {
+    PROFILE_SCOPE("MoveSelectionCommand::redo");
+    _world->movePieces(_pieces, _x, _y, _z);
+}
+
+
+// /////////////////////////////////////////////////////////////////
+// ColorSelectionCommand
+// /////////////////////////////////////////////////////////////////
+
+ColorSelectionCommand::ColorSelectionCommand(World* world, const World::PieceList& pieces, const QColor& color, QUndoCommand* parent) :
+    QUndoCommand(parent),
+    _world(world),
+    _pieces(pieces),
+    _newColors(pieces.size(), color) {
+
+    // Record previous colors, to restore them on undo
+    _oldColors.reserve(_pieces.size());
+    for (int k = 0; k < _pieces.size(); k++) {
+        LegoNode* legoNode = dynamic_cast<LegoNode*>(_pieces.at(k)->getChild(0));
+        _oldColors << (legoNode ? legoNode->getLego()->getColor() : color);
+    }
+
+    setText(QString("Color %1 pieces").arg(_pieces.size()));
+}
+
+void ColorSelectionCommand::undo(void) {
+    PROFILE_SCOPE("ColorSelectionCommand::undo");
+    _world->colorPieces(_pieces, _oldColors);
+}
+
+void ColorSelectionCommand::redo(void) {
+    PROFILE_SCOPE("ColorSelectionCommand::redo");
+    _world->colorPieces(_pieces, _newColors);
+}
+
+
+// /////////////////////////////////////////////////////////////////
+// AddPiecesCommand
+// /////////////////////////////////////////////////////////////////
+
+AddPiecesCommand::AddPiecesCommand(World* world, const World::PieceList& pieces, const QString& text, QUndoCommand* parent) :
+    QUndoCommand(parent),
+    _world(world),
+    _pieces(pieces) {
+
+    setText(QString("%1 (%2 pieces)").arg(text).arg(_pieces.size()));
+}
+
+void AddPiecesCommand::undo(void) {
+    PROFILE_SCOPE("AddPiecesCommand::undo");
+    _world->removePieces(_pieces);
+}
+
+void AddPiecesCommand::redo(void) {
+    PROFILE_SCOPE("AddPiecesCommand::redo");
+    // Generated pieces are added to the world in one batch
+    _world->restorePieces(_pieces);
+}
+
+
+// /////////////////////////////////////////////////////////////////
+// SetRoadsCommand
+// /////////////////////////////////////////////////////////////////
+
+SetRoadsCommand::SetRoadsCommand(Traffic* traffic, const RoadGenerator::RoadGrid& roadGrid, QUndoCommand* parent) :
+    QUndoCommand(parent),
+    _traffic(traffic),
+    _oldRoadGrid(traffic->getRoads()),
+    _newRoadGrid(roadGrid) {
+
+    setText("Set traffic roads");
+}
+
+void SetRoadsCommand::undo(void) {
+    PROFILE_SCOPE("SetRoadsCommand::undo");
+    // Vehicules drive back on the roads they had before
+    _traffic->setRoads(_oldRoadGrid);
+}
+
+void SetRoadsCommand::redo(void) {
+    PROFILE_SCOPE("SetRoadsCommand::redo");
+    _traffic->setRoads(_newRoadGrid);
+}
@@ -5,6 +5,7 @@
 
 #include "World.h"
 #include "LegoNode.h"
+#include "Traffic.h"
 
 
 class AddLegoCommand : public QUndoCommand {
@@ -60,5 +61,71 @@ public:
     RotateLegoCommand();
 };
 
+class DeleteSelectionCommand : public QUndoCommand {
+public:
+    DeleteSelectionCommand(World* world, const World::PieceList& pieces, QUndoCommand* parent = NULL);
+
+    virtual void undo(void);
+    virtual void redo(void);
+
+private:
+    World* _world;
+    World::PieceList _pieces;
+};
+
+class MoveSelectionCommand : public QUndoCommand {
+public:
+    MoveSelectionCommand(World* world, const World::PieceList& pieces, int x, int y, int z, QUndoCommand* parent = NULL);
+
+    virtual void undo(void);
+    virtual void redo(void);
+
+private:
+    World* _world;
+    World::PieceList _pieces;
+    int _x;
+    int _y;
+    int _z;
+};
+
+class ColorSelectionCommand : public QUndoCommand {
+public:
+    ColorSelectionCommand(World* world, const World::PieceList& pieces, const QColor& color, QUndoCommand* parent = NULL);
+
+    virtual void undo(void);
+    virtual void redo(void);
+
+private:
+    World* _world;
+    World::PieceList _pieces;
+    QVector<QColor> _oldColors;
+    QVector<QColor> _newColors;
+};
+
+class AddPiecesCommand : public QUndoCommand {
+public:
+    AddPiecesCommand(World* world, const World::PieceList& pieces, const QString& text, QUndoCommand* parent = NULL);
+
+    virtual void undo(void);
+    virtual void redo(void);
+
+private:
+    World* _world;
+    World::PieceList _pieces;
+};
+
+class SetRoadsCommand : public QUndoCommand {
+public:
+    SetRoadsCommand(Traffic* traffic, const RoadGenerator::RoadGrid& roadGrid, QUndoCommand* parent = NULL);
+
+    virtual void undo(void);
+    virtual void redo(void);
+
+private:
+    Traffic* _traffic;
+    RoadGenerator::RoadGrid _oldRoadGrid;
+    RoadGenerator::RoadGrid _newRoadGrid;
+};
+
 
 #endif // COMMANDS_H
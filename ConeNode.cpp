@@ -1,6 +1,6 @@
 #include "ConeNode.h"
+#include "Profiler.h"
 
-#include <osg/ShapeDrawable>
 #include <osg/MatrixTransform>
 #include <osg/Geometry>
 #include <osg/Material>
@@ -23,6 +23,8 @@ ConeNode::ConeNode(const ConeNode& coneNode) :
 }
 
 void ConeNode::createGeode(void) {
+    PROFILE_SCOPE("ConeNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
 
@@ -58,13 +60,8 @@ void ConeNode::createGeode(void) {
     addChild(createBottomCylinder(0, 0, 0.5, false, (-height+0.5)*Lego::height_unit/2));
 
     // Add bottom cache
-    osg::ref_ptr<osg::ShapeDrawable> cache = new osg::ShapeDrawable(
-                new osg::Cylinder(
-                    osg::Vec3(0, 0, zCenter-length/2),
-                    Lego::length_unit/2,
-                    0.1));
-    cache->setColor(osg::Vec4(static_cast<float>(color.red())/255.0, static_cast<float>(color.green())/255.0, static_cast<float>(color.blue())/255.0, 1.0));
-    geode->addDrawable(cache);
+    geode->addDrawable(makeSolidCylinder(osg::Vec3(0, 0, zCenter-length/2), osg::Vec3(0, 0, 1), Lego::length_unit/2, 0.1,
+                                         osg::Vec4(static_cast<float>(color.red())/255.0, static_cast<float>(color.green())/255.0, static_cast<float>(color.blue())/255.0, 1.0)));
 }
 
 osg::Geometry* ConeNode::createTruncatedCone(double startRadius, double endRadius, double center, double length, int numberSegments) {
@@ -2,11 +2,19 @@
 
 CornerDialog::CornerDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 CornerDialog::CornerDialog(const CornerDialog& cornerDialog) :
     LegoDialog(cornerDialog) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void CornerDialog::createWidgets(void) {
     // Corner type
     _cornerTypeComboBox = new QComboBox(this);
     QStringList cornerTypeList;
@@ -21,6 +21,8 @@ public slots:
     virtual void setLego(int);
 
 private:
+    void createWidgets(void);
+
     QComboBox* _cornerTypeComboBox;
 };
 
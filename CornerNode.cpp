@@ -1,4 +1,5 @@
 #include "CornerNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Material>
@@ -18,6 +19,8 @@ CornerNode::CornerNode(const CornerNode& cornerNode) :
 }
 
 void CornerNode::createGeode(void) {
+    PROFILE_SCOPE("CornerNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
 
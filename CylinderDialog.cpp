@@ -2,11 +2,19 @@
 
 CylinderDialog::CylinderDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 CylinderDialog::CylinderDialog(const CylinderDialog& cylinderDialog) :
     LegoDialog(cylinderDialog) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void CylinderDialog::createWidgets(void) {
     // Cylinder type
     _cylinderTypeComboBox = new QComboBox(this);
     QStringList cylinderTypeList;
@@ -1,8 +1,8 @@
 #include "CylinderNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Material>
-#include <osg/ShapeDrawable>
 
 CylinderNode::CylinderNode() :
     LegoNode() {
@@ -19,6 +19,8 @@ CylinderNode::CylinderNode(const CylinderNode& cylinderNode) :
 }
 
 void CylinderNode::createGeode(void) {
+    PROFILE_SCOPE("CylinderNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
 
@@ -83,47 +85,19 @@ void CylinderNode::createGeode(void) {
 
     // Get color
     QColor color = _lego->getColor();
+    osg::Vec4 colorVec(static_cast<float>(color.red())/255.0, static_cast<float>(color.green())/255.0, static_cast<float>(color.blue())/255.0, 1.0);
 
     // Create cylinder shape for big ones
     if (isBig) {
-        osg::ref_ptr<osg::ShapeDrawable> cylinderShape = new osg::ShapeDrawable(
-                                             new osg::Cylinder(
-                                                 osg::Vec3(0.0, 0.0, 0.0),
-                                                 radius*Lego::length_unit,
-                                                 height*Lego::height_unit
-                                             )
-                                         );
-        // Assign color
-        cylinderShape->setColor(osg::Vec4(static_cast<float>(color.red())/255.0, static_cast<float>(color.green())/255.0, static_cast<float>(color.blue())/255.0, 1.0));
-
-        // Add cylinder shape
-        geode->addDrawable(cylinderShape.get());
+        geode->addDrawable(makeSolidCylinder(osg::Vec3(0.0, 0.0, 0.0), osg::Vec3(0, 0, 1),
+                                             radius*Lego::length_unit, height*Lego::height_unit, colorVec));
 
     // Create cylinder shapes for thin ones
     } else {
-        osg::ref_ptr<osg::ShapeDrawable> cylinderShape = new osg::ShapeDrawable(
-                                             new osg::Cylinder(
-                                                 osg::Vec3(0.0, 0.0, Lego::plot_top_height/2),
-                                                 radius*Lego::length_unit,
-                                                 height*Lego::height_unit-Lego::plot_top_height
-                                             )
-                                         );
-        // Assign color
-        cylinderShape->setColor(osg::Vec4(static_cast<float>(color.red())/255.0, static_cast<float>(color.green())/255.0, static_cast<float>(color.blue())/255.0, 1.0));
-
-        osg::ref_ptr<osg::ShapeDrawable> bottomCyShape = new osg::ShapeDrawable(
-                                             new osg::Cylinder(
-                                                 osg::Vec3(0.0, 0.0, -height*Lego::height_unit/2+Lego::plot_top_height/2),
-                                                 Lego::plot_bottom_radius,
-                                                 Lego::plot_top_height
-                                             )
-                                         );
-        // Assign color
-        bottomCyShape->setColor(osg::Vec4(static_cast<float>(color.red())/255.0, static_cast<float>(color.green())/255.0, static_cast<float>(color.blue())/255.0, 1.0));
-
-        // Add cylinder shape
-        geode->addDrawable(cylinderShape.get());
-        geode->addDrawable(bottomCyShape.get());
+        geode->addDrawable(makeSolidCylinder(osg::Vec3(0.0, 0.0, Lego::plot_top_height/2), osg::Vec3(0, 0, 1),
+                                             radius*Lego::length_unit, height*Lego::height_unit-Lego::plot_top_height, colorVec));
+        geode->addDrawable(makeSolidCylinder(osg::Vec3(0.0, 0.0, -height*Lego::height_unit/2+Lego::plot_top_height/2), osg::Vec3(0, 0, 1),
+                                             Lego::plot_bottom_radius, Lego::plot_top_height, colorVec));
     }
 
     // Add plots iteratively if the cylinder type is not flat
@@ -2,7 +2,12 @@
 
 
 DoorDialog::DoorDialog(QWidget* parent) :
-    LegoDialog(parent) {
+    LegoDialog(parent),
+    _doorColor(Qt::white),
+    _doorHandleColor(Qt::black) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 DoorDialog::DoorDialog(const DoorDialog& doorDialog) :
@@ -10,6 +15,11 @@ DoorDialog::DoorDialog(const DoorDialog& doorDialog) :
     _doorColor(Qt::white),
     _doorHandleColor(Qt::black) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void DoorDialog::createWidgets(void) {
     // Door Color Button
     _doorColorButton = new QPushButton("", this);
     _doorColorButton->setIcon(QIcon("../LEGO_CREATOR/IMG/icons/color.png"));
@@ -22,6 +22,8 @@ private slots:
     void browseDoorHandleColor(void);
 
 private:
+    void createWidgets(void);
+
     QPushButton* _doorColorButton;
     QColor _doorColor;
     QPushButton* _doorHandleColorButton;
@@ -1,4 +1,5 @@
 #include "DoorNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Material>
@@ -22,6 +23,8 @@ DoorNode::DoorNode(const DoorNode& doorNode) :
 }
 
 void DoorNode::createGeode(void) {
+    PROFILE_SCOPE("DoorNode::createGeode");
+
     // Remove children if any
     removeChildren(0, getNumChildren());
 
@@ -2,11 +2,19 @@
 
 EdgeDialog::EdgeDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 EdgeDialog::EdgeDialog(const EdgeDialog& edgeDialog) :
     LegoDialog(edgeDialog) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void EdgeDialog::createWidgets(void) {
     // Edge type
     _edgeTypeComboBox = new QComboBox(this);
     QStringList edgeTypeList;
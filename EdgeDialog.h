@@ -25,6 +25,8 @@ public slots:
     virtual void updateMaxLength(int edgeType);
 
 private:
+    void createWidgets(void);
+
     QSpinBox* _lengthSpinBox;
     QComboBox* _edgeTypeComboBox;
     QGroupBox* _lengthGroupBox;
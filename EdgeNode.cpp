@@ -1,4 +1,5 @@
 #include "EdgeNode.h"
+#include "Profiler.h"
 
 #include <osg/ShapeDrawable>
 #include <osg/MatrixTransform>
@@ -20,6 +21,8 @@ EdgeNode::EdgeNode(const EdgeNode& edgeNode) :
 }
 
 void EdgeNode::createGeode(void) {
+    PROFILE_SCOPE("EdgeNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
 
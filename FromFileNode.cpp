@@ -1,6 +1,6 @@
 #include "FromFileNode.h"
-
-#include <osgDB/ReadFile>
+#include "ModelCache.h"
+#include "Profiler.h"
 
 FromFileNode::FromFileNode() :
     LegoNode() {
@@ -17,6 +17,8 @@ FromFileNode::FromFileNode(const FromFileNode& fromFileNode) :
 }
 
 void FromFileNode::createGeode(void) {
+    PROFILE_SCOPE("FromFileNode::createGeode");
+
     removeChildren(0, getNumChildren());
 
     // Get the fromFile
@@ -25,8 +27,10 @@ void FromFileNode::createGeode(void) {
     // Get file name
     QString fileName = fromFile->getFileName();
 
-    // Read osg file
-    addChild(osgDB::readNodeFile(fileName.toStdString()));
+    // Shared model, already read when MainWindow imported it in background
+    osg::Node* model = ModelCache::get(fileName);
+    if (model)
+        addChild(model);
 }
 
 FromFileNode* FromFileNode::cloning(void) const {
@@ -1,4 +1,5 @@
 #include "FrontShipNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Material>
@@ -20,6 +21,8 @@ FrontShipNode::FrontShipNode(const FrontShipNode& frontShipNode) :
 }
 
 void FrontShipNode::createGeode(void) {
+    PROFILE_SCOPE("FrontShipNode::createGeode");
+
     // Get integer sizes
     int width = 3;
     int length = 4;
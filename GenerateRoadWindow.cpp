@@ -1,21 +1,33 @@
 #include "GenerateRoadWindow.h"
 
+#include <climits>
+#include <cstdlib>
+
+// Largest circuit, in road parts
+#define MAX_ROAD_SIZE 256
+
 GenerateRoadWindow::GenerateRoadWindow(QWidget *parent) :
     QDialog(parent) {
 
     // Width
     _widthSpinBox = new QSpinBox(this);
     _widthSpinBox->setValue(2);
-    _widthSpinBox->setMinimum(1);
+    _widthSpinBox->setRange(1, MAX_ROAD_SIZE);
 
     // Length
     _lengthSpinBox = new QSpinBox(this);
     _lengthSpinBox->setValue(2);
-    _lengthSpinBox->setMinimum(1);
+    _lengthSpinBox->setRange(1, MAX_ROAD_SIZE);
+
+    // Seed, random by default, kept to generate the same circuit again
+    _seedSpinBox = new QSpinBox(this);
+    _seedSpinBox->setRange(0, INT_MAX);
+    _seedSpinBox->setValue(rand());
 
     QFormLayout* dimensionLayout = new QFormLayout;
     dimensionLayout->addRow("Width:", _widthSpinBox);
     dimensionLayout->addRow("Length:", _lengthSpinBox);
+    dimensionLayout->addRow("Seed:", _seedSpinBox);
 
     // Buttons
     _cancelButton = new QPushButton("Cancel", this);
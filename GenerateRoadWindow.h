@@ -12,6 +12,7 @@ public:
 
     int getWidth(void) const { return _widthSpinBox->text().toInt(); }
     int getLength(void) const { return _lengthSpinBox->text().toInt(); }
+    quint32 getSeed(void) const { return _seedSpinBox->value(); }
     
 signals:
     
@@ -20,6 +21,7 @@ public slots:
 private:
     QSpinBox* _widthSpinBox;
     QSpinBox* _lengthSpinBox;
+    QSpinBox* _seedSpinBox;
 
     QPushButton* _okButton;
     QPushButton* _cancelButton;
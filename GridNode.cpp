@@ -1,4 +1,5 @@
 #include "GridNode.h"
+#include "Profiler.h"
 
 #include <osg/ShapeDrawable>
 #include <osg/MatrixTransform>
@@ -20,6 +21,8 @@ GridNode::GridNode(const GridNode& gridNode) :
 }
 
 void GridNode::createGeode(void) {
+    PROFILE_SCOPE("GridNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
 
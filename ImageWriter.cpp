@@ -0,0 +1,87 @@
+#include "ImageWriter.h"
+
+#include <osgDB/WriteFile>
+
+#include <QDebug>
+
+// Images waiting to be written, before capture blocks: keeps memory bounded on long batches
+#define MAX_QUEUED_JOBS 32
+
+ImageWriter* ImageWriter::instance(void) {
+    // Single writer thread, started on first use
+    static ImageWriter writer;
+    if (!writer.isRunning())
+        writer.start(QThread::LowPriority);
+    return &writer;
+}
+
+ImageWriter::ImageWriter(void) :
+    QThread(),
+    _busy(false),
+    _stopping(false) {
+}
+
+ImageWriter::~ImageWriter(void) {
+    // Write pending images, then stop thread
+    _mutex.lock();
+    _stopping = true;
+    _jobAdded.wakeAll();
+    _mutex.unlock();
+    wait();
+}
+
+void ImageWriter::write(osg::Image* image, const std::string& fileName, const osgDB::Options* options) {
+    Job job;
+    job.image = image;
+    job.fileName = fileName;
+    job.options = options;
+
+    QMutexLocker locker(&_mutex);
+    while (_jobs.size() >= MAX_QUEUED_JOBS)
+        _jobTaken.wait(&_mutex);
+    _jobs.enqueue(job);
+    _jobAdded.wakeOne();
+}
+
+void ImageWriter::waitForDone(void) {
+    QMutexLocker locker(&_mutex);
+    while (!_jobs.isEmpty() || _busy)
+        _jobsDone.wait(&_mutex);
+}
+
+QStringList ImageWriter::takeWritten(void) {
+    // Files successfully written since last call
+    QMutexLocker locker(&_mutex);
+    QStringList written = _written;
+    _written.clear();
+    return written;
+}
+
+void ImageWriter::run(void) {
+    _mutex.lock();
+    forever {
+        // Wait for next image
+        while (_jobs.isEmpty()) {
+            _jobsDone.wakeAll();
+            if (_stopping) {
+                _mutex.unlock();
+                return;
+            }
+            _jobAdded.wait(&_mutex);
+        }
+        Job job = _jobs.dequeue();
+        _busy = true;
+        _jobTaken.wakeOne();
+        _mutex.unlock();
+
+        // Encoding and disk access happen out of the lock
+        bool ok = osgDB::writeImageFile(*job.image, job.fileName, job.options.get());
+        if (!ok)
+            qDebug() << "Cannot write" << QString::fromStdString(job.fileName) << "within ImageWriter::run";
+
+        _mutex.lock();
+        if (ok)
+            _written << QString::fromStdString(job.fileName);
+        _busy = false;
+    }
+}
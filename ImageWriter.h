@@ -0,0 +1,49 @@
+#ifndef IMAGEWRITER_H
+#define IMAGEWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QStringList>
+
+#include <osg/Image>
+#include <osgDB/Options>
+
+#include <string>
+
+class ImageWriter : public QThread {
+
+public:
+    static ImageWriter* instance(void);
+
+    void write(osg::Image* image, const std::string& fileName, const osgDB::Options* options = NULL);
+    void waitForDone(void);
+    QStringList takeWritten(void);
+
+protected:
+    virtual void run(void);
+
+private:
+    ImageWriter(void);
+    virtual ~ImageWriter(void);
+
+    // One image to encode and write
+    struct Job {
+        osg::ref_ptr<osg::Image> image;
+        std::string fileName;
+        osg::ref_ptr<const osgDB::Options> options;
+    };
+
+private:
+    QQueue<Job> _jobs;
+    QStringList _written;
+    QMutex _mutex;
+    QWaitCondition _jobAdded;
+    QWaitCondition _jobTaken;
+    QWaitCondition _jobsDone;
+    bool _busy;
+    bool _stopping;
+};
+
+#endif // IMAGEWRITER_H
@@ -0,0 +1,25 @@
+# LDraw parts catalog indexer
+TARGET = LEGO_Indexer
+
+CONFIG += console thread
+CONFIG -= app_bundle
+
+QT -= gui
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ../PartCatalog.cpp \
+    ../LDrawParser.cpp \
+    ../Profiler.cpp
+
+HEADERS += \
+    ../PartCatalog.h \
+    ../LDrawParser.h \
+    ../Profiler.h
+
+LIBS += \
+    -losg \
+    -losgUtil \
+    -lOpenThreads
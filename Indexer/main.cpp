@@ -0,0 +1,40 @@
+// Index headers of every LDraw part within a single file, used by the part browser.
+// Usage: LEGO_Indexer [ldrawPath] [indexFile]
+// Paths default to LDrawPath and PartsIndex settings. Only parts whose modification
+// time changed since last run are read again.
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "PartCatalog.h"
+#include "LDrawParser.h"
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+
+    // Get paths from command line, or from settings
+    QSettings settings(QSettings::UserScope, "Perso", "Lego Creator");
+    QString ldrawPath = (args.size() > 1) ? args.at(1) : settings.value("LDrawPath", LDrawParser::getLDrawPath()).toString();
+    QString indexFileName = (args.size() > 2) ? args.at(2) : settings.value("PartsIndex", "../LEGO_CREATOR/OSG/parts.index").toString();
+    if (!ldrawPath.endsWith('/'))
+        ldrawPath += '/';
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Start from previous index, if any
+    PartCatalog catalog;
+    catalog.load(indexFileName);
+
+    // Read new and modified parts only
+    int changed = catalog.update(ldrawPath + "parts/");
+    qDebug() << catalog.size() << "parts indexed in" << timer.elapsed() << "ms";
+
+    if (changed > 0 && !catalog.save(indexFileName))
+        return 1;
+
+    return 0;
+}
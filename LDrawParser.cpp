@@ -2,10 +2,13 @@
 #define TESTP 0
 
 #include "LDrawParser.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Geode>
 #include <osg/MatrixTransform>
+#include <osg/CullFace>
+#include <osg/LightModel>
 #include <osgUtil/SmoothingVisitor>
 
 #include <QDir>
@@ -13,34 +16,78 @@
 #include <QTextStream>
 #include <QDebug>
 #include <QStringList>
+#include <QRegExp>
+
+#include <cmath>
 
 // Static integer to handle tab shift when debugging
 int LDrawParser::tab = 0;
 
-LDrawParser::LDrawParser(const QString& fileName) :
-    _fileName(fileName) {
+// LDraw library root, containing LDConfig.ldr, p/ and parts/
+QString LDrawParser::_ldrawPath = "/home/shaolan/Documents/ldraw/";
+
+// Colors of LDConfig.ldr, read by the first parser
+QSharedPointer<const LDrawParser::ColorTable> LDrawParser::_sharedColorTable;
+QMutex LDrawParser::_colorTableMutex;
+
+void LDrawParser::setLDrawPath(const QString& ldrawPath) {
+    _ldrawPath = ldrawPath;
+    if (!_ldrawPath.endsWith('/'))
+        _ldrawPath += '/';
+
+    // Parsers already running keep the table they started with
+    QMutexLocker locker(&_colorTableMutex);
+    _sharedColorTable.clear();
+}
+
+// Generated primitives, shared by every parser
+QHash<QString, QSharedPointer<const LDrawParser::Primitive> > LDrawParser::_primitives;
+QMutex LDrawParser::_primitivesMutex;
+int LDrawParser::_primitiveSegments = 12;
 
-    fillColorsArray();
+void LDrawParser::setPrimitiveSegments(int primitiveSegments) {
+    // Quarters of circles have to fall on segments
+    _primitiveSegments = qMax(4, (primitiveSegments + 3) / 4 * 4);
+}
+
+LDrawParser::LDrawParser(const QString& fileName) :
+    _fileName(fileName),
+    _colorTable(colorTable()) {
 }
 
 LDrawParser::LDrawParser(const LDrawParser& lDrawParser) {
     _fileName = lDrawParser._fileName;
-    _colorsArray = lDrawParser._colorsArray;
+    _colorTable = lDrawParser._colorTable;
 }
 
 LDrawParser::~LDrawParser(void) {
 }
 
-void LDrawParser::fillColorsArray(void) {
+QSharedPointer<const LDrawParser::ColorTable> LDrawParser::colorTable(void) {
+    QMutexLocker locker(&_colorTableMutex);
+    if (!_sharedColorTable)
+        _sharedColorTable = readColorTable();
+    return _sharedColorTable;
+}
+
+QSharedPointer<const LDrawParser::ColorTable> LDrawParser::readColorTable(void) {
+    PROFILE_SCOPE("LDrawParser::readColorTable");
 
     // Try to open colors specifications text file in read only mode
-    QFile file("/home/shaolan/Documents/ldraw/LDConfig.ldr");
+    QFile file(_ldrawPath + "LDConfig.ldr");
     if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        qDebug() << "Error while opening LDConfig.ldr file within LDrawParser::fillColorsArray";
+        qDebug() << "Error while opening LDConfig.ldr file within LDrawParser::readColorTable";
         // Throw exception
         throw OpenFailed();
     }
 
+    // Unknown codes are drawn black
+    QSharedPointer<ColorTable> table(new ColorTable);
+    for (int k = 0; k < NB_COLOR_CODES; k++) {
+        table->colors[k].surfColor = osg::Vec4(0.0, 0.0, 0.0, 1.0);
+        table->colors[k].edgeColor = osg::Vec4(0.0, 0.0, 0.0, 1.0);
+    }
+
     // Stream text and encode in UTF-8
     QTextStream inFile(&file);
     inFile.setCodec("UTF-8");
@@ -59,62 +106,190 @@ void LDrawParser::fillColorsArray(void) {
 
         // If the line has almost 9 fields and whose second one is !COLOUR, we create the color specification
         if (commandArgs.size() > 8 && commandArgs.at(1) == "!COLOUR") {
-            // Create color params
-            ColorParams currColorParams;
-            currColorParams.colorName = commandArgs.at(2);
-            currColorParams.surfValue = commandArgs.at(6);
-            currColorParams.edgeValue = commandArgs.at(8);
-
-            if (commandArgs.size() > 10)
-                currColorParams.alphaValue = commandArgs.at(10).toDouble();
-            else
-                currColorParams.alphaValue = 255.0;
-
             // Get color id
-            int colorId = commandArgs.at(4).toInt();
+            int colorId = parseColorCode(commandArgs.at(4));
+            if (colorId < 0) {
+                qDebug() << "Invalid color code" << commandArgs.at(4) << "within LDrawParser::readColorTable";
+                continue;
+            }
 
-            // Insert it among other colors
-            _colorsArray.insert(colorId, currColorParams);
+            // Alpha is optional, opaque by default
+            double alphaValue = 255.0;
+            int alphaIndex = commandArgs.indexOf("ALPHA");
+            if (alphaIndex > 0 && alphaIndex + 1 < commandArgs.size())
+                alphaValue = commandArgs.at(alphaIndex + 1).toDouble();
+
+            // Resolve colors once for all primitives using them
+            ColorParams colorParams;
+            colorParams.surfColor = parseColorValue(commandArgs.at(6), alphaValue);
+            colorParams.edgeColor = parseColorValue(commandArgs.at(8), alphaValue);
+            if (colorId < NB_COLOR_CODES)
+                table->colors[colorId] = colorParams;
+            else
+                table->otherColors.insert(colorId, colorParams);
 
 #if DEBUGP
-            qDebug() << colorId << currColorParams.colorName << currColorParams.surfValue << currColorParams.edgeValue;
+            qDebug() << colorId << commandArgs.at(2) << commandArgs.at(6) << commandArgs.at(8);
 #endif
 
         }
     }
     // Close file
     file.close();
+
+    return table;
 }
 
-QString LDrawParser::getSurfQString(int colorId) {
-    return _colorsArray.value(colorId).surfValue;
+int LDrawParser::parseColorCode(const QString& code) {
+    bool ok;
+    int colorId;
+
+    // Direct colors are written in hexadecimal
+    if (code.startsWith("0x", Qt::CaseInsensitive))
+        colorId = code.mid(2).toInt(&ok, 16);
+    else
+        colorId = code.toInt(&ok);
+
+    return ok ? colorId : -1;
 }
 
-QString LDrawParser::getEdgeQString(int colorId) {
-    return _colorsArray.value(colorId).edgeValue;
+osg::Vec4 LDrawParser::parseColorValue(const QString& value, double alpha) {
+    // Values are #RRGGBB, sometimes 0xRRGGBB
+    QString hexValue = value;
+    if (hexValue.startsWith('#'))
+        hexValue.remove(0, 1);
+    else if (hexValue.startsWith("0x", Qt::CaseInsensitive))
+        hexValue.remove(0, 2);
+
+    uint rgb = hexValue.toUInt(0, 16);
+    return osg::Vec4(static_cast<double>((rgb >> 16) & 0xFF) / 255.0,
+                     static_cast<double>((rgb >> 8)  & 0xFF) / 255.0,
+                     static_cast<double>( rgb        & 0xFF) / 255.0,
+                     alpha / 255.0);
 }
 
-double LDrawParser::getAlphaValue(int colorId) {
-    return _colorsArray.value(colorId).alphaValue;
+osg::Vec4 LDrawParser::getDirectColor(int colorId, bool isSurf) {
+    // Direct colors 0x2RRGGBB are opaque, with black edges
+    if ((colorId >> 24) != 2 || !isSurf)
+        return osg::Vec4(0.0, 0.0, 0.0, 1.0);
+
+    return osg::Vec4(static_cast<double>((colorId >> 16) & 0xFF) / 255.0,
+                     static_cast<double>((colorId >> 8)  & 0xFF) / 255.0,
+                     static_cast<double>( colorId        & 0xFF) / 255.0,
+                     1.0);
 }
 
-osg::Vec4 LDrawParser::getSurfOrEdgeColor(int colorId, bool isSurf) {
-    QString colorName;
-    if (isSurf)
-        colorName = getSurfQString(colorId);
-    else
-        colorName = getEdgeQString(colorId);
+QSharedPointer<const LDrawParser::Primitive> LDrawParser::nativePrimitive(const QString& fileName) {
+    int segments = _primitiveSegments;
+    QString key = fileName + '/' + QString::number(segments);
 
-    QColor color(colorName);
+    QMutexLocker locker(&_primitivesMutex);
+    QHash<QString, QSharedPointer<const Primitive> >::const_iterator it = _primitives.find(key);
+    if (it != _primitives.end())
+        return it.value();
 
-#if DEBUGP
-    qDebug() << colorName << color;
-#endif
+    // Files which aren't well-known primitives are remembered too, so that each include costs a single lookup
+    QSharedPointer<const Primitive> primitive = createPrimitive(fileName, segments);
+    _primitives.insert(key, primitive);
+    return primitive;
+}
+
+QSharedPointer<const LDrawParser::Primitive> LDrawParser::createPrimitive(const QString& fileName, int segments) {
+    // Low and high resolution primitives are generated at the same quality
+    QString name = fileName;
+    if (name.startsWith("48/"))
+        name.remove(0, 3);
+
+    QSharedPointer<Primitive> primitive(new Primitive);
+
+    // A stud: 6 LDU radius, 4 LDU high above y = 0. Its fast-draw version stu2.dat is generated at the same quality
+    if (name == "stud.dat" || name == "stu2.dat") {
+        addCircle(*primitive, "edge", 1.0, 6.0, 0.0, 0.0, segments);
+        addCircle(*primitive, "edge", 1.0, 6.0, -4.0, 0.0, segments);
+        addCircle(*primitive, "cyli", 1.0, 6.0, -4.0, 4.0, segments);
+        addCircle(*primitive, "disc", 1.0, 6.0, -4.0, 0.0, segments);
+        return primitive;
+    }
+
+    // Circles: n-4cyli.dat, n-4disc.dat, n-4edge.dat and n-4ringk.dat, n quarters of a unit circle
+    QRegExp circle("([1-4])-4(cyli|disc|edge|ring(\\d+))\\.dat");
+    if (!circle.exactMatch(name))
+        return QSharedPointer<const Primitive>();
+
+    double fraction = circle.cap(1).toInt() / 4.0;
+    if (circle.cap(3).isEmpty()) {
+        addCircle(*primitive, circle.cap(2), fraction, 1.0, 0.0, 1.0, segments);
+    } else {
+        // Ring k lies between radius k and k+1
+        addCircle(*primitive, "ring", fraction, circle.cap(3).toInt(), 0.0, 0.0, segments);
+    }
+
+    return primitive;
+}
 
-    return osg::Vec4(static_cast<double>(color.red())   / 255.0,
-                     static_cast<double>(color.green()) / 255.0,
-                     static_cast<double>(color.blue())  / 255.0,
-                     getAlphaValue(colorId) / 255.0);
+void LDrawParser::addCircle(Primitive& primitive, const QString& shape, double fraction, double radius, double y, double height, int segments) {
+    // Points turn from +x to +z, as in LDraw primitives
+    int nbSegments = qRound(segments * fraction);
+    QVector<osg::Vec3> points;
+    for (int k = 0; k <= nbSegments; k++) {
+        double angle = 2.0 * osg::PI * k / segments;
+        points << osg::Vec3(cos(angle), 0.0, sin(angle));
+    }
+
+    osg::Vec3 center(0.0, y, 0.0);
+    for (int k = 0; k < nbSegments; k++) {
+        const osg::Vec3& p0 = points.at(k);
+        const osg::Vec3& p1 = points.at(k+1);
+
+        if (shape == "edge") {
+            primitive.lineVertices << center + p0*radius << center + p1*radius;
+        } else if (shape == "disc") {
+            // Facing -y, up in LDraw
+            primitive.triangleVertices << center << center + p0*radius << center + p1*radius;
+        } else if (shape == "ring") {
+            primitive.quadVertices << center + p0*radius << center + p0*(radius+1.0)
+                                   << center + p1*(radius+1.0) << center + p1*radius;
+        } else if (shape == "cyli") {
+            // From y down to y+height, facing outwards
+            osg::Vec3 bottom = center + osg::Vec3(0.0, height, 0.0);
+            primitive.quadVertices << bottom + p0*radius << bottom + p1*radius
+                                   << center + p1*radius << center + p0*radius;
+        }
+    }
+}
+
+void LDrawParser::appendPrimitive(const Primitive& primitive, bool cull, bool invert, const osg::Matrix& matrix, int color,
+                                  Arrays& cullArrays, Arrays& twoSidedArrays) const {
+    double detMatrix = (matrix(0, 0)*matrix(1, 1)*matrix(2, 2)
+                     +  matrix(1, 0)*matrix(2, 1)*matrix(0, 2)
+                     +  matrix(2, 0)*matrix(0, 1)*matrix(1, 2)
+                     -  matrix(2, 0)*matrix(1, 1)*matrix(0, 2)
+                     -  matrix(0, 0)*matrix(2, 1)*matrix(1, 2)
+                     -  matrix(1, 0)*matrix(0, 1)*matrix(2, 2));
+
+    // Mirroring matrices and inverted includes turn faces inside out
+    bool reverse = (detMatrix < 0) != invert;
+
+    // Native primitives are certified: they are culled as soon as including files are
+    Arrays& arrays = cull ? cullArrays : twoSidedArrays;
+    osg::Vec4 surfColor = getSurfOrEdgeColor(color);
+    osg::Vec4 edgeColor = getSurfOrEdgeColor(color, false);
+
+    for (int k = 0; k < primitive.lineVertices.size(); k+=2) {
+        twoSidedArrays.lineVerticesArray->push_back(multMatVec(primitive.lineVertices.at(k), matrix));
+        twoSidedArrays.lineVerticesArray->push_back(multMatVec(primitive.lineVertices.at(k+1), matrix));
+        twoSidedArrays.lineColorsArray->push_back(edgeColor);
+    }
+    for (int k = 0; k < primitive.triangleVertices.size(); k+=3) {
+        for (int i = 0; i < 3; i++)
+            arrays.triangleVerticesArray->push_back(multMatVec(primitive.triangleVertices.at(reverse ? k+2-i : k+i), matrix));
+        arrays.triangleColorsArray->push_back(surfColor);
+    }
+    for (int k = 0; k < primitive.quadVertices.size(); k+=4) {
+        for (int i = 0; i < 4; i++)
+            arrays.quadVerticesArray->push_back(multMatVec(primitive.quadVertices.at(reverse ? k+3-i : k+i), matrix));
+        arrays.quadColorsArray->push_back(surfColor);
+    }
 }
 
 osg::Vec3 LDrawParser::calculateNormal(const osg::Vec3& a, const osg::Vec3& b, const osg::Vec3& c) {
@@ -132,69 +307,117 @@ osg::Vec3 LDrawParser::multMatVec(const osg::Vec3& vec, const osg::Matrix& mat)
                      mat(0, 2)*vec[0] + mat(1, 2)*vec[1] + mat(2, 2)*vec[2] + mat(3, 2));
 }
 
-osg::Group* LDrawParser::createNode(void) {
-    osg::ref_ptr<osg::Vec3Array> lineVerticesArray = new osg::Vec3Array;
-    osg::ref_ptr<osg::Vec3Array> triangleVerticesArray = new osg::Vec3Array;
-    osg::ref_ptr<osg::Vec3Array> quadVerticesArray = new osg::Vec3Array;
-    osg::ref_ptr<osg::Vec4Array> lineColorsArray = new osg::Vec4Array;
-    osg::ref_ptr<osg::Vec4Array> triangleColorsArray = new osg::Vec4Array;
-    osg::ref_ptr<osg::Vec4Array> quadColorsArray = new osg::Vec4Array;
+LDrawParser::Arrays::Arrays(void) :
+    lineVerticesArray(new osg::Vec3Array),
+    triangleVerticesArray(new osg::Vec3Array),
+    quadVerticesArray(new osg::Vec3Array),
+    lineColorsArray(new osg::Vec4Array),
+    triangleColorsArray(new osg::Vec4Array),
+    quadColorsArray(new osg::Vec4Array) {
+}
 
-    osg::Matrix ident(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1);
+osg::StateSet* LDrawParser::getCullStateSet(bool cull) {
+    // Shared by every imported part, so that they are sorted together
+    static QMutex mutex;
+    static osg::ref_ptr<osg::StateSet> cullStateSet;
+    static osg::ref_ptr<osg::StateSet> twoSidedStateSet;
+
+    QMutexLocker locker(&mutex);
+    if (!cullStateSet) {
+        // BFC certified faces all face outwards: back faces are never seen
+        cullStateSet = new osg::StateSet;
+        cullStateSet->setAttributeAndModes(new osg::CullFace(osg::CullFace::BACK), osg::StateAttribute::ON);
+
+        // Other faces can be seen from both sides, and lit from both sides
+        twoSidedStateSet = new osg::StateSet;
+        twoSidedStateSet->setMode(GL_CULL_FACE, osg::StateAttribute::OFF);
+        osg::ref_ptr<osg::LightModel> lightModel = new osg::LightModel;
+        lightModel->setTwoSided(true);
+        twoSidedStateSet->setAttributeAndModes(lightModel.get(), osg::StateAttribute::ON);
+    }
+
+    return cull ? cullStateSet.get() : twoSidedStateSet.get();
+}
+
+osg::Geometry* LDrawParser::createGeometry(const Arrays& arrays) {
+    const osg::Vec3Array* triangleVerticesArray = arrays.triangleVerticesArray.get();
+    const osg::Vec3Array* quadVerticesArray = arrays.quadVerticesArray.get();
+    const osg::Vec3Array* lineVerticesArray = arrays.lineVerticesArray.get();
 
-    fillArrays(_fileName, true, false, ident,
-               lineVerticesArray.get(), triangleVerticesArray.get(), quadVerticesArray.get(),
-               lineColorsArray.get(), triangleColorsArray.get(), quadColorsArray.get());
+    if (triangleVerticesArray->empty() && quadVerticesArray->empty() && lineVerticesArray->empty())
+        return NULL;
 
     osg::ref_ptr<osg::Vec3Array> verticesArray = new osg::Vec3Array;
     osg::ref_ptr<osg::Vec4Array> colorsArray = new osg::Vec4Array;
     osg::ref_ptr<osg::Vec3Array> normalsArray = new osg::Vec3Array;
 
-    // Add every vertices to global vertices array and create normals
+    // Add every vertices to global vertices array, with the normal and color of their primitive
     for (unsigned int k = 0; k < triangleVerticesArray->getNumElements(); k+=3) {
-        normalsArray->push_back(calculateNormal(triangleVerticesArray->at(k), triangleVerticesArray->at(k+1), triangleVerticesArray->at(k+2)));
-        for (int i = 0; i < 3; i++)
+        osg::Vec3 normal = calculateNormal(triangleVerticesArray->at(k), triangleVerticesArray->at(k+1), triangleVerticesArray->at(k+2));
+        for (int i = 0; i < 3; i++) {
             verticesArray->push_back(triangleVerticesArray->at(k + i));
+            normalsArray->push_back(normal);
+            colorsArray->push_back(arrays.triangleColorsArray->at(k/3));
+        }
     }
     for (unsigned int k = 0; k < quadVerticesArray->getNumElements(); k+=4) {
-        normalsArray->push_back(calculateNormal(quadVerticesArray->at(k), quadVerticesArray->at(k+1), quadVerticesArray->at(k+2)));
-        for (int i = 0; i < 4; i++)
+        osg::Vec3 normal = calculateNormal(quadVerticesArray->at(k), quadVerticesArray->at(k+1), quadVerticesArray->at(k+2));
+        for (int i = 0; i < 4; i++) {
             verticesArray->push_back(quadVerticesArray->at(k + i));
+            normalsArray->push_back(normal);
+            colorsArray->push_back(arrays.quadColorsArray->at(k/4));
+        }
     }
     for (unsigned int k = 0; k < lineVerticesArray->getNumElements(); k++) {
         verticesArray->push_back(lineVerticesArray->at(k));
+        normalsArray->push_back(osg::Vec3(0.0, 0.0, 1.0));
+        colorsArray->push_back(arrays.lineColorsArray->at(k/2));
     }
 
-    // Add every colors to global colors array
-    for (unsigned int k = 0; k < triangleColorsArray->getNumElements(); k++)
-        colorsArray->push_back(triangleColorsArray->at(k));
-    for (unsigned int k = 0; k < quadColorsArray->getNumElements(); k++)
-        colorsArray->push_back(quadColorsArray->at(k));
-    for (unsigned int k = 0; k < lineColorsArray->getNumElements(); k++)
-        colorsArray->push_back(lineColorsArray->at(k));
-
     // Create geometry
     osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
 
     // Match vertices
     geometry->setVertexArray(verticesArray);
 
-    // Match colors
+    // Match colors, per vertex so that the geometry can be indexed and simplified
     geometry->setColorArray(colorsArray);
-    geometry->setColorBinding(osg::Geometry::BIND_PER_PRIMITIVE);
+    geometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
 
     // Match normals
     geometry->setNormalArray(normalsArray);
-    geometry->setNormalBinding(osg::Geometry::BIND_PER_PRIMITIVE);
+    geometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
 
     // Add primitives
     geometry->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::TRIANGLES, 0, triangleVerticesArray->getNumElements()));
     geometry->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::QUADS, triangleVerticesArray->getNumElements(), quadVerticesArray->getNumElements()));
     geometry->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::LINES, triangleVerticesArray->getNumElements()+quadVerticesArray->getNumElements(), lineVerticesArray->getNumElements()));
 
+    return geometry.release();
+}
+
+osg::Group* LDrawParser::createNode(void) {
+    Arrays cullArrays;
+    Arrays twoSidedArrays;
+
+    osg::Matrix ident(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1);
+
+    fillArrays(_fileName, true, false, ident, cullArrays, twoSidedArrays);
+
     // Create geode
     osg::ref_ptr<osg::Geode> geode = new osg::Geode;
-    geode->addDrawable(geometry);
+
+    // Certified faces are drawn culled, the others two-sided
+    osg::ref_ptr<osg::Geometry> cullGeometry = createGeometry(cullArrays);
+    if (cullGeometry.valid()) {
+        cullGeometry->setStateSet(getCullStateSet(true));
+        geode->addDrawable(cullGeometry.get());
+    }
+    osg::ref_ptr<osg::Geometry> twoSidedGeometry = createGeometry(twoSidedArrays);
+    if (twoSidedGeometry.valid()) {
+        twoSidedGeometry->setStateSet(getCullStateSet(false));
+        geode->addDrawable(twoSidedGeometry.get());
+    }
 
 //    // Smooth visitor to create normals automagically
 //    osgUtil::SmoothingVisitor::smooth(*geometry);
@@ -210,11 +433,14 @@ osg::Group* LDrawParser::createNode(void) {
 }
 
 void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert, osg::Matrix accumTransformMatrix,
-                             osg::Vec3Array* lineVerticesArray, osg::Vec3Array* triangleVerticesArray, osg::Vec3Array* quadVerticesArray,
-                             osg::Vec4Array* lineColorsArray, osg::Vec4Array* triangleColorsArray, osg::Vec4Array* quadColorsArray, int currColor) {
-    bool localCull = true;
-    Winding winding = ccw;
-    ///Certified certified = unknown;
+                             Arrays& cullArrays, Arrays& twoSidedArrays, int currColor) {
+    PROFILE_SCOPE("LDrawParser::fillArrays");
+
+    // Faces are culled only within certified files, whose including files are certified too
+    bool localCull = false;
+    // Counter clockwise by default, clockwise within an inverted include
+    Winding winding = accumInvert ? cw : ccw;
+    Certified certified = unknown;
     bool invertNext = false;
     QStringList commandArgs;
 
@@ -264,8 +490,14 @@ void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert,
                 // It's a command or a comment
                 if (n == 0) {
                     if (commandArgs.contains("BFC")) {
-                        if (commandArgs.contains("CLIP")) {
+                        if (commandArgs.contains("CERTIFY")) {
+                            certified = yes;
                             localCull = true;
+                        } if (commandArgs.contains("NOCERTIFY")) {
+                            certified = no;
+                            localCull = false;
+                        } if (commandArgs.contains("CLIP")) {
+                            localCull = (certified == yes);
                         } if (commandArgs.contains("NOCLIP")) {
                             localCull = false;
                         } if (commandArgs.contains("CCW")) {
@@ -287,6 +519,7 @@ void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert,
                 } if (n == 1) {
                     // The last parameter is the file's name to include
                     QString fileName = commandArgs.at(14);
+                    QSharedPointer<const Primitive> primitive;
 #if TESTP
                     QString pathName = fileName;
 #else
@@ -299,26 +532,32 @@ void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert,
                         fileName.replace('\\', '/');
                     }
 
-                    // Files included can be located under p/ or parts/ directory...
-                    QString path = "";
-                    QDir dir1 = QDir("/home/shaolan/Documents/ldraw/p/");
-                    QDir dir2 = QDir("/home/shaolan/Documents/ldraw/parts/");
-
-                    // ...so we check where the file is, and create the path string accordingly
-                    if (dir1.exists(fileName))
-                        path = "/home/shaolan/Documents/ldraw/p/";
-                    else if (dir2.exists(fileName))
-                        path = "/home/shaolan/Documents/ldraw/parts/";
-                    else {
-                        qDebug() << "Cannot find" << fileName << "under p/ nor parts/ directory within LDrawParser::createNode.";
-                        throw OpenFailed();
-                    }
+                    // Well-known primitives are generated once instead of being parsed
+                    primitive = nativePrimitive(fileName);
+
+                    QString pathName;
+                    if (!primitive) {
+                        // Files included can be located under p/ or parts/ directory...
+                        QString path = "";
+                        QDir dir1 = QDir(_ldrawPath + "p/");
+                        QDir dir2 = QDir(_ldrawPath + "parts/");
+
+                        // ...so we check where the file is, and create the path string accordingly
+                        if (dir1.exists(fileName))
+                            path = _ldrawPath + "p/";
+                        else if (dir2.exists(fileName))
+                            path = _ldrawPath + "parts/";
+                        else {
+                            qDebug() << "Cannot find" << fileName << "under p/ nor parts/ directory within LDrawParser::createNode.";
+                            throw OpenFailed();
+                        }
 
-                    // Create complete path name, according to directory and file's name
-                    QString pathName = path + fileName;
+                        // Create complete path name, according to directory and file's name
+                        pathName = path + fileName;
+                    }
 #endif
                     // Get color code
-                    int nextColor = commandArgs.at(1).toInt();
+                    int nextColor = parseColorCode(commandArgs.at(1));
                     if (nextColor == 16)
                         nextColor = currColor;
 #if DEBUGP
@@ -341,16 +580,20 @@ void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert,
 
                     osg::Matrix transformMatrix(a, d, g, 0.0, b, e, h, 0.0, c, f, i, 0.0, x, y, z, 1.0);
 
-                    fillArrays(pathName, accumCull && localCull, ((accumInvert && !invertNext) || (!accumInvert && invertNext)), transformMatrix*accumTransformMatrix,
-                               lineVerticesArray, triangleVerticesArray, quadVerticesArray, lineColorsArray, triangleColorsArray, quadColorsArray, nextColor);
+                    if (primitive)
+                        appendPrimitive(*primitive, accumCull && localCull, ((accumInvert && !invertNext) || (!accumInvert && invertNext)), transformMatrix*accumTransformMatrix,
+                                        nextColor, cullArrays, twoSidedArrays);
+                    else
+                        fillArrays(pathName, accumCull && localCull, ((accumInvert && !invertNext) || (!accumInvert && invertNext)), transformMatrix*accumTransformMatrix,
+                                   cullArrays, twoSidedArrays, nextColor);
                 // If it's a line
                 } else if (n == 2) {
                     // Fill colors array
-                    int colorCode = commandArgs.at(1).toInt();
+                    int colorCode = parseColorCode(commandArgs.at(1));
                     if (colorCode == 24)
-                        lineColorsArray->push_back(getSurfOrEdgeColor(currColor, false));
+                        twoSidedArrays.lineColorsArray->push_back(getSurfOrEdgeColor(currColor, false));
                     else
-                        lineColorsArray->push_back(getSurfOrEdgeColor(colorCode, false));
+                        twoSidedArrays.lineColorsArray->push_back(getSurfOrEdgeColor(colorCode, false));
 
                     // Create vertices
                     osg::Vec3 v0(commandArgs.at(2).toDouble(), commandArgs.at(3).toDouble(), commandArgs.at(4).toDouble());
@@ -360,12 +603,11 @@ void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert,
                     v1 = multMatVec(v1, accumTransformMatrix);
 
                     // Fill vertices array
-                    lineVerticesArray->push_back(v0);
-                    lineVerticesArray->push_back(v1);
+                    twoSidedArrays.lineVerticesArray->push_back(v0);
+                    twoSidedArrays.lineVerticesArray->push_back(v1);
 
                 // If it's a triangle
                 } else if (n == 3) {
-                    //if (accumCull) {
                         double detMatrix = (accumTransformMatrix(0, 0)*accumTransformMatrix(1, 1)*accumTransformMatrix(2, 2)
                                          +  accumTransformMatrix(1, 0)*accumTransformMatrix(2, 1)*accumTransformMatrix(0, 2)
                                          +  accumTransformMatrix(2, 0)*accumTransformMatrix(0, 1)*accumTransformMatrix(1, 2)
@@ -386,12 +628,15 @@ void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert,
                                  << "Has to be inverted:" << !rotation;
 #endif
 
+                        // Certified faces are culled, the others drawn two-sided
+                        Arrays& arrays = (accumCull && localCull) ? cullArrays : twoSidedArrays;
+
                         // Fill colors array
-                        int colorCode = commandArgs.at(1).toInt();
+                        int colorCode = parseColorCode(commandArgs.at(1));
                         if (colorCode == 16)
-                            triangleColorsArray->push_back(getSurfOrEdgeColor(currColor));
+                            arrays.triangleColorsArray->push_back(getSurfOrEdgeColor(currColor));
                         else
-                            triangleColorsArray->push_back(getSurfOrEdgeColor(colorCode));
+                            arrays.triangleColorsArray->push_back(getSurfOrEdgeColor(colorCode));
 
                         // Create vertices
                         osg::Vec3 v0(commandArgs.at(2).toDouble(), commandArgs.at(3).toDouble(), commandArgs.at(4).toDouble());
@@ -404,19 +649,17 @@ void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert,
 
                         // Fill vertices array
                         if (rotation) {
-                            triangleVerticesArray->push_back(v0);
-                            triangleVerticesArray->push_back(v1);
-                            triangleVerticesArray->push_back(v2);
+                            arrays.triangleVerticesArray->push_back(v0);
+                            arrays.triangleVerticesArray->push_back(v1);
+                            arrays.triangleVerticesArray->push_back(v2);
                         } else {
                             //qDebug() << "!CCW";
-                            triangleVerticesArray->push_back(v2);
-                            triangleVerticesArray->push_back(v1);
-                            triangleVerticesArray->push_back(v0);
+                            arrays.triangleVerticesArray->push_back(v2);
+                            arrays.triangleVerticesArray->push_back(v1);
+                            arrays.triangleVerticesArray->push_back(v0);
                         }
-                    //}
                 // If it's a quad
                 } else if (n == 4) {
-                    //if (accumCull) {
 
                         double detMatrix = (accumTransformMatrix(0, 0)*accumTransformMatrix(1, 1)*accumTransformMatrix(2, 2)
                                          +  accumTransformMatrix(1, 0)*accumTransformMatrix(2, 1)*accumTransformMatrix(0, 2)
@@ -437,12 +680,15 @@ void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert,
                                  << "Has to be inverted:" << !rotation;
 #endif
 
+                        // Certified faces are culled, the others drawn two-sided
+                        Arrays& arrays = (accumCull && localCull) ? cullArrays : twoSidedArrays;
+
                         // Fill colors array
-                        int colorCode = commandArgs.at(1).toInt();
+                        int colorCode = parseColorCode(commandArgs.at(1));
                         if (colorCode == 16)
-                            quadColorsArray->push_back(getSurfOrEdgeColor(currColor));
+                            arrays.quadColorsArray->push_back(getSurfOrEdgeColor(currColor));
                         else
-                            quadColorsArray->push_back(getSurfOrEdgeColor(colorCode));
+                            arrays.quadColorsArray->push_back(getSurfOrEdgeColor(colorCode));
 
                         // Create vertices
                         osg::Vec3 v0(commandArgs.at(2).toDouble(), commandArgs.at(3).toDouble(), commandArgs.at(4).toDouble());
@@ -457,18 +703,17 @@ void LDrawParser::fillArrays(QString fileName, bool accumCull, bool accumInvert,
 
                         // Fill vertices array
                         if (rotation) {
-                            quadVerticesArray->push_back(v0);
-                            quadVerticesArray->push_back(v1);
-                            quadVerticesArray->push_back(v2);
-                            quadVerticesArray->push_back(v3);
+                            arrays.quadVerticesArray->push_back(v0);
+                            arrays.quadVerticesArray->push_back(v1);
+                            arrays.quadVerticesArray->push_back(v2);
+                            arrays.quadVerticesArray->push_back(v3);
                         } else {
                             //qDebug() << "!CCW";
-                            quadVerticesArray->push_back(v3);
-                            quadVerticesArray->push_back(v2);
-                            quadVerticesArray->push_back(v1);
-                            quadVerticesArray->push_back(v0);
+                            arrays.quadVerticesArray->push_back(v3);
+                            arrays.quadVerticesArray->push_back(v2);
+                            arrays.quadVerticesArray->push_back(v1);
+                            arrays.quadVerticesArray->push_back(v0);
                         }
-                    //}
                 }
                 if (n != 0 || (n == 0 && !containsInvertNext))
                     invertNext = false;
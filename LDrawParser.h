@@ -2,10 +2,14 @@
 #define LDRAWPARSER_H
 
 #include <QString>
-#include <QColor>
-#include <QMap>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QHash>
+#include <QVector>
 
 #include <osg/Node>
+#include <osg/Geometry>
+#include <osg/Vec4>
 
 class LDrawParser {
 
@@ -16,6 +20,13 @@ public:
 public:
     static int tab;
 
+    static void setLDrawPath(const QString& ldrawPath);
+    static QString getLDrawPath(void) { return _ldrawPath; }
+
+    // Segments of the circles of native primitives, fewer than the 16 of LDraw files by default so that parts get lighter
+    static void setPrimitiveSegments(int primitiveSegments);
+    static int getPrimitiveSegments(void) { return _primitiveSegments; }
+
 public:
     class OpenFailed : std::exception {
     public:
@@ -25,11 +36,18 @@ public:
     };
 
 public:
+    // Colors of a LDraw color code, resolved once from LDConfig.ldr
     struct ColorParams {
-        QString colorName;
-        QString surfValue;
-        QString edgeValue;
-        double alphaValue;
+        osg::Vec4 surfColor;
+        osg::Vec4 edgeColor;
+    };
+
+    // Codes from LDConfig.ldr, direct colors (0x2RRGGBB) are resolved apart
+    static const int NB_COLOR_CODES = 512;
+    struct ColorTable {
+        ColorParams colors[NB_COLOR_CODES];
+        // Rare codes beyond the table
+        QHash<int, ColorParams> otherColors;
     };
 
 public:
@@ -40,21 +58,69 @@ public:
     static osg::Vec3 calculateNormal(const osg::Vec3& a, const osg::Vec3& b, const osg::Vec3& c);
     static osg::Vec3 multMatVec(const osg::Vec3& vec, const osg::Matrix& mat);
 
+    // Primitives drawn with the same face culling
+    struct Arrays {
+        Arrays(void);
+
+        osg::ref_ptr<osg::Vec3Array> lineVerticesArray;
+        osg::ref_ptr<osg::Vec3Array> triangleVerticesArray;
+        osg::ref_ptr<osg::Vec3Array> quadVerticesArray;
+        osg::ref_ptr<osg::Vec4Array> lineColorsArray;
+        osg::ref_ptr<osg::Vec4Array> triangleColorsArray;
+        osg::ref_ptr<osg::Vec4Array> quadColorsArray;
+    };
+
     osg::Group* createNode(void);
     void fillArrays(QString fileName, bool accumCull, bool accumInvert, osg::Matrix accumTransformMatrix,
-                    osg::Vec3Array* lineVerticesArray, osg::Vec3Array* triangleVerticesArray, osg::Vec3Array* quadVerticesArray,
-                    osg::Vec4Array* lineColorsArray, osg::Vec4Array* triangleColorsArray, osg::Vec4Array* quadColorsArray, int currColor = 16);
+                    Arrays& cullArrays, Arrays& twoSidedArrays, int currColor = 16);
 
 private:
-    void fillColorsArray(void);
-    QString getSurfQString(int colorId);
-    QString getEdgeQString(int colorId);
-    osg::Vec4 getSurfOrEdgeColor(int colorId, bool isSurf = true);
-    double getAlphaValue(int colorId);
+    // Well-known primitive generated instead of being parsed, in its own LDraw coordinates,
+    // faces being counter clockwise seen from outside
+    struct Primitive {
+        QVector<osg::Vec3> lineVertices;
+        QVector<osg::Vec3> triangleVertices;
+        QVector<osg::Vec3> quadVertices;
+    };
+
+    static QSharedPointer<const Primitive> nativePrimitive(const QString& fileName);
+    static QSharedPointer<const Primitive> createPrimitive(const QString& fileName, int segments);
+    static void addCircle(Primitive& primitive, const QString& shape, double fraction, double radius, double y, double height, int segments);
+    void appendPrimitive(const Primitive& primitive, bool cull, bool invert, const osg::Matrix& matrix, int color,
+                         Arrays& cullArrays, Arrays& twoSidedArrays) const;
+
+    static QSharedPointer<const ColorTable> colorTable(void);
+    static QSharedPointer<const ColorTable> readColorTable(void);
+    static int parseColorCode(const QString& code);
+    static osg::Vec4 parseColorValue(const QString& value, double alpha);
+    static osg::Vec4 getDirectColor(int colorId, bool isSurf);
+    static osg::Geometry* createGeometry(const Arrays& arrays);
+    static osg::StateSet* getCullStateSet(bool cull);
+
+    osg::Vec4 getSurfOrEdgeColor(int colorId, bool isSurf = true) const {
+        if (colorId >= 0 && colorId < NB_COLOR_CODES)
+            return isSurf ? _colorTable->colors[colorId].surfColor : _colorTable->colors[colorId].edgeColor;
+
+        QHash<int, ColorParams>::const_iterator it = _colorTable->otherColors.find(colorId);
+        if (it != _colorTable->otherColors.end())
+            return isSurf ? it.value().surfColor : it.value().edgeColor;
+        return getDirectColor(colorId, isSurf);
+    }
 
 private:
+    static QString _ldrawPath;
+
+    // Shared by every parser, read again when the LDraw path changes
+    static QSharedPointer<const ColorTable> _sharedColorTable;
+    static QMutex _colorTableMutex;
+
+    // Native primitives by file name, null for files to parse
+    static QHash<QString, QSharedPointer<const Primitive> > _primitives;
+    static QMutex _primitivesMutex;
+    static int _primitiveSegments;
+
     QString _fileName;
-    QMap<int, ColorParams> _colorsArray;
+    QSharedPointer<const ColorTable> _colorTable;
 };
 
 #endif // LDRAWPARSER_H
@@ -8,7 +8,7 @@ SOURCES += \
     Brick.cpp \
     BrickNode.cpp \
     BrickDialog.cpp \
-    LegoFactory.cpp \
+    LegoRegistry.cpp \
     Corner.cpp \
     CornerNode.cpp \
     CornerDialog.cpp \
@@ -64,7 +64,20 @@ SOURCES += \
     SkyBox.cpp \
     PickHandler.cpp \
     LDrawParser.cpp \
-    PhotoCallback.cpp
+    PhotoCallback.cpp \
+    ImageWriter.cpp \
+    SpatialIndex.cpp \
+    Profiler.cpp \
+    ProfilerWidget.cpp \
+    PartCatalog.cpp \
+    PartSearch.cpp \
+    PartBrowser.cpp \
+    RoadGenerator.cpp \
+    CityGenerator.cpp \
+    ModelCache.cpp \
+    PlotCulling.cpp \
+    WallCompiler.cpp \
+    RegionCompiler.cpp
 
 HEADERS += \
     MainWindow.h \
@@ -75,7 +88,7 @@ HEADERS += \
     Brick.h \
     BrickNode.h \
     BrickDialog.h \
-    LegoFactory.h \
+    LegoRegistry.h \
     Corner.h \
     CornerNode.h \
     CornerDialog.h \
@@ -131,7 +144,20 @@ HEADERS += \
     SkyBox.h \
     PickHandler.h \
     LDrawParser.h \
-    PhotoCallback.h
+    PhotoCallback.h \
+    ImageWriter.h \
+    SpatialIndex.h \
+    Profiler.h \
+    ProfilerWidget.h \
+    PartCatalog.h \
+    PartSearch.h \
+    PartBrowser.h \
+    RoadGenerator.h \
+    CityGenerator.h \
+    ModelCache.h \
+    PlotCulling.h \
+    WallCompiler.h \
+    RegionCompiler.h
 
 LIBS += \
     -losgQt \
@@ -146,4 +172,9 @@ LIBS += \
 
 QT += opengl
 
+# Startup benchmark: make benchmark fails when the first scene frame takes longer than STARTUP_BUDGET ms
+STARTUP_BUDGET = 3000
+benchmark.commands = ./$$TARGET --startup-benchmark $$STARTUP_BUDGET
+QMAKE_EXTRA_TARGETS += benchmark
+
 CONFIG += thread
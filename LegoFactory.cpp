@@ -1 +0,0 @@
-#include "LegoFactory.h"
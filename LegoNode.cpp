@@ -1,6 +1,5 @@
 #include "LegoNode.h"
 
-#include <osg/ShapeDrawable>
 #include <osg/MatrixTransform>
 #include <osg/Geometry>
 #include <osg/Material>
@@ -8,6 +7,70 @@
 #include <osgUtil/Tessellator>
 
 #include <QDebug>
+#include <QMutex>
+#include <QHash>
+#include <QByteArray>
+
+const char* LegoNode::bodyName = "Body";
+const char* LegoNode::plotName = "Plot";
+const char* LegoNode::bottomCylinderName = "Bottom cylinder";
+
+namespace {
+    // Arrays of generated shapes, shared by every shape of the same kind and size
+    struct SharedArrays {
+        osg::ref_ptr<osg::Vec3Array> vertices;
+        osg::ref_ptr<osg::Vec3Array> normals;
+        osg::ref_ptr<osg::DrawElementsUShort> triangles;
+    };
+
+    // Shapes are created within generator threads too
+    QMutex sharedArraysMutex;
+    QHash<QByteArray, SharedArrays> sharedArrays;
+
+    enum SharedShape { solidCylinder, sphere };
+
+    QByteArray sharedArraysKey(SharedShape shape, const float* parameters, int nbParameters) {
+        QByteArray key(reinterpret_cast<const char*>(&shape), sizeof(shape));
+        key.append(reinterpret_cast<const char*>(parameters), nbParameters*sizeof(float));
+        return key;
+    }
+
+    // Arrays of the given key, to be filled when new: arrays no geometry uses any more are forgotten then
+    SharedArrays& findSharedArrays(const QByteArray& key) {
+        if (!sharedArrays.contains(key)) {
+            QHash<QByteArray, SharedArrays>::iterator it = sharedArrays.begin();
+            while (it != sharedArrays.end()) {
+                if (it.value().vertices->referenceCount() == 1)
+                    it = sharedArrays.erase(it);
+                else
+                    ++it;
+            }
+        }
+        return sharedArrays[key];
+    }
+
+    // Only the color belongs to the geometry, so that shapes of the same size can be drawn with the same buffers
+    osg::Geometry* createSharedGeometry(const SharedArrays& arrays, const osg::Vec4& color) {
+        osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+        geometry->setVertexArray(arrays.vertices.get());
+        geometry->setNormalArray(arrays.normals.get());
+        geometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+        geometry->addPrimitiveSet(arrays.triangles.get());
+
+        osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
+        colors->push_back(color);
+        geometry->setColorArray(colors.get());
+        geometry->setColorBinding(osg::Geometry::BIND_OVERALL);
+
+        geometry->setUseDisplayList(false);
+        geometry->setUseVertexBufferObjects(true);
+
+        // Because LEGO bricks don't move
+        geometry->setDataVariance(osg::Object::STATIC);
+
+        return geometry.release();
+    }
+}
 
 LegoNode::LegoNode(osg::ref_ptr<Lego> lego) :
     osg::Group() {
@@ -260,6 +323,7 @@ osg::Geode* LegoNode::createPlotCylinderAndTop(double radiusX, double radiusY, i
     plotTop->setDataVariance(osg::Object::STATIC);
 
     osg::ref_ptr<osg::Geode> plot = new osg::Geode;
+    plot->setName(plotName);
     plot->addDrawable(plotCylinder);
     plot->addDrawable(plotTop);
 
@@ -304,6 +368,7 @@ osg::Geode* LegoNode::createBottomCylinder(double radiusX, double radiusY, doubl
 
     // Create geode
     osg::ref_ptr<osg::Geode> plot = new osg::Geode;
+    plot->setName(bottomCylinderName);
     plot->addDrawable(cylinderExt);
     plot->addDrawable(cylinderInt);
     plot->addDrawable(disk);
@@ -313,3 +378,105 @@ osg::Geode* LegoNode::createBottomCylinder(double radiusX, double radiusY, doubl
 
     return plot.release();
 }
+
+osg::Geometry* LegoNode::makeSolidCylinder(const osg::Vec3& center, const osg::Vec3& axis, double radius, double height, const osg::Vec4& color, int numberSegments) {
+    float parameters[9] = { center.x(), center.y(), center.z(), axis.x(), axis.y(), axis.z(),
+                            static_cast<float>(radius), static_cast<float>(height), static_cast<float>(numberSegments) };
+    QByteArray key = sharedArraysKey(solidCylinder, parameters, 9);
+
+    QMutexLocker locker(&sharedArraysMutex);
+    SharedArrays& arrays = findSharedArrays(key);
+    if (!arrays.vertices) {
+        arrays.vertices = new osg::Vec3Array;
+        arrays.normals = new osg::Vec3Array;
+        arrays.triangles = new osg::DrawElementsUShort(osg::PrimitiveSet::TRIANGLES);
+
+        osg::Vec3 halfHeight(0, 0, height/2);
+
+        // Side: one bottom and one top vertex per angle, the first angle being repeated to close it
+        for (int k = 0; k <= numberSegments; k++) {
+            float angle = 2.0f * osg::PI * k / numberSegments;
+            osg::Vec3 normal(cosf(angle), sinf(angle), 0);
+            arrays.vertices->push_back(normal*radius - halfHeight);
+            arrays.vertices->push_back(normal*radius + halfHeight);
+            arrays.normals->push_back(normal);
+            arrays.normals->push_back(normal);
+        }
+        for (int k = 0; k < numberSegments; k++) {
+            unsigned short bottom = 2*k;
+            arrays.triangles->push_back(bottom);
+            arrays.triangles->push_back(bottom+2);
+            arrays.triangles->push_back(bottom+3);
+            arrays.triangles->push_back(bottom);
+            arrays.triangles->push_back(bottom+3);
+            arrays.triangles->push_back(bottom+1);
+        }
+
+        // Top and bottom disks, as fans of triangles around their center
+        for (int side = -1; side <= 1; side += 2) {
+            osg::Vec3 normal(0, 0, side);
+            unsigned short first = arrays.vertices->size();
+            arrays.vertices->push_back(halfHeight*side);
+            arrays.normals->push_back(normal);
+            for (int k = 0; k <= numberSegments; k++) {
+                float angle = 2.0f * osg::PI * k / numberSegments;
+                arrays.vertices->push_back(osg::Vec3(cosf(angle)*radius, sinf(angle)*radius, 0) + halfHeight*side);
+                arrays.normals->push_back(normal);
+            }
+            for (int k = 0; k < numberSegments; k++) {
+                arrays.triangles->push_back(first);
+                arrays.triangles->push_back(side > 0 ? first+k+1 : first+k+2);
+                arrays.triangles->push_back(side > 0 ? first+k+2 : first+k+1);
+            }
+        }
+
+        // Cylinder is built along z on the origin, then turned along its axis and moved to its center
+        osg::Quat rotation;
+        rotation.makeRotate(osg::Vec3(0, 0, 1), axis);
+        for (unsigned int k = 0; k < arrays.vertices->size(); k++) {
+            (*arrays.vertices)[k] = rotation * (*arrays.vertices)[k] + center;
+            (*arrays.normals)[k] = rotation * (*arrays.normals)[k];
+        }
+    }
+
+    return createSharedGeometry(arrays, color);
+}
+
+osg::Geometry* LegoNode::makeSphere(double radius, const osg::Vec4& color, int numberSegments) {
+    float parameters[2] = { static_cast<float>(radius), static_cast<float>(numberSegments) };
+    QByteArray key = sharedArraysKey(sphere, parameters, 2);
+
+    QMutexLocker locker(&sharedArraysMutex);
+    SharedArrays& arrays = findSharedArrays(key);
+    if (!arrays.vertices) {
+        arrays.vertices = new osg::Vec3Array;
+        arrays.normals = new osg::Vec3Array;
+        arrays.triangles = new osg::DrawElementsUShort(osg::PrimitiveSet::TRIANGLES);
+
+        // Rings from the top to the bottom, the first angle of each ring being repeated to close it
+        int numberRings = numberSegments/2;
+        for (int i = 0; i <= numberRings; i++) {
+            float theta = osg::PI * i / numberRings;
+            for (int j = 0; j <= numberSegments; j++) {
+                float phi = 2.0f * osg::PI * j / numberSegments;
+                osg::Vec3 normal(sinf(theta)*cosf(phi), sinf(theta)*sinf(phi), cosf(theta));
+                arrays.vertices->push_back(normal*radius);
+                arrays.normals->push_back(normal);
+            }
+        }
+        for (int i = 0; i < numberRings; i++) {
+            for (int j = 0; j < numberSegments; j++) {
+                unsigned short up = i*(numberSegments+1) + j;
+                unsigned short down = up + numberSegments+1;
+                arrays.triangles->push_back(up);
+                arrays.triangles->push_back(down);
+                arrays.triangles->push_back(down+1);
+                arrays.triangles->push_back(up);
+                arrays.triangles->push_back(down+1);
+                arrays.triangles->push_back(up+1);
+            }
+        }
+    }
+
+    return createSharedGeometry(arrays, color);
+}
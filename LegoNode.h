@@ -2,8 +2,9 @@
 #define LegoNode_H
 
 #include <osg/Node>
-#include <osg/ShapeDrawable>
+#include <osg/Geometry>
 #include <osg/Geode>
+#include <osg/MatrixTransform>
 
 #include "Lego.h"
 
@@ -30,6 +31,17 @@ public:
                                              bool isInt = false,
                                              int numberSegments = 20) const;
 
+    // Closed shapes made of indexed triangles, already in place so that they merge with the rest of the piece.
+    // Unlike makeDisk and makeCylinder, their arrays don't depend on the piece: every shape of the same size
+    // and place shares them, i.e. every wheel or cylinder of the same kind
+    static osg::Geometry* makeSolidCylinder(const osg::Vec3& center, const osg::Vec3& axis,
+                                            double radius, double height,
+                                            const osg::Vec4& color,
+                                            int numberSegments = 20);
+    static osg::Geometry* makeSphere(double radius,
+                                     const osg::Vec4& color,
+                                     int numberSegments = 40);
+
     osg::Drawable* createPlotCylinder(double radiusX, double radiusY, int height) const;
     osg::Drawable* createPlotTop(double radiusX, double radiusY, int height) const;
     osg::Geode* createPlotCylinderAndTop(double radiusX, double radiusY, int height) const;
@@ -37,6 +49,11 @@ public:
 
     virtual LegoNode* cloning(void) const { return new LegoNode(*this); }
 
+    // Names of body, plot and bottom cylinder geodes, so that World can hide the covered or compiled ones
+    static const char* bodyName;
+    static const char* plotName;
+    static const char* bottomCylinderName;
+
 protected:
     Lego* _lego;
 };
@@ -0,0 +1,58 @@
+#include "LegoRegistry.h"
+
+#include "BrickDialog.h"
+#include "CornerDialog.h"
+#include "TileDialog.h"
+#include "ReverseTileDialog.h"
+#include "RoadDialog.h"
+#include "CylinderDialog.h"
+#include "ConeDialog.h"
+#include "EdgeDialog.h"
+#include "WindowDialog.h"
+#include "DoorDialog.h"
+#include "WheelDialog.h"
+#include "FrontShipDialog.h"
+#include "GridDialog.h"
+#include "ClampDialog.h"
+#include "CharacterDialog.h"
+#include "FromFileDialog.h"
+
+// Constructors are wrapped in plain functions so that the registry is a constant array
+template<class T> Lego* constructLego(void) { return new T; }
+template<class T> LegoNode* constructLegoNode(void) { return new T; }
+template<class T> LegoDialog* constructLegoDialog(void) { return new T; }
+
+#define LEGO_ENTRY(Name) { #Name, &constructLego<Name>, &constructLegoNode<Name##Node>, &constructLegoDialog<Name##Dialog> }
+
+// Indexed by LegoRegistry::LegoType, so the entries have to follow the enum order
+const LegoRegistry::Entry LegoRegistry::_entries[LegoRegistry::nbLegoTypes] = {
+    LEGO_ENTRY(Brick),
+    LEGO_ENTRY(Corner),
+    LEGO_ENTRY(Tile),
+    LEGO_ENTRY(ReverseTile),
+    LEGO_ENTRY(Road),
+    LEGO_ENTRY(Cylinder),
+    LEGO_ENTRY(Cone),
+    LEGO_ENTRY(Edge),
+    LEGO_ENTRY(Window),
+    LEGO_ENTRY(Door),
+    LEGO_ENTRY(Wheel),
+    LEGO_ENTRY(FrontShip),
+    LEGO_ENTRY(Grid),
+    LEGO_ENTRY(Clamp),
+    LEGO_ENTRY(Character),
+    LEGO_ENTRY(FromFile)
+};
+
+#undef LEGO_ENTRY
+
+LegoRegistry::LegoType LegoRegistry::fromName(const QString& name) {
+    // Only used when reading names from outside (files, settings), never in creation loops
+    for (int k = 0; k < nbLegoTypes; k++) {
+        if (name == _entries[k].name)
+            return static_cast<LegoType>(k);
+    }
+
+    // Fall back on brick, the default piece
+    return brick;
+}
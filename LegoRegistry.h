@@ -0,0 +1,39 @@
+#ifndef LEGOREGISTRY_H
+#define LEGOREGISTRY_H
+
+#include <QString>
+
+#include "Lego.h"
+#include "LegoNode.h"
+#include "LegoDialog.h"
+
+
+class LegoRegistry {
+
+public:
+    // Order matters: it is the order of the shape combo box within MainWindow
+    enum LegoType { brick, corner, tile, reverseTile, road, cylinder, cone, edge,
+                    window, door, wheel, frontShip, grid, clamp, character, fromFile,
+                    nbLegoTypes };
+
+    // One entry per LEGO piece: Lego, LegoNode and LegoDialog are always built together
+    struct Entry {
+        const char* name;
+        Lego* (*createLego)(void);
+        LegoNode* (*createLegoNode)(void);
+        LegoDialog* (*createLegoDialog)(void);
+    };
+
+    static const Entry& entry(LegoType legoType) { return _entries[legoType]; }
+    static QString name(LegoType legoType) { return QString(_entries[legoType].name); }
+    static LegoType fromName(const QString& name);
+
+    static Lego* createLego(LegoType legoType) { return _entries[legoType].createLego(); }
+    static LegoNode* createLegoNode(LegoType legoType) { return _entries[legoType].createLegoNode(); }
+    static LegoDialog* createLegoDialog(LegoType legoType) { return _entries[legoType].createLegoDialog(); }
+
+private:
+    static const Entry _entries[nbLegoTypes];
+};
+
+#endif // LEGOREGISTRY_H
@@ -5,10 +5,15 @@
 #include "MainWindow.h"
 
 #include "GenerateRoadWindow.h"
+#include "RoadGenerator.h"
+#include "CityGenerator.h"
+#include "ModelCache.h"
 #include "Commands.h"
 #include "SettingsDialog.h"
 
-#include "LegoFactory.h"
+#include "LegoRegistry.h"
+#include "Profiler.h"
+#include "ProfilerWidget.h"
 #include "BrickDialog.h"
 #include "CornerDialog.h"
 #include "RoadDialog.h"
@@ -25,14 +30,17 @@
 #include "ConeDialog.h"
 #include "EdgeDialog.h"
 #include "ClampDialog.h"
+#include "LDrawParser.h"
 
 #include <QSettings>
+#include <QtConcurrentRun>
+
+#include <osgDB/ReadFile>
 
 MainWindow::MainWindow(QWidget* parent) :
     QMainWindow(parent),
     _legoColor(Qt::red),
     _world(),
-    _roadPath(),
     _settings(QSettings::UserScope, "Perso", "Lego Creator"),
     _alreadySaved(false),
     _saved(true) {
@@ -40,14 +48,17 @@ MainWindow::MainWindow(QWidget* parent) :
     // Create undo stack to manage undo/redo actions
     _undoStack = new QUndoStack(this);
 
-    // Create the settings dialog
-    _settingsDialog = new SettingsDialog;
+    // Files are read in background, so that long imports don't freeze the interface
+    _importWatcher = new QFutureWatcher<osg::Node*>(this);
+    connect(_importWatcher, SIGNAL(finished()), this, SLOT(importFinished()));
+
+    // Settings dialog is created when first opened
+    _settingsDialog = NULL;
 
     // Settings to record save path and other
     _settings.setValue("SavePath", "../LEGO_CREATOR/OSG/");
     _settings.setValue("OpenPath", "../LEGO_CREATOR/OSG/");
     _settings.setValue("RecordPath", "../LEGO_CREATOR/OSG/RecordPath/");
-    _settings.setValue("VehiculesPath", "../LEGO_CREATOR/OSG/Vehicules");
     _settings.setValue("RecordFileName", "traffic.path");
     _settings.setValue("FileName", "");
     _settings.setValue("DefaultViewerColor", QColor(236.0, 236.0, 236.0));
@@ -55,18 +66,25 @@ MainWindow::MainWindow(QWidget* parent) :
     _settings.setValue("DefaultViewerLength", 30);
     _settings.setValue("DefaultViewerGridVisible", true);
 
-    // Register in factories
-    initFactories();
+    // LDraw library, used by the parts browser
+    LDrawParser::setLDrawPath(_settings.value("LDrawPath", LDrawParser::getLDrawPath()).toString());
+    LDrawParser::setPrimitiveSegments(_settings.value("LDrawPrimitiveSegments", LDrawParser::getPrimitiveSegments()).toInt());
+
+    Profiler::markStartup("World created");
 
     // Init preview element
     initPreview();
     initDialogs();
+    Profiler::markStartup("Preview created");
+
+    // Create profiler dock, hidden until asked from Edit menu
+    createProfilerDock();
 
     // Create menus
     createFileMenu();
     createEditMenu();
     createGenerateMenu();
-    //createTrafficMenu();
+    createTrafficMenu();
     createHelpMenu();
 
     // Create tool bar
@@ -74,15 +92,18 @@ MainWindow::MainWindow(QWidget* parent) :
 
     // Create undo/redo window
     createUndoView();
+    Profiler::markStartup("Menus created");
 
     // Create right dock
     createParamsDock();
+    Profiler::markStartup("Params dock created");
 
     // Create scene
     createScene();
+    Profiler::markStartup("Scene viewer created");
 
-    // Init Traffic from world scene
-    //initTraffic();
+    // Init Traffic within world scene, roads come with generated circuits and cities
+    initTraffic();
 
     // Add skybox
     //addSkyBox();
@@ -93,17 +114,17 @@ MainWindow::MainWindow(QWidget* parent) :
 
     // Connections
     connect(_shapeComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(chooseDialog(int)));
-    for (int k = 0; k < _shapeComboBox->count(); k++)
-        connect(_legoDialog.at(k), SIGNAL(changedLego(LegoNode*)), this, SLOT(legoUpdated(LegoNode*)));
     connect(_colorButton, SIGNAL(clicked()), this, SLOT(browseColor()));
     connect(_createButton, SIGNAL(clicked()), this, SLOT(createLego()));
 
     connect(_undoAction, SIGNAL(triggered()), this, SLOT(freezeFit()));
     connect(_redoAction, SIGNAL(triggered()), this, SLOT(freezeCreate()));
 
-    connect(_settingsDialog, SIGNAL(gridSizeChanged()), this, SLOT(updateWorldGrid()));
-    connect(_settingsDialog, SIGNAL(viewerColorChanged(QColor)), this, SLOT(viewerColorUpdate(QColor)));
-    connect(_settingsDialog, SIGNAL(gridVisible(bool)), this, SLOT(setGridVisible(bool)));
+    // Viewers only draw on demand: scene edits and LEGO changes request a frame
+    connect(_undoStack, SIGNAL(indexChanged(int)), _sceneViewer, SLOT(requestFrame()));
+
+    // Startup timeline is logged once the scene is drawn
+    connect(_sceneViewer, SIGNAL(firstFrameDrawn()), this, SLOT(startupFinished()));
 
     // Change soft title
     setWindowTitle("LEGO Creator");
@@ -116,190 +137,6 @@ MainWindow::MainWindow(QWidget* parent) :
 }
 
 MainWindow::~MainWindow() {
-    // Delete all factories
-    LegoFactory<Brick, QString>::kill();
-    LegoFactory<BrickNode, QString>::kill();
-    LegoFactory<BrickDialog, QString>::kill();
-
-    LegoFactory<Corner, QString>::kill();
-    LegoFactory<CornerNode, QString>::kill();
-    LegoFactory<CornerDialog, QString>::kill();
-
-    LegoFactory<Road, QString>::kill();
-    LegoFactory<RoadNode, QString>::kill();
-    LegoFactory<RoadDialog, QString>::kill();
-
-    LegoFactory<Tile, QString>::kill();
-    LegoFactory<TileNode, QString>::kill();
-    LegoFactory<TileDialog, QString>::kill();
-
-    LegoFactory<ReverseTile, QString>::kill();
-    LegoFactory<ReverseTileNode, QString>::kill();
-    LegoFactory<ReverseTileDialog, QString>::kill();
-
-    LegoFactory<Character, QString>::kill();
-    LegoFactory<CharacterNode, QString>::kill();
-    LegoFactory<CharacterDialog, QString>::kill();
-
-    LegoFactory<Window, QString>::kill();
-    LegoFactory<WindowNode, QString>::kill();
-    LegoFactory<WindowDialog, QString>::kill();
-
-    LegoFactory<Door, QString>::kill();
-    LegoFactory<DoorNode, QString>::kill();
-    LegoFactory<DoorDialog, QString>::kill();
-
-    LegoFactory<FromFile, QString>::kill();
-    LegoFactory<FromFileNode, QString>::kill();
-    LegoFactory<FromFileDialog, QString>::kill();
-
-    LegoFactory<Wheel, QString>::kill();
-    LegoFactory<WheelNode, QString>::kill();
-    LegoFactory<WheelDialog, QString>::kill();
-
-    LegoFactory<Character, QString>::kill();
-    LegoFactory<CharacterNode, QString>::kill();
-    LegoFactory<CharacterDialog, QString>::kill();
-
-    LegoFactory<FrontShip, QString>::kill();
-    LegoFactory<FrontShipNode, QString>::kill();
-    LegoFactory<FrontShipDialog, QString>::kill();
-
-    LegoFactory<Cylinder, QString>::kill();
-    LegoFactory<CylinderNode, QString>::kill();
-    LegoFactory<CylinderDialog, QString>::kill();
-
-    LegoFactory<Cone, QString>::kill();
-    LegoFactory<ConeNode, QString>::kill();
-    LegoFactory<ConeDialog, QString>::kill();
-
-    LegoFactory<Edge, QString>::kill();
-    LegoFactory<EdgeNode, QString>::kill();
-    LegoFactory<EdgeDialog, QString>::kill();
-
-    LegoFactory<Grid, QString>::kill();
-    LegoFactory<GridNode, QString>::kill();
-    LegoFactory<GridDialog, QString>::kill();
-
-    LegoFactory<Clamp, QString>::kill();
-    LegoFactory<ClampNode, QString>::kill();
-    LegoFactory<ClampDialog, QString>::kill();
-}
-
-void MainWindow::initFactories(void) {
-    // Register Brick
-    LegoFactory<Brick, QString>::instance()->registerLego(QString("Brick"), new Brick);
-    // Register BrickNode
-    LegoFactory<BrickNode, QString>::instance()->registerLego(QString("BrickNode"), new BrickNode);
-    // Register BrickDialog
-    LegoFactory<BrickDialog, QString>::instance()->registerLego(QString("BrickDialog"), new BrickDialog);
-
-    // Register Corner
-    LegoFactory<Corner, QString>::instance()->registerLego(QString("Corner"), new Corner);
-    // Register CornerNode
-    LegoFactory<CornerNode, QString>::instance()->registerLego(QString("CornerNode"), new CornerNode);
-    // Register CornerDialog
-    LegoFactory<CornerDialog, QString>::instance()->registerLego(QString("CornerDialog"), new CornerDialog);
-
-    // Register Tile
-    LegoFactory<Tile, QString>::instance()->registerLego(QString("Tile"), new Tile);
-    // Register TileNode
-    LegoFactory<TileNode, QString>::instance()->registerLego(QString("TileNode"), new TileNode);
-    // Register TileDialog
-    LegoFactory<TileDialog, QString>::instance()->registerLego(QString("TileDialog"), new TileDialog);
-
-    // Register ReverseTile
-    LegoFactory<ReverseTile, QString>::instance()->registerLego(QString("ReverseTile"), new ReverseTile);
-    // Register ReverseTileNode
-    LegoFactory<ReverseTileNode, QString>::instance()->registerLego(QString("ReverseTileNode"), new ReverseTileNode);
-    // Register ReverseTileDialog
-    LegoFactory<ReverseTileDialog, QString>::instance()->registerLego(QString("ReverseTileDialog"), new ReverseTileDialog);
-
-    // Register Road
-    LegoFactory<Road, QString>::instance()->registerLego(QString("Road"), new Road);
-    // Register RoadNode
-    LegoFactory<RoadNode, QString>::instance()->registerLego(QString("RoadNode"), new RoadNode);
-    // Register RoadDialog
-    LegoFactory<RoadDialog, QString>::instance()->registerLego(QString("RoadDialog"), new RoadDialog);
-
-    // Register Cylinder
-    LegoFactory<Cylinder, QString>::instance()->registerLego(QString("Cylinder"), new Cylinder);
-    // Register CylinderNode
-    LegoFactory<CylinderNode, QString>::instance()->registerLego(QString("CylinderNode"), new CylinderNode);
-    // Register CylinderDialog
-    LegoFactory<CylinderDialog, QString>::instance()->registerLego(QString("CylinderDialog"), new CylinderDialog);
-
-    // Register Cone
-    LegoFactory<Cone, QString>::instance()->registerLego(QString("Cone"), new Cone);
-    // Register ConeNode
-    LegoFactory<ConeNode, QString>::instance()->registerLego(QString("ConeNode"), new ConeNode);
-    // Register ConeDialog
-    LegoFactory<ConeDialog, QString>::instance()->registerLego(QString("ConeDialog"), new ConeDialog);
-
-    // Register Edge
-    LegoFactory<Edge, QString>::instance()->registerLego(QString("Edge"), new Edge);
-    // Register EdgeNode
-    LegoFactory<EdgeNode, QString>::instance()->registerLego(QString("EdgeNode"), new EdgeNode);
-    // Register EdgeDialog
-    LegoFactory<EdgeDialog, QString>::instance()->registerLego(QString("EdgeDialog"), new EdgeDialog);
-
-    // Register Window
-    LegoFactory<Window, QString>::instance()->registerLego(QString("Window"), new Window);
-    // Register WindowNode
-    LegoFactory<WindowNode, QString>::instance()->registerLego(QString("WindowNode"), new WindowNode);
-    // Register WindowDialog
-    LegoFactory<WindowDialog, QString>::instance()->registerLego(QString("WindowDialog"), new WindowDialog);
-
-    // Register Door
-    LegoFactory<Door, QString>::instance()->registerLego(QString("Door"), new Door);
-    // Register DoorNode
-    LegoFactory<DoorNode, QString>::instance()->registerLego(QString("DoorNode"), new DoorNode);
-    // Register DoorDialog
-    LegoFactory<DoorDialog, QString>::instance()->registerLego(QString("DoorDialog"), new DoorDialog);
-
-    // Register Wheel
-    LegoFactory<Wheel, QString>::instance()->registerLego(QString("Wheel"), new Wheel);
-    // Register WheelNode
-    LegoFactory<WheelNode, QString>::instance()->registerLego(QString("WheelNode"), new WheelNode);
-    // Register WheelDialog
-    LegoFactory<WheelDialog, QString>::instance()->registerLego(QString("WheelDialog"), new WheelDialog);
-
-    // Register FrontShip
-    LegoFactory<FrontShip, QString>::instance()->registerLego(QString("FrontShip"), new FrontShip);
-    // Register FrontShipNode
-    LegoFactory<FrontShipNode, QString>::instance()->registerLego(QString("FrontShipNode"), new FrontShipNode);
-    // Register FrontShipDialog
-    LegoFactory<FrontShipDialog, QString>::instance()->registerLego(QString("FrontShipDialog"), new FrontShipDialog);
-
-    // Register Grid
-    LegoFactory<Grid, QString>::instance()->registerLego(QString("Grid"), new Grid);
-    // Register GridNode
-    LegoFactory<GridNode, QString>::instance()->registerLego(QString("GridNode"), new GridNode);
-    // Register GridDialog
-    LegoFactory<GridDialog, QString>::instance()->registerLego(QString("GridDialog"), new GridDialog);
-
-    // Register Clamp
-    LegoFactory<Clamp, QString>::instance()->registerLego(QString("Clamp"), new Clamp);
-    // Register ClampNode
-    LegoFactory<ClampNode, QString>::instance()->registerLego(QString("ClampNode"), new ClampNode);
-    // Register ClampDialog
-    LegoFactory<ClampDialog, QString>::instance()->registerLego(QString("ClampDialog"), new ClampDialog);
-
-    // Register Character
-    LegoFactory<Character, QString>::instance()->registerLego(QString("Character"), new Character);
-    // Register CharacterNode
-    LegoFactory<CharacterNode, QString>::instance()->registerLego(QString("CharacterNode"), new CharacterNode);
-    // Register CharacterDialog
-    LegoFactory<CharacterDialog, QString>::instance()->registerLego(QString("CharacterDialog"), new CharacterDialog);
-
-    // Register FromFile
-    LegoFactory<FromFile, QString>::instance()->registerLego(QString("FromFile"), new FromFile);
-    // Register FromFileNode
-    LegoFactory<FromFileNode, QString>::instance()->registerLego(QString("FromFileNode"), new FromFileNode);
-    // Register FromFileDialog
-    LegoFactory<FromFileDialog, QString>::instance()->registerLego(QString("FromFileDialog"), new FromFileDialog);
-
-    // ENREGISTRER ICI LES AUTRES CLASSES DE PIECE LEGO QUE L'ON CREERA
 }
 
 void MainWindow::initPreview(void) {
@@ -307,13 +144,13 @@ void MainWindow::initPreview(void) {
     _currMatTrans = new osg::MatrixTransform;
 
     // Create a 4x2 red classic brick by default
-    _currLego = LegoFactory<Brick, QString>::instance()->create("Brick");
+    _currLego = LegoRegistry::createLego(LegoRegistry::brick);
     static_cast<Brick*>(_currLego.get())->setColor(QColor(Qt::red));
     static_cast<Brick*>(_currLego.get())->setWidth(2);
     static_cast<Brick*>(_currLego.get())->setLength(4);
 
     // Create associated brick geode
-    _currLegoNode = LegoFactory<BrickNode, QString>::instance()->create("BrickNode");
+    _currLegoNode = LegoRegistry::createLegoNode(LegoRegistry::brick);
     _currLegoNode->setLego(_currLego);
     _currLegoNode->createGeode();
 
@@ -322,108 +159,46 @@ void MainWindow::initPreview(void) {
     // Create root node and add brick geode
     _scene = new osg::Group;
     _scene->addChild(_currMatTrans);
+
+    // Preview shares the world skybox
+    _scene->addChild(_world.getSkybox());
 }
 
 void MainWindow::initDialogs(void) {
-    // BrickDialog
-    if (BrickDialog* brickDialog = dynamic_cast<BrickDialog*>(LegoFactory<BrickDialog, QString>::instance()->create("BrickDialog"))) {
-        brickDialog->initLego(_currLego);
-        brickDialog->initLegoNode(_currLegoNode);
-        _legoDialog << brickDialog;
-    } else
-        qDebug() << "Cannot create BrickDialog in MainWindow::initDialogs";
-
-    // CornerDialog
-    if (CornerDialog* cornerDialog = dynamic_cast<CornerDialog*>(LegoFactory<CornerDialog, QString>::instance()->create("CornerDialog")))
-        _legoDialog << cornerDialog;
-    else
-        qDebug() << "Cannot create CornerDialog in MainWindow::initDialogs";
-
-    // TileDialog
-    if (TileDialog* tileDialog = dynamic_cast<TileDialog*>(LegoFactory<TileDialog, QString>::instance()->create("TileDialog")))
-        _legoDialog << tileDialog;
-    else
-        qDebug() << "Cannot create TileDialog in MainWindow::initDialogs";
-
-    // ReverseTileDialog
-    if (ReverseTileDialog* reversetileDialog = dynamic_cast<ReverseTileDialog*>(LegoFactory<ReverseTileDialog, QString>::instance()->create("ReverseTileDialog")))
-        _legoDialog << reversetileDialog;
-    else
-        qDebug() << "Cannot create ReverseTileDialog in MainWindow::initDialogs";
-
-    // RoadDialog
-    if (RoadDialog* roadDialog = dynamic_cast<RoadDialog*>(LegoFactory<RoadDialog, QString>::instance()->create("RoadDialog")))
-        _legoDialog << roadDialog;
-    else
-        qDebug() << "Cannot create RoadDialog in MainWindow::initDialogs";
-
-    // CylinderDialog
-    if (CylinderDialog* cylinderDialog = dynamic_cast<CylinderDialog*>(LegoFactory<CylinderDialog, QString>::instance()->create("CylinderDialog")))
-        _legoDialog << cylinderDialog;
-    else
-        qDebug() << "Cannot create CylinderDialog in MainWindow::initDialogs";
-
-    // ConeDialog
-    if (ConeDialog* coneDialog = dynamic_cast<ConeDialog*>(LegoFactory<ConeDialog, QString>::instance()->create("ConeDialog")))
-        _legoDialog << coneDialog;
-    else
-        qDebug() << "Cannot create ConeDialog in MainWindow::initDialogs";
-
-    // EdgeDialog
-    if (EdgeDialog* edgeDialog = dynamic_cast<EdgeDialog*>(LegoFactory<EdgeDialog, QString>::instance()->create("EdgeDialog")))
-        _legoDialog << edgeDialog;
-    else
-        qDebug() << "Cannot create EdgeDialog in MainWindow::initDialogs";
-
-    // WindowDialog
-    if (WindowDialog* windowDialog = dynamic_cast<WindowDialog*>(LegoFactory<WindowDialog, QString>::instance()->create("WindowDialog")))
-        _legoDialog << windowDialog;
-    else
-        qDebug() << "Cannot create WindowDialog in MainWindow::initDialogs";
-
-    // DoorDialog
-    if (DoorDialog* doorDialog = dynamic_cast<DoorDialog*>(LegoFactory<DoorDialog, QString>::instance()->create("DoorDialog")))
-        _legoDialog << doorDialog;
-    else
-        qDebug() << "Cannot create DoorDialog in MainWindow::initDialogs";
-
-    // WheelDialog
-    if (WheelDialog* wheelDialog = dynamic_cast<WheelDialog*>(LegoFactory<WheelDialog, QString>::instance()->create("WheelDialog")))
-        _legoDialog << wheelDialog;
-    else
-        qDebug() << "Cannot create WheelDialog in MainWindow::initDialogs";
-
-    // FrontShipDialog
-    if (FrontShipDialog* frontShipDialog = dynamic_cast<FrontShipDialog*>(LegoFactory<FrontShipDialog, QString>::instance()->create("FrontShipDialog")))
-        _legoDialog << frontShipDialog;
-    else
-        qDebug() << "Cannot create FrontShipDialog in MainWindow::initDialogs";
-
-    // GridDialog
-    if (GridDialog* gridDialog = dynamic_cast<GridDialog*>(LegoFactory<GridDialog, QString>::instance()->create("GridDialog")))
-        _legoDialog << gridDialog;
-    else
-        qDebug() << "Cannot create GridDialog in MainWindow::initDialogs";
-
-    // ClampDialog
-    if (ClampDialog* clampDialog = dynamic_cast<ClampDialog*>(LegoFactory<ClampDialog, QString>::instance()->create("ClampDialog")))
-        _legoDialog << clampDialog;
-    else
-        qDebug() << "Cannot create ClampDialog in MainWindow::initDialogs";
-
-    // CharacterDialog
-    if (CharacterDialog* characterDialog = dynamic_cast<CharacterDialog*>(LegoFactory<CharacterDialog, QString>::instance()->create("CharacterDialog")))
-        _legoDialog << characterDialog;
-    else
-        qDebug() << "Cannot create CharacterDialog in MainWindow::initDialogs";
-
-    for (int k = 1; k < _legoDialog.size(); k++) {
-        _legoDialog.at(k)->setVisible(false);
+    // One dialog per piece available in the shape combo box, i.e. every piece but FromFile.
+    // They are created on first use, by legoDialog
+    _legoDialog.fill(NULL, LegoRegistry::fromFile);
+    _dialogsLayout = NULL;
+}
+
+LegoDialog* MainWindow::legoDialog(int dialogIndex) {
+    if (!_legoDialog.at(dialogIndex)) {
+        PROFILE_SCOPE("MainWindow::legoDialog");
+
+        LegoDialog* dialog = LegoRegistry::createLegoDialog(static_cast<LegoRegistry::LegoType>(dialogIndex));
+        dialog->setVisible(false);
+        _dialogsLayout->addWidget(dialog);
+
+        // Preview follows dialog changes
+        connect(dialog, SIGNAL(changedLego(LegoNode*)), this, SLOT(legoUpdated(LegoNode*)));
+        connect(dialog, SIGNAL(changedLego(LegoNode*)), _brickViewer, SLOT(requestFrame()));
+
+        _legoDialog[dialogIndex] = dialog;
     }
+
+    return _legoDialog.at(dialogIndex);
+}
+
+void MainWindow::startupFinished(void) {
+    Profiler::markStartup("First scene frame");
+    Profiler::logStartup();
+
+    emit started();
 }
 
 
 
+
 // ////////////////////////////////////
 // Create Param Dock Widget
 // ////////////////////////////////////
@@ -431,21 +206,8 @@ void MainWindow::createParamsDock(void) {
     // ComboBox choose your brick
     _shapeComboBox = new QComboBox(this);
     QStringList brickForms;
-    brickForms << "Brick"
-               << "Corner"
-               << "Tile"
-               << "ReverseTile"
-               << "Road"
-               << "Cylinder"
-               << "Cone"
-               << "Edge"
-               << "Window"
-               << "Door"
-               << "Wheel"
-               << "FrontShip"
-               << "Grid"
-               << "Clamp"
-               << "Character";
+    for (int k = 0; k < LegoRegistry::fromFile; k++)
+        brickForms << LegoRegistry::name(static_cast<LegoRegistry::LegoType>(k));
     _shapeComboBox->addItems(brickForms);
     _shapeComboBox->setFixedWidth(150);
     QFormLayout* shapeLayout = new QFormLayout;
@@ -456,7 +218,7 @@ void MainWindow::createParamsDock(void) {
     previewFrame->setFixedSize(250, 250);
     // Create osg viewer widget that displays bricks
     qDebug() << "Preview";
-    _brickViewer = new ViewerWidget(false);
+    _brickViewer = new ViewerWidget(false, renderThreadingModel());
     _brickViewer->initView();
     _brickViewer->initManipulators();
     _brickViewer->changeCamera(ViewerWidget::createCamera(osg::Vec4(.1, .1, .1, 1.), 0, 0, 100, 100));
@@ -495,10 +257,15 @@ void MainWindow::createParamsDock(void) {
     QVBoxLayout* mainLayout = new QVBoxLayout;
     mainLayout->addWidget(previewFrame);
     mainLayout->addLayout(globalShapeLayout);
-    for (int k = 0; k < _legoDialog.size(); k++)
-        mainLayout->addWidget(_legoDialog.at(k));
     mainLayout->setAlignment(Qt::AlignTop);
 
+    // Only the dialog of the preview brick is needed at startup
+    _dialogsLayout = mainLayout;
+    LegoDialog* brickDialog = legoDialog(LegoRegistry::brick);
+    brickDialog->initLego(_currLego);
+    brickDialog->initLegoNode(_currLegoNode);
+    brickDialog->setVisible(true);
+
     // Params Widget
     _paramsWidget = new QWidget(this);
     _paramsWidget->setLayout(mainLayout);
@@ -509,6 +276,11 @@ void MainWindow::createParamsDock(void) {
     _paramsTabWidget = new QTabWidget(this);
     _paramsTabWidget->addTab(_paramsWidget, "Bricks");
     _paramsTabWidget->addTab(_undoView, "Commands");
+
+    // LDraw parts browser, a chosen part is imported like any other file
+    _partBrowser = new PartBrowser(this);
+    _paramsTabWidget->addTab(_partBrowser, "Parts");
+    connect(_partBrowser, SIGNAL(partChosen(QString)), this, SLOT(openFromFile(QString)));
     // No focus on tab, it's ugly
     _paramsTabWidget->setFocusPolicy(Qt::NoFocus);
 
@@ -522,6 +294,16 @@ void MainWindow::createParamsDock(void) {
     _paramsDock->move(50, 200);
 }
 
+void MainWindow::createProfilerDock(void) {
+    // Profiler dock shows live timings of LEGO creation, picking, commands and file I/O
+    _profilerDock = new QDockWidget("Profiler", this);
+    _profilerDock->setWidget(new ProfilerWidget(_profilerDock));
+    addDockWidget(Qt::BottomDockWidgetArea, _profilerDock);
+    _profilerDock->setFloating(true);
+    _profilerDock->resize(600, 300);
+    _profilerDock->hide();
+}
+
 void MainWindow::createScene(void) {
     // Scene frame, contains LEGO bricks
     _sceneFrame = new QFrame(this);
@@ -541,11 +323,13 @@ void MainWindow::createScene(void) {
 
     // Scene viewer
     qDebug() << "Scene";
-    _sceneViewer = new ViewerWidget(true);
+    _sceneViewer = new ViewerWidget(true, renderThreadingModel());
     _sceneViewer->initView();
     _sceneViewer->initManipulators();
     _sceneViewer->changeCamera(ViewerWidget::createCamera(osg::Vec4(r/255.0, g/255.0, b/255.0, 1.), 0.0, 0.0, 1440.0, 770.0));
     _sceneViewer->changeScene(_world.getScene().get());
+    _sceneViewer->setWorld(&_world);
+    _sceneViewer->setBoxPickingOnly(_settings.value("PickBoxOnly", false).toBool());
     qDebug() << "Add scene to word:" << _world.getScene().get();
     _sceneViewer->initWidget();
 
@@ -569,194 +353,68 @@ void MainWindow::browseColor(void) {
 }
 
 void MainWindow::chooseDialog(int dialogIndex) {
-    // Dialogs are created, but only the current LEGO dialog is  visible
+    // Only the current LEGO dialog is visible, it is created on first choice
     for (int k = 0; k < _legoDialog.size(); k++) {
-        if (k == dialogIndex)
-            _legoDialog.at(k)->setVisible(true);
-        else
+        if (_legoDialog.at(k) && k != dialogIndex)
             _legoDialog.at(k)->setVisible(false);
     }
+    legoDialog(dialogIndex)->setVisible(true);
+
+    // Create LEGO and LegoNode according to the dialog, straight from the registry
+    LegoRegistry::LegoType legoType = static_cast<LegoRegistry::LegoType>(dialogIndex);
+    _currLego = LegoRegistry::createLego(legoType);
+    _currLegoNode = LegoRegistry::createLegoNode(legoType);
+
+    // Every piece gets the current color...
+    _currLego->setColor(_legoColor);
 
-    // Create dialog, according to
-    switch (dialogIndex) {
+    // ... and its own dialog values
+    switch (legoType) {
     // Brick dialog
-    case 0:
-        if ((_currLego = dynamic_cast<Brick*>(LegoFactory<Brick, QString>::instance()->create("Brick")))) {
-            BrickDialog* dialog = static_cast<BrickDialog*>(_legoDialog.at(dialogIndex));
-            Brick* lego = static_cast<Brick*>(_currLego.get());
-            lego->setColor(_legoColor);
-            lego->setWidth(dialog->getWidth());
-            lego->setLength(dialog->getLength());
-        } else {
-            qDebug() << "Cannot cast in Brick* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<BrickNode*>(LegoFactory<BrickNode, QString>::instance()->create("BrickNode"))))
-            qDebug() << "Cannot cast in BrickNode* within MainWindow::chooseDialog";
-        break;
-    // Corner dialog
-    case 1:
-        if ((_currLego = dynamic_cast<Corner*>(LegoFactory<Corner, QString>::instance()->create("Corner")))) {
-            Corner* lego = static_cast<Corner*>(_currLego.get());
-            lego->setColor(_legoColor);
-        } else {
-            qDebug() << "Cannot cast in Corner* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<CornerNode*>(LegoFactory<CornerNode, QString>::instance()->create("CornerNode"))))
-            qDebug() << "Cannot cast in CornerNode* within MainWindow::chooseDialog";
+    case LegoRegistry::brick: {
+        BrickDialog* dialog = static_cast<BrickDialog*>(_legoDialog.at(dialogIndex));
+        Brick* lego = static_cast<Brick*>(_currLego.get());
+        lego->setWidth(dialog->getWidth());
+        lego->setLength(dialog->getLength());
         break;
+    }
     // Tile dialog
-    case 2:
-        if ((_currLego = dynamic_cast<Tile*>(LegoFactory<Tile, QString>::instance()->create("Tile")))) {
-            TileDialog* dialog = static_cast<TileDialog*>(_legoDialog.at(dialogIndex));
-            Tile* lego = static_cast<Tile*>(_currLego.get());
-            lego->setColor(_legoColor);
-            lego->setWidth(dialog->getWidth());
-            lego->setLength(dialog->getLength());
-        } else {
-            qDebug() << "Cannot cast in Tile* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<TileNode*>(LegoFactory<TileNode, QString>::instance()->create("TileNode"))))
-            qDebug() << "Cannot cast in TileNode* within MainWindow::chooseDialog";
+    case LegoRegistry::tile: {
+        TileDialog* dialog = static_cast<TileDialog*>(_legoDialog.at(dialogIndex));
+        Tile* lego = static_cast<Tile*>(_currLego.get());
+        lego->setWidth(dialog->getWidth());
+        lego->setLength(dialog->getLength());
         break;
+    }
     // ReverseTile dialog
-    case 3:
-        if ((_currLego = dynamic_cast<ReverseTile*>(LegoFactory<ReverseTile, QString>::instance()->create("ReverseTile")))) {
-            ReverseTileDialog* dialog = static_cast<ReverseTileDialog*>(_legoDialog.at(dialogIndex));
-            ReverseTile* lego = static_cast<ReverseTile*>(_currLego.get());
-            lego->setColor(_legoColor);
-            lego->setWidth(dialog->getWidth());
-            lego->setLength(dialog->getLength());
-        } else {
-            qDebug() << "Cannot cast in ReverseTile* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<ReverseTileNode*>(LegoFactory<ReverseTileNode, QString>::instance()->create("ReverseTileNode"))))
-            qDebug() << "Cannot cast in ReverseTileNode* within MainWindow::chooseDialog";
+    case LegoRegistry::reverseTile: {
+        ReverseTileDialog* dialog = static_cast<ReverseTileDialog*>(_legoDialog.at(dialogIndex));
+        ReverseTile* lego = static_cast<ReverseTile*>(_currLego.get());
+        lego->setWidth(dialog->getWidth());
+        lego->setLength(dialog->getLength());
         break;
+    }
     // Road dialog
-    case 4:
-        if ((_currLego = dynamic_cast<Road*>(LegoFactory<Road, QString>::instance()->create("Road")))) {
-            RoadDialog* dialog = static_cast<RoadDialog*>(_legoDialog.at(dialogIndex));
-            Road* lego = static_cast<Road*>(_currLego.get());
-            lego->setColor(QColor(0, 112, 44));
-            lego->setRoadType(dialog->getCurrentRoadTypeIndex());
-        } else {
-            qDebug() << "Cannot cast in Road* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<RoadNode*>(LegoFactory<RoadNode, QString>::instance()->create("RoadNode"))))
-            qDebug() << "Cannot cast in RoadNode* within MainWindow::chooseDialog";
-        break;
-    // Cylinder dialog
-    case 5:
-        if ((_currLego = dynamic_cast<Cylinder*>(LegoFactory<Cylinder, QString>::instance()->create("Cylinder")))) {
-            Cylinder* lego = static_cast<Cylinder*>(_currLego.get());
-            lego->setColor(_legoColor);
-        } else {
-            qDebug() << "Cannot cast in Cylinder* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<CylinderNode*>(LegoFactory<CylinderNode, QString>::instance()->create("CylinderNode"))))
-            qDebug() << "Cannot cast in CylinderNode* within MainWindow::chooseDialog";
-        break;
-    // Cone dialog
-    case 6:
-        if ((_currLego = dynamic_cast<Cone*>(LegoFactory<Cone, QString>::instance()->create("Cone")))) {
-            Cone* lego = static_cast<Cone*>(_currLego.get());
-            lego->setColor(_legoColor);
-        } else {
-            qDebug() << "Cannot cast in Cone* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<ConeNode*>(LegoFactory<ConeNode, QString>::instance()->create("ConeNode"))))
-            qDebug() << "Cannot cast in ConeNode* within MainWindow::chooseDialog";
+    case LegoRegistry::road: {
+        RoadDialog* dialog = static_cast<RoadDialog*>(_legoDialog.at(dialogIndex));
+        Road* lego = static_cast<Road*>(_currLego.get());
+        lego->setColor(QColor(0, 112, 44));
+        lego->setRoadType(dialog->getCurrentRoadTypeIndex());
         break;
+    }
     // Edge dialog
-    case 7:
-        if ((_currLego = dynamic_cast<Edge*>(LegoFactory<Edge, QString>::instance()->create("Edge")))) {
-            EdgeDialog* dialog = static_cast<EdgeDialog*>(_legoDialog.at(dialogIndex));
-            Edge* lego = static_cast<Edge*>(_currLego.get());
-            lego->setColor(_legoColor);
-            lego->setLength(dialog->getLength());
-        } else {
-            qDebug() << "Cannot cast in Edge* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<EdgeNode*>(LegoFactory<EdgeNode, QString>::instance()->create("EdgeNode"))))
-            qDebug() << "Cannot cast in EdgeNode* within MainWindow::chooseDialog";
-        break;
-    // Window dialog
-    case 8:
-        if ((_currLego = dynamic_cast<Window*>(LegoFactory<Window, QString>::instance()->create("Window")))) {
-            Window* lego = static_cast<Window*>(_currLego.get());
-            lego->setColor(_legoColor);
-        } else {
-            qDebug() << "Cannot cast in Window* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<WindowNode*>(LegoFactory<WindowNode, QString>::instance()->create("WindowNode"))))
-            qDebug() << "Cannot cast in WindowNode* within MainWindow::chooseDialog";
-        break;
-    // Door dialog
-    case 9:
-        if ((_currLego = dynamic_cast<Door*>(LegoFactory<Door, QString>::instance()->create("Door")))) {
-            Door* lego = static_cast<Door*>(_currLego.get());
-            lego->setColor(_legoColor);
-        } else {
-            qDebug() << "Cannot cast in Door* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<DoorNode*>(LegoFactory<DoorNode, QString>::instance()->create("DoorNode"))))
-            qDebug() << "Cannot cast in DoorNode* within MainWindow::chooseDialog";
-        break;
-    // Wheel dialog
-    case 10:
-        if ((_currLego = dynamic_cast<Wheel*>(LegoFactory<Wheel, QString>::instance()->create("Wheel")))) {
-            Wheel* lego = static_cast<Wheel*>(_currLego.get());
-            lego->setColor(_legoColor);
-        } else {
-            qDebug() << "Cannot cast in Wheel* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<WheelNode*>(LegoFactory<WheelNode, QString>::instance()->create("WheelNode"))))
-            qDebug() << "Cannot cast in WheelNode* within MainWindow::chooseDialog";
-
-        break;
-    // FrontShip dialog
-    case 11:
-        if ((_currLego = dynamic_cast<FrontShip*>(LegoFactory<FrontShip, QString>::instance()->create("FrontShip")))) {
-            FrontShip* lego = static_cast<FrontShip*>(_currLego.get());
-            lego->setColor(_legoColor);
-        } else {
-            qDebug() << "Cannot cast in FrontShip* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<FrontShipNode*>(LegoFactory<FrontShipNode, QString>::instance()->create("FrontShipNode"))))
-            qDebug() << "Cannot cast in FrontShipNode* within MainWindow::chooseDialog";
-        break;
-    // Grid dialog
-    case 12:
-        if ((_currLego = dynamic_cast<Grid*>(LegoFactory<Grid, QString>::instance()->create("Grid")))) {
-            Grid* lego = static_cast<Grid*>(_currLego.get());
-            lego->setColor(_legoColor);
-        } else {
-            qDebug() << "Cannot cast in Grid* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<GridNode*>(LegoFactory<GridNode, QString>::instance()->create("GridNode"))))
-            qDebug() << "Cannot cast in GridNode* within MainWindow::chooseDialog";
-        break;
-    // Clamp dialog
-    case 13:
-        if ((_currLego = dynamic_cast<Clamp*>(LegoFactory<Clamp, QString>::instance()->create("Clamp")))) {
-            Clamp* lego = static_cast<Clamp*>(_currLego.get());
-            lego->setColor(_legoColor);
-        } else {
-            qDebug() << "Cannot cast in Clamp* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<ClampNode*>(LegoFactory<ClampNode, QString>::instance()->create("ClampNode"))))
-            qDebug() << "Cannot cast in ClampNode* within MainWindow::chooseDialog";
+    case LegoRegistry::edge: {
+        EdgeDialog* dialog = static_cast<EdgeDialog*>(_legoDialog.at(dialogIndex));
+        Edge* lego = static_cast<Edge*>(_currLego.get());
+        lego->setLength(dialog->getLength());
         break;
+    }
     // Character dialog
-    case 14:
-        if ((_currLego = dynamic_cast<Character*>(LegoFactory<Character, QString>::instance()->create("Character")))) {
-            Character* lego = static_cast<Character*>(_currLego.get());
-            lego->setColor(QColor(0, 112, 44));
-        } else {
-            qDebug() << "Cannot cast in Character* within MainWindow::chooseDialog";
-        }
-        if (!(_currLegoNode = dynamic_cast<CharacterNode*>(LegoFactory<CharacterNode, QString>::instance()->create("CharacterNode"))))
-            qDebug() << "Cannot cast in CharacterNode* within MainWindow::chooseDialog";
+    case LegoRegistry::character:
+        _currLego->setColor(QColor(0, 112, 44));
+        break;
+    // Other dialogs only need the color
+    default:
         break;
     }
 
@@ -766,6 +424,7 @@ void MainWindow::chooseDialog(int dialogIndex) {
     _currLegoNode->createGeode();
     _currMatTrans->addChild(_currLegoNode);
     _scene->setChild(0, _currMatTrans.get());
+    _brickViewer->requestFrame();
 
     // Initialize current objects
     _legoDialog.at(dialogIndex)->initLego(_currLego);
@@ -840,6 +499,7 @@ void MainWindow::deleteLego(void) {
 
     // Delete brick
     _world.deleteLego();
+    _sceneViewer->requestFrame();
 
     // Users can create another brick
     freezeFit();
@@ -848,9 +508,73 @@ void MainWindow::deleteLego(void) {
     _saved = false;
 }
 
+void MainWindow::deleteSelection(void) {
+    // Nothing to do without selected pieces
+    if (_world.getSelection().isEmpty())
+        return;
+
+    // Create command to handle undo/redo action
+    _undoStack->push(new DeleteSelectionCommand(&_world, _world.getSelection()));
+
+    // The file has changed
+    _saved = false;
+}
+
+void MainWindow::moveSelection(void) {
+    // Nothing to do without selected pieces
+    QAction* moveAction = qobject_cast<QAction*>(sender());
+    if (!moveAction || _world.getSelection().isEmpty())
+        return;
+
+    // Direction is given by action data
+    int x = 0, y = 0, z = 0;
+    switch (moveAction->data().toInt()) {
+    case 0: x = -1; break;
+    case 1: x =  1; break;
+    case 2: y = -1; break;
+    case 3: y =  1; break;
+    case 4: z = -1; break;
+    case 5: z =  1; break;
+    }
+
+    // Create command to handle undo/redo action
+    _undoStack->push(new MoveSelectionCommand(&_world, _world.getSelection(), x, y, z));
+
+    // The file has changed
+    _saved = false;
+}
+
+void MainWindow::colorSelection(void) {
+    // Nothing to do without selected pieces
+    if (_world.getSelection().isEmpty())
+        return;
+
+    // Open color dialog
+    QColor newColor = QColorDialog::getColor(_legoColor, this);
+
+    // If users did not push cancel button
+    if (newColor.isValid()) {
+        // Create command to handle undo/redo action
+        _undoStack->push(new ColorSelectionCommand(&_world, _world.getSelection(), newColor));
+
+        // The file has changed
+        _saved = false;
+    }
+}
+
+void MainWindow::compileWalls(void) {
+    // Merge bricks into walls, the whole construction without selection
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    _world.compileWalls(_world.getSelection());
+    QApplication::restoreOverrideCursor();
+
+    _sceneViewer->requestFrame();
+}
+
 void MainWindow::translate(int) {
     // As soon as users have change one of the x, y, or z brick coordinate, we translate it
     _world.translationXYZ(_xTransSpinBox->text().toInt(), _yTransSpinBox->text().toInt(), _zTransSpinBox->text().toInt());
+    _sceneViewer->requestFrame();
 
     // The file has changed
     _saved = false;
@@ -859,6 +583,7 @@ void MainWindow::translate(int) {
 void MainWindow::rotateLeft(void) {
     // Rotate clock wise
     _world.rotation(true);
+    _sceneViewer->requestFrame();
 
     // The file has changed
     _saved = false;
@@ -867,178 +592,68 @@ void MainWindow::rotateLeft(void) {
 void MainWindow::rotateRight(void) {
     // Rotate counter clock wise
     _world.rotation(false);
+    _sceneViewer->requestFrame();
 }
 
-void MainWindow::openFromFile(const QString& fileName) {
-    if ((_currLego = dynamic_cast<FromFile*>(LegoFactory<FromFile, QString>::instance()->create("FromFile")))) {
-        if (_currLegoNode = dynamic_cast<FromFileNode*>(LegoFactory<FromFileNode, QString>::instance()->create("FromFileNode"))) {
-            _currLegoNode->setLego(_currLego);
-            FromFile* fromFile = static_cast<FromFile*>(_currLego.get());
-            fromFile->setFileName(fileName);
-            _currLegoNode->createGeode();
-
-            createLego();
-        } else
-            qDebug() << "Cannot cast in FromFileNode* within MainWindow::openFromFile";
-    } else
-        qDebug() << "Cannot cast in FromFile* within MainWindow::openFromFile";
+// Read a model within a background thread, the model cache keeps it for FromFileNode
+static osg::Node* readModel(const QString& fileName) {
+    PROFILE_SCOPE("MainWindow::readModel");
 
-    // Force dialog to refresh and avoid segfault
-    int currDialogIndex = _shapeComboBox->currentIndex();
-    int nextDialogIndex = (currDialogIndex+1)%(_shapeComboBox->count());
-    _shapeComboBox->setCurrentIndex(nextDialogIndex);
-    _shapeComboBox->setCurrentIndex(currDialogIndex);
+    return ModelCache::get(fileName);
 }
 
-void MainWindow::chooseRoad(int i, int j, int width, int length, bool roadTop, bool roadRight) {
-    // Create a road part, according to its top and left neighbour.
-    // The algorithm could (might?) be improved
+osgViewer::ViewerBase::ThreadingModel MainWindow::renderThreadingModel(void) const {
+    // Cull and draw run on OSG threads, unless disabled (some X11 drivers do not like it)
+    if (_settings.value("RenderThread", true).toBool())
+        return osgViewer::ViewerBase::CullThreadPerCameraDrawThreadPerContext;
 
-    // The new road
-    osg::ref_ptr<Road> road = new Road;
+    return osgViewer::ViewerBase::SingleThreaded;
+}
 
-    // Road might have to be rotated several times
-    int nbRotations = 0;
-    // Road type will be get randomly
-    int roadType = -1;
+void MainWindow::openFromFile(const QString& fileName) {
+    // Only one import at a time
+    if (_importWatcher->isRunning())
+        return;
 
-    // There are a road coming from the top and the left
-    if (roadTop && roadRight) {
-        // There are four roads possible in this particular configuration
-        roadType = round((rand()/(double)RAND_MAX) * 3);
-        switch (roadType) {
-        case 0:
-            road->setRoadType(Road::curve);
-            _roadPath[i][j][0] = 1;
-            _roadPath[i][j][1] = 0;
-            _roadPath[i][j][2] = 0;
-            _roadPath[i][j][3] = 1;
-            break;
-        case 1:
-            road->setRoadType(Road::intersection);
-            nbRotations = 2;
-            _roadPath[i][j][0] = 1;
-            _roadPath[i][j][1] = 1;
-            _roadPath[i][j][2] = 0;
-            _roadPath[i][j][3] = 1;
-            break;
-        case 2:
-            road->setRoadType(Road::intersection);
-            nbRotations = 1;
-            _roadPath[i][j][0] = 1;
-            _roadPath[i][j][1] = 0;
-            _roadPath[i][j][2] = 1;
-            _roadPath[i][j][3] = 1;
-            break;
-        case 3:
-            road->setRoadType(Road::cross);
-            _roadPath[i][j][0] = 1;
-            _roadPath[i][j][1] = 1;
-            _roadPath[i][j][2] = 1;
-            _roadPath[i][j][3] = 1;
-            break;
-        }
-    // There is only a road coming from the top
-    } else if (roadTop && !roadRight) {
-        // There are three roads possible in this particular configuration
-        roadType = round((rand()/(double)RAND_MAX) * 2);
-        switch (roadType) {
-        case 0:
-            road->setRoadType(Road::curve);
-            nbRotations = 3;
-            _roadPath[i][j][0] = 0;
-            _roadPath[i][j][1] = 0;
-            _roadPath[i][j][2] = 1;
-            _roadPath[i][j][3] = 1;
-            break;
-        case 1:
-            road->setRoadType(Road::straight);
-            _roadPath[i][j][0] = 0;
-            _roadPath[i][j][1] = 1;
-            _roadPath[i][j][2] = 0;
-            _roadPath[i][j][3] = 1;
-            break;
-        case 2:
-            road->setRoadType(Road::intersection);
-            _roadPath[i][j][0] = 0;
-            _roadPath[i][j][1] = 1;
-            _roadPath[i][j][2] = 1;
-            _roadPath[i][j][3] = 1;
-            break;
-        }
-    // There is only a road coming from the left
-    } else if (!roadTop && roadRight) {
-        // There are three roads possible in this particular configuration
-        roadType = round((rand()/(double)RAND_MAX) * 2);
-        switch (roadType) {
-        case 0:
-            road->setRoadType(Road::curve);
-            nbRotations = 1;
-            _roadPath[i][j][0] = 1;
-            _roadPath[i][j][1] = 1;
-            _roadPath[i][j][2] = 0;
-            _roadPath[i][j][3] = 0;
-            break;
-        case 1:
-            road->setRoadType(Road::straight);
-            nbRotations = 1;
-            _roadPath[i][j][0] = 1;
-            _roadPath[i][j][1] = 0;
-            _roadPath[i][j][2] = 1;
-            _roadPath[i][j][3] = 0;
-            break;
-        case 2:
-            road->setRoadType(Road::intersection);
-            nbRotations = 3;
-            _roadPath[i][j][0] = 1;
-            _roadPath[i][j][1] = 1;
-            _roadPath[i][j][2] = 1;
-            _roadPath[i][j][3] = 0;
-            break;
-        }
-    // There is no road coming from the top nor the left
-    } else {
-        roadType = round((rand()/(double)RAND_MAX));
-        // There are two roads possible in this particular configuration
-        switch (roadType) {
-        case 0:
-            road->setRoadType(Road::curve);
-            nbRotations = 2;
-            _roadPath[i][j][0] = 0;
-            _roadPath[i][j][1] = 1;
-            _roadPath[i][j][2] = 1;
-            _roadPath[i][j][3] = 0;
-            break;
-        case 1:
-            road->setRoadType(Road::none);
-            _roadPath[i][j][0] = 0;
-            _roadPath[i][j][1] = 0;
-            _roadPath[i][j][2] = 0;
-            _roadPath[i][j][3] = 0;
-            break;
-        }
-    }
+    // Users can't open nor create pieces until the file is read
+    _openAction->setEnabled(false);
+    _paramsTabWidget->find(_paramsWidget->winId())->setEnabled(false);
 
-    // Create the road geode thanks to the brand new road
-    osg::ref_ptr<RoadNode> roadNode = new RoadNode(road);
+    // Read file in background
+    _importFileName = fileName;
+    _importWatcher->setFuture(QtConcurrent::run(readModel, fileName));
+}
 
-    // Create matrix transform
-    osg::ref_ptr<osg::MatrixTransform> matTrans = new osg::MatrixTransform;
-    // Add road geode
-    matTrans->addChild(roadNode);
-
-    // Add brick to the world
-    _world.addBrick(roadNode.get(), road.get());
-    // Translate the road
-    _world.translation(-32*floor(length/2)-16 + 32*i, -32*floor(width/2)+16 + 32*j, World::minHeight);
-    // Apply rotation
-    for (int k = 0; k < nbRotations; k++) {
-        _world.rotation(true);
+void MainWindow::importFinished(void) {
+    _openAction->setEnabled(true);
+    _paramsTabWidget->find(_paramsWidget->winId())->setEnabled(true);
+
+    // Check file has been read
+    if (!_importWatcher->result()) {
+        QMessageBox::critical(this, "Your file could not have been read", "An error occured while tempting to open "+_importFileName+" within MainWindow::importFinished.");
+        return;
     }
+
+    QString fileName = _importFileName;
+
+    // Create FromFile objects, model comes from the object cache
+    _currLego = LegoRegistry::createLego(LegoRegistry::fromFile);
+    _currLegoNode = LegoRegistry::createLegoNode(LegoRegistry::fromFile);
+    _currLegoNode->setLego(_currLego);
+    static_cast<FromFile*>(_currLego.get())->setFileName(fileName);
+    _currLegoNode->createGeode();
+
+    createLego();
+
+    // Force dialog to refresh and avoid segfault
+    int currDialogIndex = _shapeComboBox->currentIndex();
+    int nextDialogIndex = (currDialogIndex+1)%(_shapeComboBox->count());
+    _shapeComboBox->setCurrentIndex(nextDialogIndex);
+    _shapeComboBox->setCurrentIndex(currDialogIndex);
 }
 
 void MainWindow::generateRoad(void) {
-    // Call the road dialog to ask users the width and length of their road circuit
+    // Call the road dialog to ask users the width, length and seed of their road circuit
     GenerateRoadWindow* roadWindow = new GenerateRoadWindow(this);
 
     // If users entered OK button
@@ -1047,53 +662,86 @@ void MainWindow::generateRoad(void) {
         int width = roadWindow->getWidth();
         int length = roadWindow->getLength();
 
-        // 4 sides: left top right bottom; true = road, false = no road.
-        _roadPath.clear();
-        // Record four bool values, one for each road, in order
-        _roadPath = QVector<QVector<QVector<bool> > >(width, QVector<QVector<bool> >(length, QVector <bool>(4, false)));
-
-        // Bool values to know wheter there are roads coming from top and left road
-        bool roadTop;
-        bool roadLeft;
-
-        // Create road iteratively, from a corner
-        for (int i = 0; i < width; i++) {
-            for (int j = 0; j < length; j++) {
-                // First road, road may or may not come from top or left
-                if (i == 0 && j == 0) {
-                    roadTop = round((rand()/(double)RAND_MAX));
-                    roadLeft = round((rand()/(double)RAND_MAX));
-                // On left side, top road coming depends on previous road, road may or may not come from left
-                } else if (i == 0 && j != 0) {
-                    roadTop = _roadPath[i][j-1][1];
-                    roadLeft = round((rand()/(double)RAND_MAX));
-                // On top side, left road coming depends on left road previously created, road may or may not come from top
-                } else if (i != 0 && j == 0) {
-                    roadTop = round((rand()/(double)RAND_MAX));
-                    roadLeft = _roadPath[i-1][j][2];
-                // Wherever else, roads coming from top and left depend on previously added roads
-                } else {
-                    roadTop = _roadPath[i][j-1][1];
-                    roadLeft = _roadPath[i-1][j][2];
-                }
-                // Create a random road, according to roads coming or not from top and left
-                chooseRoad(i, j, width, length, roadTop, roadLeft);
-            }
+        // Same seed, same circuit
+        RoadGenerator generator(width, length, roadWindow->getSeed());
+        const QVector<RoadGenerator::Placement>& placements = generator.generate();
+
+        // Create every road, centered on the origin
+        World::PieceList pieces;
+        pieces.reserve(placements.size());
+        for (int k = 0; k < placements.size(); k++) {
+            const RoadGenerator::Placement& placement = placements.at(k);
+
+            osg::ref_ptr<Road> road = new Road(placement.roadType);
+            osg::ref_ptr<RoadNode> roadNode = new RoadNode(road.get());
+
+            // Rotate, then translate, like World::rotation and World::translation do
+            osg::Matrix matrix = osg::Matrix::rotate(-placement.nbRotations*M_PI/2, osg::Vec3(0, 0, 1))
+                * osg::Matrix::translate(Lego::length_unit*(-32*floor(length/2)-16 + 32*placement.i),
+                                         Lego::length_unit*(-32*floor(width/2)+16 + 32*placement.j),
+                                         Lego::height_unit*World::minHeight);
+
+            pieces << _world.createPiece(roadNode.get(), matrix);
         }
+
+        // Add them in one batch, and in one undo step with the traffic lanes
+        _undoStack->beginMacro("Generate road");
+        if (!pieces.isEmpty())
+            _undoStack->push(new AddPiecesCommand(&_world, pieces, "Generate road"));
+
+        // Vehicules drive on the new circuit, cell (0, 0) being the first placed road
+        _undoStack->push(new SetRoadsCommand(&_traffic, generator.getRoadGrid(osg::Vec3(Lego::length_unit*(-32*floor(length/2)-16),
+                                                                                       Lego::length_unit*(-32*floor(width/2)+16),
+                                                                                       Lego::height_unit*World::minHeight))));
+        _undoStack->endMacro();
     }
 
+    delete roadWindow;
+
+    // The file has changed
+    _saved = false;
+}
+
+void MainWindow::addGeneratedPieces(const QVector<CityGenerator::Piece>& generatedPieces, const QString& text) {
+    // Name pieces, then add them in one batch, and in one undo step
+    World::PieceList pieces;
+    pieces.reserve(generatedPieces.size());
+    for (int k = 0; k < generatedPieces.size(); k++)
+        pieces << _world.createPiece(generatedPieces.at(k).legoNode.get(), generatedPieces.at(k).matrix);
+
+    if (!pieces.isEmpty())
+        _undoStack->push(new AddPiecesCommand(&_world, pieces, text));
+
     // The file has changed
     _saved = false;
 }
 
 void MainWindow::generateHouse(void) {
-    // Load saved house
-    openFromFile("../LEGO_CREATOR/OSG/house.osg");
+    // Build a random house, from bricks, corners, windows, door and tiles
+    CityGenerator generator(1, 1, rand());
+    addGeneratedPieces(generator.generateHouse(12, 8), "Generate house");
 }
 
 void MainWindow::generateCity(void) {
-    // Load saved city
-    openFromFile("../LEGO_CREATOR/OSG/town.osg");
+    // Same dialog as roads: width and length are in blocks
+    GenerateRoadWindow* cityWindow = new GenerateRoadWindow(this);
+    cityWindow->setWindowTitle("Generate city");
+
+    if (cityWindow->exec() == QDialog::Accepted) {
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+
+        // Blocks are built in parallel
+        CityGenerator generator(cityWindow->getWidth(), cityWindow->getLength(), cityWindow->getSeed());
+        // Undoing the city also takes vehicules off its roads
+        _undoStack->beginMacro("Generate city");
+        addGeneratedPieces(generator.generate(), "Generate city");
+        _undoStack->push(new SetRoadsCommand(&_traffic, generator.getRoadGrid()));
+        _undoStack->endMacro();
+
+        QApplication::restoreOverrideCursor();
+    }
+
+    delete cityWindow;
 }
 
 void MainWindow::generateFormule1(void) {
@@ -1101,9 +749,34 @@ void MainWindow::generateFormule1(void) {
     openFromFile("../LEGO_CREATOR/OSG/formule1.osg");
 }
 
+void MainWindow::initTraffic(void) {
+    // Traffic is part of the scene, not of the construction: it is never saved
+    _world.getScene()->addChild(_traffic.getRoot());
+    _traffic.setNbVehicules(_settings.value("NbVehicules", 1000).toInt());
+}
+
+void MainWindow::switchTraffic(bool b) {
+    // Frames are drawn on demand, and go on by themselves while traffic is simulated
+    _traffic.switchTraffic(b);
+    _sceneViewer->requestFrame();
+}
+
+void MainWindow::chooseNbVehicules(void) {
+    bool ok;
+    int nbVehicules = QInputDialog::getInt(this, "Traffic", "Number of vehicules:", _traffic.getNbVehicules(), 0, 100000, 100, &ok);
+    if (!ok)
+        return;
+
+    _settings.setValue("NbVehicules", nbVehicules);
+    _traffic.setNbVehicules(nbVehicules);
+    _sceneViewer->requestFrame();
+}
+
 void MainWindow::eraseScene(void) {
     // remove everything from construction scene
     _world.eraseConstructionScene();
+    _traffic.clearRoads();
+    _sceneViewer->requestFrame();
 
     // There is no file associated anymore
     _settings.setValue("FileName", "");
@@ -1383,6 +1056,14 @@ void MainWindow::quitSoft(void) {
 }
 
 void MainWindow::openSettings(void) {
+    // Created when first opened
+    if (!_settingsDialog) {
+        _settingsDialog = new SettingsDialog;
+        connect(_settingsDialog, SIGNAL(gridSizeChanged()), this, SLOT(updateWorldGrid()));
+        connect(_settingsDialog, SIGNAL(viewerColorChanged(QColor)), this, SLOT(viewerColorUpdate(QColor)));
+        connect(_settingsDialog, SIGNAL(gridVisible(bool)), this, SLOT(setGridVisible(bool)));
+    }
+
     _settingsDialog->exec();
 }
 
@@ -1397,6 +1078,7 @@ void MainWindow::viewerColorUpdate(QColor color) {
 
     // Scene viewer
     _sceneViewer->getCamera()->setClearColor(osg::Vec4(r/255.0, g/255.0, b/255.0, 1.));
+    _sceneViewer->requestFrame();
 }
 
 void MainWindow::setGridVisible(bool b) {
@@ -1405,6 +1087,7 @@ void MainWindow::setGridVisible(bool b) {
     // And if grid visible is checked, we recreate it
     if (b)
         _world.createGuideLines();
+    _sceneViewer->requestFrame();
 }
 
 void MainWindow::freezeFit(void) {
@@ -1509,6 +1192,45 @@ void MainWindow::createEditMenu(void) {
     // Add separator
     editMenu->addSeparator();
 
+    // Add Delete selection action
+    _deleteSelectionAction = editMenu->addAction("&Delete selection");
+    _deleteSelectionAction->setShortcut(QKeySequence::Delete);
+    // Connect action
+    connect(_deleteSelectionAction, SIGNAL(triggered()), this, SLOT(deleteSelection()));
+
+    // Add Color selection action
+    _colorSelectionAction = editMenu->addAction("&Color selection...");
+    _colorSelectionAction->setShortcut(QKeySequence("CTRL+SHIFT+L"));
+    // Connect action
+    connect(_colorSelectionAction, SIGNAL(triggered()), this, SLOT(colorSelection()));
+
+    // Add Compile walls action
+    _compileWallsAction = editMenu->addAction("Compile &walls");
+    _compileWallsAction->setShortcut(QKeySequence("CTRL+ALT+W"));
+    // Connect action
+    connect(_compileWallsAction, SIGNAL(triggered()), this, SLOT(compileWalls()));
+
+    // Add Move selection submenu, one Lego unit per action
+    QMenu* moveMenu = editMenu->addMenu("&Move selection");
+    const char* moveNames[6] = { "Along -X", "Along +X", "Along -Y", "Along +Y", "Down", "Up" };
+    const char* moveShortcuts[6] = { "ALT+LEFT", "ALT+RIGHT", "ALT+DOWN", "ALT+UP", "ALT+PGDOWN", "ALT+PGUP" };
+    for (int k = 0; k < 6; k++) {
+        QAction* moveAction = moveMenu->addAction(moveNames[k]);
+        moveAction->setShortcut(QKeySequence(moveShortcuts[k]));
+        moveAction->setData(k);
+        // Connect action
+        connect(moveAction, SIGNAL(triggered()), this, SLOT(moveSelection()));
+    }
+
+    // Add separator
+    editMenu->addSeparator();
+
+    // Add Profiler action
+    QAction* profilerAction = _profilerDock->toggleViewAction();
+    profilerAction->setText("&Profiler");
+    profilerAction->setShortcut(QKeySequence("F12"));
+    editMenu->addAction(profilerAction);
+
     // Add Settings action
     _settingsAction = editMenu->addAction("&Settings...");
     //_settingsAction->setShortcut(QKeySequence::Preferences);
@@ -1546,6 +1268,23 @@ void MainWindow::createGenerateMenu(void) {
     connect(_generateFormule1Action, SIGNAL(triggered()), this, SLOT(generateFormule1()));
 }
 
+void MainWindow::createTrafficMenu(void) {
+    // Create Traffic menu
+    QMenu* trafficMenu = menuBar()->addMenu("&Traffic");
+
+    // Add Show traffic sub menu
+    _trafficAction = trafficMenu->addAction("&Show traffic");
+    _trafficAction->setShortcut(QKeySequence("CTRL+SHIFT+T"));
+    _trafficAction->setCheckable(true);
+    // Connect action
+    connect(_trafficAction, SIGNAL(toggled(bool)), this, SLOT(switchTraffic(bool)));
+
+    // Add Vehicules sub menu
+    _nbVehiculesAction = trafficMenu->addAction("&Vehicules...");
+    // Connect action
+    connect(_nbVehiculesAction, SIGNAL(triggered()), this, SLOT(chooseNbVehicules()));
+}
+
 void MainWindow::createHelpMenu(void) {
     // Create ? menu
     QMenu* helpMenu = menuBar()->addMenu("&?");
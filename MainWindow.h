@@ -2,13 +2,15 @@
 #define MAINWINDOW_H
 
 #include <QtGui>
+#include <QFutureWatcher>
 
 #include "ViewerWidget.h"
 #include "SettingsDialog.h"
 #include "LegoDialog.h"
 #include "World.h"
-
-//#include "Traffic.h"
+#include "PartBrowser.h"
+#include "CityGenerator.h"
+#include "Traffic.h"
 
 
 class MainWindow : public QMainWindow {
@@ -18,34 +20,36 @@ public:
     MainWindow(QWidget* parent = 0);
     virtual ~MainWindow();
 
-    void initFactories(void);
     void initPreview(void);
     void initDialogs(void);
+    LegoDialog* legoDialog(int dialogIndex);
 
     void setStyle(void);
 
     void createFileMenu(void);
     void createEditMenu(void);
     void createGenerateMenu(void);
-    //void createTrafficMenu(void);
+    void createTrafficMenu(void);
     void createHelpMenu(void);
     void createToolBar(void);
     void createUndoView(void);
     void createParamsDock(void);
+    void createProfilerDock(void);
     void createScene(void);
 
-    //void initTraffic(void);
+    void initTraffic(void);
     //void addSkyBox(void);
     //void removeTraffic(void);
     //void createLight(void);
     //void removeLight(void);
 
-    void chooseRoad(int i, int j, int width, int length, bool roadTop, bool roadRight);
-
-    void openFromFile(const QString& fileName);
+    osgViewer::ViewerBase::ThreadingModel renderThreadingModel(void) const;
+    void addGeneratedPieces(const QVector<CityGenerator::Piece>& generatedPieces, const QString& text);
     void writeFile(const QString& fileName);
 
 public slots:
+    void openFromFile(const QString& fileName);
+
     void browseColor(void);
     void chooseDialog(int dialogIndex);
     void legoUpdated(LegoNode* legoNode);
@@ -54,6 +58,11 @@ public slots:
     void fitLego(void);
     void deleteLego(void);
 
+    void deleteSelection(void);
+    void moveSelection(void);
+    void colorSelection(void);
+    void compileWalls(void);
+
     void translate(int);
     void rotateLeft(void);
     void rotateRight(void);
@@ -66,6 +75,7 @@ public slots:
     void eraseScene(void);
     void newFile(void);
     void openFile(void);
+    void importFinished(void);
     void saveFile(void);
     void saveAsFile(void);
     void quitSoft(void);
@@ -77,11 +87,14 @@ public slots:
 
     void checkExistence(QString fileName);
 
-    //void switchTraffic(bool b);
+    void switchTraffic(bool b);
+    void chooseNbVehicules(void);
 
     void freezeFit(void);
     void freezeCreate(void);
 
+    void startupFinished(void);
+
 private:
     ViewerWidget* _brickViewer;
     ViewerWidget* _sceneViewer;
@@ -89,7 +102,9 @@ private:
 
     QTabWidget* _paramsTabWidget;
     QWidget* _paramsWidget;
+    PartBrowser* _partBrowser;
     QDockWidget* _paramsDock;
+    QDockWidget* _profilerDock;
 
     QComboBox* _shapeComboBox;
     QPushButton* _colorButton;
@@ -112,12 +127,18 @@ private:
     QAction* _undoAction;
     QAction* _redoAction;
     QAction* _settingsAction;
+    QAction* _deleteSelectionAction;
+    QAction* _colorSelectionAction;
+    QAction* _compileWallsAction;
 
     QAction* _generateRoadAction;
     QAction* _generateHouseAction;
     QAction* _generateCityAction;
     QAction* _generateFormule1Action;
 
+    QAction* _trafficAction;
+    QAction* _nbVehiculesAction;
+
     QAction* _helpAction;
     QAction* _aboutAction;
 
@@ -129,10 +150,10 @@ private:
     osg::ref_ptr<Lego> _currLego;
 
     QVector<LegoDialog*> _legoDialog;
+    QVBoxLayout* _dialogsLayout;
 
     World _world;
-
-    QVector<QVector<QVector<bool> > > _roadPath;
+    Traffic _traffic;
 
     QSettings _settings;
     SettingsDialog* _settingsDialog;
@@ -141,12 +162,16 @@ private:
     bool _saved;
 
     QUndoStack* _undoStack;
+
+    QFutureWatcher<osg::Node*>* _importWatcher;
+    QString _importFileName;
     QUndoView* _undoView;
 
     QToolBar* _moveToolBar;
 
 signals:
     void fileAlreadyExists(bool);
+    void started(void);
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,185 @@
+#include "ModelCache.h"
+
+#include "Lego.h"
+#include "LDrawParser.h"
+#include "Profiler.h"
+
+#include <osg/MatrixTransform>
+#include <osg/LOD>
+#include <osg/Geode>
+#include <osgDB/ReadFile>
+#include <osgUtil/Optimizer>
+#include <osgUtil/Simplifier>
+#include <osgUtil/SmoothingVisitor>
+
+#include <QDebug>
+
+#include <cfloat>
+#include <cmath>
+
+// LDraw units: a stud is 20 LDU wide, a plate 8 LDU high
+#define LDRAW_UNIT (Lego::length_unit/20.0)
+
+namespace {
+    // Lighter levels: part of the vertices kept, and screen size in pixels under which they are drawn
+    const int NB_LOD_LEVELS = 2;
+    const float LOD_RATIOS[NB_LOD_LEVELS] = { 0.4f, 0.1f };
+    const float LOD_PIXELS[NB_LOD_LEVELS] = { 300.0f, 80.0f };
+
+    // Smaller models are drawn as they are
+    const unsigned int MIN_LOD_VERTICES = 2000;
+
+    class VertexCounter : public osg::NodeVisitor {
+    public:
+        VertexCounter(void) :
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN),
+            _nbVertices(0) {}
+
+        unsigned int getNbVertices(void) const { return _nbVertices; }
+
+        virtual void apply(osg::Geode& geode) {
+            for (unsigned int k = 0; k < geode.getNumDrawables(); k++) {
+                osg::Geometry* geometry = geode.getDrawable(k)->asGeometry();
+                if (geometry && geometry->getVertexArray())
+                    _nbVertices += geometry->getVertexArray()->getNumElements();
+            }
+        }
+
+    private:
+        unsigned int _nbVertices;
+    };
+
+    // Flat normals split vertices between faces: without them, faces share their vertices and edges can be collapsed
+    class NormalRemover : public osg::NodeVisitor {
+    public:
+        NormalRemover(void) :
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+        virtual void apply(osg::Geode& geode) {
+            for (unsigned int k = 0; k < geode.getNumDrawables(); k++) {
+                osg::Geometry* geometry = geode.getDrawable(k)->asGeometry();
+                if (geometry) {
+                    geometry->setNormalArray(NULL);
+                    geometry->setNormalBinding(osg::Geometry::BIND_OFF);
+                }
+            }
+        }
+    };
+
+    // Faces meeting at more than a crease angle keep their own normals
+    class NormalSmoother : public osg::NodeVisitor {
+    public:
+        NormalSmoother(void) :
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+        virtual void apply(osg::Geode& geode) {
+            for (unsigned int k = 0; k < geode.getNumDrawables(); k++) {
+                osg::Geometry* geometry = geode.getDrawable(k)->asGeometry();
+                if (geometry)
+                    osgUtil::SmoothingVisitor::smooth(*geometry, osg::PI/4);
+            }
+        }
+    };
+}
+
+QHash<QString, osg::ref_ptr<osg::Node> > ModelCache::_models;
+QMutex ModelCache::_mutex;
+
+osg::Node* ModelCache::get(const QString& fileName) {
+    PROFILE_SCOPE("ModelCache::get");
+
+    {
+        QMutexLocker locker(&_mutex);
+        QHash<QString, osg::ref_ptr<osg::Node> >::const_iterator it = _models.find(fileName);
+        if (it != _models.end())
+            return it.value().get();
+    }
+
+    // Read without the lock, so that a long background import doesn't block pieces created meanwhile
+    osg::ref_ptr<osg::Node> model = readModel(fileName);
+    if (!model)
+        return NULL;
+
+    // When two threads read the same file, the first model wins
+    QMutexLocker locker(&_mutex);
+    osg::ref_ptr<osg::Node>& cached = _models[fileName];
+    if (!cached)
+        cached = model;
+    return cached.get();
+}
+
+void ModelCache::clear(void) {
+    QMutexLocker locker(&_mutex);
+    _models.clear();
+}
+
+osg::Node* ModelCache::readModel(const QString& fileName) {
+    PROFILE_SCOPE("ModelCache::readModel");
+
+    osg::ref_ptr<osg::Node> model;
+    if (fileName.endsWith(".dat", Qt::CaseInsensitive)) {
+        // LDraw parts are Y down, in LDraw units
+        try {
+            LDrawParser parser(fileName);
+            osg::ref_ptr<osg::MatrixTransform> ldrawToLego = new osg::MatrixTransform;
+            ldrawToLego->setMatrix(osg::Matrix::rotate(-M_PI/2, osg::X_AXIS) * osg::Matrix::scale(LDRAW_UNIT, LDRAW_UNIT, LDRAW_UNIT));
+            ldrawToLego->addChild(parser.createNode());
+            model = ldrawToLego;
+        } catch (const LDrawParser::OpenFailed&) {
+            qDebug() << "Cannot parse" << fileName << "within ModelCache::readModel";
+        }
+    } else {
+        model = osgDB::readNodeFile(fileName.toStdString());
+    }
+
+    if (!model) {
+        qDebug() << "Cannot read" << fileName << "within ModelCache::readModel";
+        return NULL;
+    }
+
+    // Models are shared and never change: optimize them once for all pieces using them
+    osgUtil::Optimizer optimizer;
+    optimizer.optimize(model.get(), osgUtil::Optimizer::DEFAULT_OPTIMIZATIONS | osgUtil::Optimizer::INDEX_MESH | osgUtil::Optimizer::VERTEX_POSTTRANSFORM);
+    model->setDataVariance(osg::Object::STATIC);
+
+    return createLODs(model.release());
+}
+
+osg::Node* ModelCache::createLODs(osg::Node* model) {
+    PROFILE_SCOPE("ModelCache::createLODs");
+
+    osg::ref_ptr<osg::Node> fullModel = model;
+    VertexCounter counter;
+    fullModel->accept(counter);
+    if (counter.getNbVertices() < MIN_LOD_VERTICES)
+        return fullModel.release();
+
+    // Levels are chosen by their size on screen, whatever the scale of the model
+    osg::ref_ptr<osg::LOD> lod = new osg::LOD;
+    lod->setName("Model levels of detail");
+    lod->setRangeMode(osg::LOD::PIXEL_SIZE_ON_SCREEN);
+    lod->addChild(fullModel.get(), LOD_PIXELS[0], FLT_MAX);
+
+    for (int k = 0; k < NB_LOD_LEVELS; k++) {
+        // States and textures are shared with the full model
+        osg::ref_ptr<osg::Node> level = static_cast<osg::Node*>(fullModel->clone(osg::CopyOp::DEEP_COPY_NODES | osg::CopyOp::DEEP_COPY_DRAWABLES
+                                                                                 | osg::CopyOp::DEEP_COPY_ARRAYS | osg::CopyOp::DEEP_COPY_PRIMITIVES));
+
+        // Cheapest edges are collapsed first: edge lines are dropped, they are not seen that far
+        NormalRemover normalRemover;
+        level->accept(normalRemover);
+        osgUtil::Simplifier simplifier(LOD_RATIOS[k]);
+        simplifier.setSmoothing(false);
+        level->accept(simplifier);
+
+        // Normals again, brick edges kept sharp
+        NormalSmoother normalSmoother;
+        level->accept(normalSmoother);
+        level->setDataVariance(osg::Object::STATIC);
+
+        float minPixels = (k+1 < NB_LOD_LEVELS) ? LOD_PIXELS[k+1] : 0.0f;
+        lod->addChild(level.get(), minPixels, LOD_PIXELS[k]);
+    }
+
+    return lod.release();
+}
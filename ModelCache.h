@@ -0,0 +1,26 @@
+#ifndef MODELCACHE_H
+#define MODELCACHE_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+
+#include <osg/Node>
+#include <osg/ref_ptr>
+
+class ModelCache {
+
+public:
+    static osg::Node* get(const QString& fileName);
+    static void clear(void);
+
+private:
+    static osg::Node* readModel(const QString& fileName);
+    static osg::Node* createLODs(osg::Node* model);
+
+private:
+    static QHash<QString, osg::ref_ptr<osg::Node> > _models;
+    static QMutex _mutex;
+};
+
+#endif // MODELCACHE_H
@@ -0,0 +1,114 @@
+#include "PartBrowser.h"
+
+#include "LDrawParser.h"
+#include "Profiler.h"
+
+// Parts listed for a query, the list widget would be the bottleneck beyond
+#define MAX_RESULTS 200
+// Thumbnail size within the list
+#define ICON_SIZE 48
+// Thumbnails loaded per event loop iteration
+#define ICONS_PER_STEP 8
+
+PartBrowser::PartBrowser(QWidget* parent) :
+    QWidget(parent),
+    _catalogLoaded(false),
+    _nextIcon(0) {
+
+    // Search field, searching on every keystroke
+    _searchLineEdit = new QLineEdit(this);
+    connect(_searchLineEdit, SIGNAL(textChanged(QString)), this, SLOT(search(QString)));
+
+    // Matching parts
+    _partsList = new QListWidget(this);
+    _partsList->setIconSize(QSize(ICON_SIZE, ICON_SIZE));
+    _partsList->setUniformItemSizes(true);
+    connect(_partsList, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(choosePart(QListWidgetItem*)));
+
+    _countLabel = new QLabel(this);
+
+    // Main layout
+    QVBoxLayout* mainLayout = new QVBoxLayout;
+    mainLayout->addWidget(_searchLineEdit);
+    mainLayout->addWidget(_partsList);
+    mainLayout->addWidget(_countLabel);
+    setLayout(mainLayout);
+
+    connect(&_iconTimer, SIGNAL(timeout()), this, SLOT(loadIcons()));
+}
+
+void PartBrowser::showEvent(QShowEvent* event) {
+    // Catalog is only read the first time the browser is shown
+    if (!_catalogLoaded)
+        loadCatalog();
+
+    QWidget::showEvent(event);
+}
+
+void PartBrowser::loadCatalog(void) {
+    PROFILE_SCOPE("PartBrowser::loadCatalog");
+
+    _catalogLoaded = true;
+
+    QSettings settings(QSettings::UserScope, "Perso", "Lego Creator");
+    _thumbnailsPath = settings.value("ThumbnailsPath", "../LEGO_CREATOR/IMG/Parts/").toString();
+    QString indexFileName = settings.value("PartsIndex", "../LEGO_CREATOR/OSG/parts.index").toString();
+
+    // Index is written by LEGO_Indexer, parts are never scanned from here
+    if (!_catalog.load(indexFileName)) {
+        _countLabel->setText("No parts index, run LEGO_Indexer");
+        return;
+    }
+
+    _partSearch.build(_catalog);
+    search(_searchLineEdit->text());
+}
+
+void PartBrowser::search(const QString& query) {
+    PROFILE_SCOPE("PartBrowser::search");
+
+    QVector<int> indexes = _partSearch.search(query, MAX_RESULTS);
+
+    // Fill list, icons come later
+    _partsList->setUpdatesEnabled(false);
+    _partsList->clear();
+    for (int k = 0; k < indexes.size(); k++) {
+        const PartCatalog::Part& part = _catalog.at(indexes.at(k));
+        QListWidgetItem* item = new QListWidgetItem(part.description, _partsList);
+        item->setToolTip(part.name + "\n" + part.category);
+        item->setData(Qt::UserRole, part.name);
+    }
+    _partsList->setUpdatesEnabled(true);
+
+    _countLabel->setText(QString("%1 of %2 parts").arg(indexes.size()).arg(_catalog.size()));
+
+    _nextIcon = 0;
+    _iconTimer.start(0);
+}
+
+void PartBrowser::loadIcons(void) {
+    int last = qMin(_nextIcon+ICONS_PER_STEP, _partsList->count());
+    for (; _nextIcon < last; _nextIcon++) {
+        QListWidgetItem* item = _partsList->item(_nextIcon);
+        QString name = item->data(Qt::UserRole).toString();
+
+        // Scaled thumbnails are kept in the pixmap cache, shared by every search
+        QString key = "part:" + name;
+        QPixmap pixmap;
+        if (!QPixmapCache::find(key, &pixmap)) {
+            QString imageName = _thumbnailsPath + QFileInfo(name).completeBaseName() + ".png";
+            if (!pixmap.load(imageName))
+                continue;
+            pixmap = pixmap.scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+            QPixmapCache::insert(key, pixmap);
+        }
+        item->setIcon(QIcon(pixmap));
+    }
+
+    if (_nextIcon >= _partsList->count())
+        _iconTimer.stop();
+}
+
+void PartBrowser::choosePart(QListWidgetItem* item) {
+    emit partChosen(LDrawParser::getLDrawPath() + "parts/" + item->data(Qt::UserRole).toString());
+}
@@ -0,0 +1,46 @@
+#ifndef PARTBROWSER_H
+#define PARTBROWSER_H
+
+#include <QtGui>
+
+#include "PartCatalog.h"
+#include "PartSearch.h"
+
+class PartBrowser : public QWidget {
+    Q_OBJECT
+
+public:
+    PartBrowser(QWidget* parent = 0);
+
+signals:
+    void partChosen(const QString& fileName);
+
+public slots:
+    void search(const QString& query);
+
+protected:
+    virtual void showEvent(QShowEvent* event);
+
+private slots:
+    void loadIcons(void);
+    void choosePart(QListWidgetItem* item);
+
+private:
+    void loadCatalog(void);
+
+private:
+    PartCatalog _catalog;
+    PartSearch _partSearch;
+    bool _catalogLoaded;
+    QString _thumbnailsPath;
+
+    QLineEdit* _searchLineEdit;
+    QListWidget* _partsList;
+    QLabel* _countLabel;
+
+    // Thumbnails are loaded a few at a time, so that typing never waits for the disk
+    QTimer _iconTimer;
+    int _nextIcon;
+};
+
+#endif // PARTBROWSER_H
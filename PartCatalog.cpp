@@ -0,0 +1,177 @@
+#include "PartCatalog.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QTextStream>
+#include <QDataStream>
+#include <QStringList>
+#include <QtConcurrentMap>
+#include <QDebug>
+
+// Index file identification
+#define INDEX_MAGIC 0x4c434958
+#define INDEX_VERSION 2
+
+namespace {
+    // Parse one part header within a worker thread
+    PartCatalog::Part readPart(const QFileInfo& fileInfo) {
+        PartCatalog::Part part;
+        part.modified = fileInfo.lastModified().toTime_t();
+        if (!PartCatalog::readHeader(fileInfo.absoluteFilePath(), part))
+            part.name.clear();
+        return part;
+    }
+}
+
+PartCatalog::PartCatalog(void) {
+}
+
+bool PartCatalog::readHeader(const QString& fileName, Part& part) {
+    // Try to open text file in read only mode
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qDebug() << "Error while opening in read only " + fileName + " file within PartCatalog::readHeader";
+        return false;
+    }
+
+    // Stream text and encode in UTF-8
+    QTextStream inFile(&file);
+    inFile.setCodec("UTF-8");
+
+    // Name is kept as on disk, so that the part can be opened on case sensitive file systems
+    part.name = QFileInfo(fileName).fileName();
+    part.description.clear();
+    part.category.clear();
+    part.type.clear();
+
+    // Only header is read: it ends with the first line that is not a comment or a meta command
+    bool firstLine = true;
+    while (!inFile.atEnd()) {
+        QString currLine = inFile.readLine().trimmed();
+        if (currLine.isEmpty())
+            continue;
+        if (!currLine.startsWith('0'))
+            break;
+
+        // First line is the description
+        if (firstLine) {
+            part.description = currLine.mid(1).simplified();
+            firstLine = false;
+        } else if (currLine.contains("!LDRAW_ORG")) {
+            // Remove words after part type, i.e Part, Part Alias, Shortcut...
+            part.type = currLine.section("!LDRAW_ORG", 1).simplified();
+            if (part.type.contains("UPDATE"))
+                part.type = part.type.section("UPDATE", 0, 0).simplified();
+            if (part.type.contains("ORIGINAL"))
+                part.type = part.type.section("ORIGINAL", 0, 0).simplified();
+        } else if (currLine.contains("!CATEGORY")) {
+            part.category = currLine.section("!CATEGORY", 1).simplified();
+        }
+    }
+
+    // Parts without !CATEGORY belong to the first word of their description,
+    // and special parts (aliases, shortcuts...) to their type
+    if (!part.type.isEmpty() && part.type != "Part")
+        part.category = part.type;
+    else if (part.category.isEmpty())
+        part.category = part.description.section(' ', 0, 0);
+    if (part.category.startsWith('~') || part.category.startsWith('_'))
+        part.category = part.category.mid(1);
+    if (part.category.contains("Physical_Colour") || part.category.contains("Shortcut") || part.category.contains("Alias"))
+        part.category = "Alias";
+
+    return !part.description.isEmpty();
+}
+
+int PartCatalog::update(const QString& partsPath) {
+    QDir partsDir(partsPath);
+    QFileInfoList allFiles = partsDir.entryInfoList(QStringList() << "*.dat", QDir::Files);
+
+    // Keep unchanged parts, and list new or modified ones
+    QVector<Part> parts;
+    parts.reserve(allFiles.size());
+    QList<QFileInfo> changedFiles;
+    for (int k = 0; k < allFiles.size(); k++) {
+        int index = indexOf(allFiles.at(k).fileName());
+        if (index != -1 && _parts.at(index).modified == allFiles.at(k).lastModified().toTime_t())
+            parts << _parts.at(index);
+        else
+            changedFiles << allFiles.at(k);
+    }
+
+    int kept = parts.size();
+
+    // Read changed headers in parallel
+    QList<Part> changedParts = QtConcurrent::blockingMapped(changedFiles, readPart);
+    for (int k = 0; k < changedParts.size(); k++) {
+        if (!changedParts.at(k).name.isEmpty())
+            parts << changedParts.at(k);
+    }
+
+    // Deleted and modified parts leave the previous entries
+    int dropped = _parts.size() - kept;
+    _parts = parts;
+    reindex();
+
+    // Zero when the index is unchanged, and doesn't need to be saved again
+    return changedFiles.size() + dropped;
+}
+
+bool PartCatalog::load(const QString& indexFileName) {
+    QFile file(indexFileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Cannot open" << indexFileName << "within PartCatalog::load";
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_6);
+
+    // Check index format
+    quint32 magic, version, count;
+    in >> magic >> version >> count;
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION) {
+        qDebug() << indexFileName << "is not a parts index, or an old one, within PartCatalog::load";
+        return false;
+    }
+
+    _parts.clear();
+    _parts.reserve(count);
+    for (quint32 k = 0; k < count && in.status() == QDataStream::Ok; k++) {
+        Part part;
+        in >> part.name >> part.description >> part.category >> part.type >> part.modified;
+        _parts << part;
+    }
+    reindex();
+
+    return in.status() == QDataStream::Ok;
+}
+
+bool PartCatalog::save(const QString& indexFileName) const {
+    QFile file(indexFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Cannot open" << indexFileName << "within PartCatalog::save";
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_6);
+
+    // Single compact file: header, then every part
+    out << quint32(INDEX_MAGIC) << quint32(INDEX_VERSION) << quint32(_parts.size());
+    for (int k = 0; k < _parts.size(); k++) {
+        const Part& part = _parts.at(k);
+        out << part.name << part.description << part.category << part.type << part.modified;
+    }
+
+    return out.status() == QDataStream::Ok;
+}
+
+void PartCatalog::reindex(void) {
+    _partIndex.clear();
+    _partIndex.reserve(_parts.size());
+    for (int k = 0; k < _parts.size(); k++)
+        _partIndex.insert(_parts.at(k).name.toLower(), k);
+}
@@ -0,0 +1,43 @@
+#ifndef PARTCATALOG_H
+#define PARTCATALOG_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+class PartCatalog {
+
+public:
+    // Header information of one LDraw part
+    struct Part {
+        QString name;
+        QString description;
+        QString category;
+        QString type;
+        qint64 modified;
+    };
+
+public:
+    PartCatalog(void);
+
+    bool load(const QString& indexFileName);
+    bool save(const QString& indexFileName) const;
+    int update(const QString& partsPath);
+
+    int size(void) const { return _parts.size(); }
+    const Part& at(int k) const { return _parts.at(k); }
+    const QVector<Part>& getParts(void) const { return _parts; }
+    int indexOf(const QString& name) const { return _partIndex.value(name.toLower(), -1); }
+
+    static bool readHeader(const QString& fileName, Part& part);
+
+private:
+    void reindex(void);
+
+private:
+    QVector<Part> _parts;
+    // Parts by lower case name, LDraw file names being case insensitive
+    QHash<QString, int> _partIndex;
+};
+
+#endif // PARTCATALOG_H
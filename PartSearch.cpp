@@ -0,0 +1,169 @@
+#include "PartSearch.h"
+
+#include <QStringList>
+
+#include <algorithm>
+
+// Part of the query trigrams a word must share with a part, in percent
+#define FUZZY_RATIO 60
+
+// Ranking bonuses
+#define WORD_SCORE 10
+#define SUBSTRING_BONUS 20
+#define NAME_PREFIX_BONUS 30
+
+namespace {
+    struct Result {
+        int score;
+        int length;
+        int index;
+    };
+
+    // Best scores first, then shortest texts: "brick 2 x 4" before "brick 2 x 4 with holes"
+    bool resultLess(const Result& a, const Result& b) {
+        if (a.score != b.score)
+            return a.score > b.score;
+        if (a.length != b.length)
+            return a.length < b.length;
+        return a.index < b.index;
+    }
+}
+
+PartSearch::PartSearch(void) {
+}
+
+quint64 PartSearch::trigram(const QChar* chars) {
+    return (quint64(chars[0].unicode()) << 32) | (quint64(chars[1].unicode()) << 16) | quint64(chars[2].unicode());
+}
+
+void PartSearch::build(const PartCatalog& catalog) {
+    _texts.clear();
+    _names.clear();
+    _postings.clear();
+    _words.clear();
+
+    int nbParts = catalog.size();
+    _texts.reserve(nbParts);
+    _names.reserve(nbParts);
+    for (int k = 0; k < nbParts; k++) {
+        const PartCatalog::Part& part = catalog.at(k);
+        QString name = part.name.toLower();
+        QString text = (name + ' ' + part.description + ' ' + part.category).toLower();
+        _names << name;
+        _texts << text;
+
+        // Parts are indexed in order, so a posting list only has to check its last part
+        const QChar* chars = text.constData();
+        for (int i = 0; i+2 < text.size(); i++) {
+            QVector<int>& postings = _postings[trigram(chars+i)];
+            if (postings.isEmpty() || postings.last() != k)
+                postings << k;
+        }
+
+        QStringList words = text.split(' ', QString::SkipEmptyParts);
+        for (int i = 0; i < words.size(); i++)
+            _words << qMakePair(words.at(i), k);
+    }
+
+    std::sort(_words.begin(), _words.end());
+
+    _wordHits.fill(0, nbParts);
+    _matchedWords.fill(0, nbParts);
+    _scores.fill(0, nbParts);
+}
+
+QVector<int> PartSearch::search(const QString& query, int maxResults) const {
+    QVector<int> indexes;
+
+    QStringList words = query.toLower().split(' ', QString::SkipEmptyParts);
+
+    // Nothing typed: the catalog as it is
+    if (words.isEmpty()) {
+        for (int k = 0; k < qMin(maxResults, _texts.size()); k++)
+            indexes << k;
+        return indexes;
+    }
+
+    // Every word must match, each one fuzzily: parts are kept once they share enough trigrams with it
+    QVector<int> candidates;
+    QVector<int> touched;
+    for (int w = 0; w < words.size(); w++) {
+        const QString& word = words.at(w);
+        touched.clear();
+
+        int threshold = 1;
+        if (word.size() < 3) {
+            // Too short for trigrams: match word prefixes
+            QVector<QPair<QString, int> >::const_iterator it = std::lower_bound(_words.begin(), _words.end(), qMakePair(word, -1));
+            for (; it != _words.end() && it->first.startsWith(word); ++it) {
+                if (_wordHits[it->second]++ == 0)
+                    touched << it->second;
+            }
+        } else {
+            // Count distinct query trigrams found within each part
+            int nbTrigrams = word.size()-2;
+            threshold = qMax(1, (nbTrigrams*FUZZY_RATIO + 99)/100);
+            QVector<quint64> trigrams;
+            for (int i = 0; i < nbTrigrams; i++) {
+                quint64 key = trigram(word.constData()+i);
+                if (!trigrams.contains(key))
+                    trigrams << key;
+            }
+            threshold = qMin(threshold, trigrams.size());
+
+            for (int i = 0; i < trigrams.size(); i++) {
+                QHash<quint64, QVector<int> >::const_iterator postings = _postings.find(trigrams.at(i));
+                if (postings == _postings.end())
+                    continue;
+                const QVector<int>& parts = postings.value();
+                for (int p = 0; p < parts.size(); p++) {
+                    if (_wordHits[parts.at(p)]++ == 0)
+                        touched << parts.at(p);
+                }
+            }
+        }
+
+        // Keep parts which matched every previous word and this one
+        for (int i = 0; i < touched.size(); i++) {
+            int k = touched.at(i);
+            if (_wordHits.at(k) >= threshold && _matchedWords.at(k) == w) {
+                if (w == 0)
+                    candidates << k;
+                _matchedWords[k] = w+1;
+                _scores[k] += WORD_SCORE*_wordHits.at(k)/threshold;
+            }
+            _wordHits[k] = 0;
+        }
+    }
+
+    // Rank candidates, exact substrings and part numbers first
+    QString simplified = words.join(" ");
+    QVector<Result> results;
+    for (int i = 0; i < candidates.size(); i++) {
+        int k = candidates.at(i);
+        if (_matchedWords.at(k) == words.size()) {
+            Result result;
+            result.score = _scores.at(k);
+            if (_texts.at(k).contains(simplified))
+                result.score += SUBSTRING_BONUS;
+            if (_names.at(k).startsWith(words.first()))
+                result.score += NAME_PREFIX_BONUS;
+            result.length = _texts.at(k).size();
+            result.index = k;
+            results << result;
+        }
+
+        // Leave scratch counters clean for next search
+        _matchedWords[k] = 0;
+        _scores[k] = 0;
+    }
+
+    int nbResults = qMin(maxResults, results.size());
+    std::partial_sort(results.begin(), results.begin()+nbResults, results.end(), resultLess);
+
+    indexes.reserve(nbResults);
+    for (int k = 0; k < nbResults; k++)
+        indexes << results.at(k).index;
+
+    return indexes;
+}
@@ -0,0 +1,40 @@
+#ifndef PARTSEARCH_H
+#define PARTSEARCH_H
+
+#include <QString>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+
+#include "PartCatalog.h"
+
+class PartSearch {
+
+public:
+    PartSearch(void);
+
+    void build(const PartCatalog& catalog);
+    QVector<int> search(const QString& query, int maxResults) const;
+
+    int size(void) const { return _texts.size(); }
+
+private:
+    static quint64 trigram(const QChar* chars);
+
+private:
+    // Lower case searchable text and name of every catalog part
+    QVector<QString> _texts;
+    QVector<QString> _names;
+
+    // Parts containing each trigram, sorted and without duplicates
+    QHash<quint64, QVector<int> > _postings;
+    // Sorted words, for queries too short to have trigrams
+    QVector<QPair<QString, int> > _words;
+
+    // Per part scratch counters, kept between searches so that a keystroke allocates nothing
+    mutable QVector<int> _wordHits;
+    mutable QVector<int> _matchedWords;
+    mutable QVector<int> _scores;
+};
+
+#endif // PARTSEARCH_H
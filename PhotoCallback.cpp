@@ -1,21 +1,105 @@
 #include "PhotoCallback.h"
 
+#include "ImageWriter.h"
+
+#include <cstring>
+
+PhotoCallback::PhotoCallback(osg::Image* img, const std::string& fileName, osgText::Text* text) :
+    _image(img),
+    _text(text),
+    _fileName(fileName),
+    _currReadback(0) {
+
+    for (int k = 0; k < 2; k++) {
+        _readbacks[k].pbo = 0;
+        _readbacks[k].size = 0;
+        _readbacks[k].pending = false;
+    }
+}
+
 void PhotoCallback::operator() (osg::RenderInfo& renderInfo) const {
     bool capturing = false;
+    if (_image.valid())
+        _image->getUserValue("Capture", capturing);
 
-    if (_image.valid() && _image->getUserValue("Capture", capturing)) {
-        osg::GraphicsContext* gc = renderInfo.getState()->getGraphicsContext();
-        if (capturing && gc->getTraits()) {
-            int width = gc->getTraits()->width;
-            int height = gc->getTraits()->height;
-
-            GLenum pixelFormat = (gc->getTraits()->alpha ? GL_RGBA : GL_RGB);
-            _image->readPixels( 0, 0, width, height, pixelFormat, GL_UNSIGNED_BYTE );
-            std::stringstream ss;
-            ss << "/home/shaolan/Images/LEGO/Parts/" << _fileName << ".bmp";
-            if (osgDB::writeImageFile(*_image, ss.str()) && _text.valid())
-                _text->setText(std::string("Saved to ") + ss.str());
+    osg::GraphicsContext* gc = renderInfo.getState()->getGraphicsContext();
+    osg::GLBufferObject::Extensions* ext = osg::GLBufferObject::getExtensions(renderInfo.getContextID(), true);
+
+    // PBO filled during this frame, if any
+    unsigned int started = 2;
+
+    if (capturing && gc->getTraits()) {
+        int width = gc->getTraits()->width;
+        int height = gc->getTraits()->height;
+        GLenum pixelFormat = (gc->getTraits()->alpha ? GL_RGBA : GL_RGB);
+
+        if (ext && ext->isPBOSupported()) {
+            // Ask GPU to copy pixels within a PBO, without waiting for them
+            started = _currReadback;
+            startReadback(ext, _readbacks[started], width, height, pixelFormat);
+            _currReadback = (_currReadback+1)%2;
+        } else {
+            // No PBO: synchronous read, but file is still written in background
+            osg::ref_ptr<osg::Image> image = new osg::Image;
+            image->readPixels(0, 0, width, height, pixelFormat, GL_UNSIGNED_BYTE);
+            ImageWriter::instance()->write(image.get(), _fileName, _options.get());
         }
+
+        if (_text.valid())
+            _text->setText(std::string("Saving to ") + _fileName);
         _image->setUserValue("Capture", false);
     }
+
+    // PBOs filled during previous frames: GPU is done with them, mapping won't stall
+    for (unsigned int k = 0; k < 2; k++) {
+        if (k != started && _readbacks[k].pending)
+            finishReadback(ext, _readbacks[k]);
+    }
+}
+
+void PhotoCallback::startReadback(osg::GLBufferObject::Extensions* ext, Readback& readback, int width, int height, GLenum pixelFormat) const {
+    // Two captures in a row on the same PBO: previous one has to be mapped first
+    if (readback.pending)
+        finishReadback(ext, readback);
+
+    unsigned int size = width*height*((pixelFormat == GL_RGBA) ? 4 : 3);
+
+    // Create PBO on first use, and resize it if needed.
+    // NB: PBOs live as long as the context, callbacks don't get a chance to release them
+    if (!readback.pbo)
+        ext->glGenBuffers(1, &readback.pbo);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, readback.pbo);
+    if (readback.size != size) {
+        ext->glBufferData(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, GL_STREAM_READ_ARB);
+        readback.size = size;
+    }
+
+    // Asynchronous read, rows are tightly packed
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, pixelFormat, GL_UNSIGNED_BYTE, 0);
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    readback.width = width;
+    readback.height = height;
+    readback.pixelFormat = pixelFormat;
+    readback.fileName = _fileName;
+    readback.pending = true;
+}
+
+void PhotoCallback::finishReadback(osg::GLBufferObject::Extensions* ext, Readback& readback) const {
+    readback.pending = false;
+
+    // Map PBO and copy pixels within an image owned by the writer
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, readback.pbo);
+    GLubyte* pixels = static_cast<GLubyte*>(ext->glMapBuffer(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB));
+    if (pixels) {
+        osg::ref_ptr<osg::Image> image = new osg::Image;
+        image->allocateImage(readback.width, readback.height, 1, readback.pixelFormat, GL_UNSIGNED_BYTE, 1);
+        memcpy(image->data(), pixels, readback.size);
+        ext->glUnmapBuffer(GL_PIXEL_PACK_BUFFER_ARB);
+
+        // Encoding and disk access happen within writer thread
+        ImageWriter::instance()->write(image.get(), readback.fileName, _options.get());
+    }
+    ext->glBindBuffer(GL_PIXEL_PACK_BUFFER_ARB, 0);
 }
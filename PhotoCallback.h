@@ -3,6 +3,7 @@
 
 #include <osg/ValueObject>
 #include <osg/Camera>
+#include <osg/BufferObject>
 #include <osgDB/ReadFile>
 #include <osgDB/WriteFile>
 #include <osgViewer/Viewer>
@@ -13,16 +14,38 @@
 class PhotoCallback : public osg::Camera::DrawCallback {
 
 public:
-    PhotoCallback(osg::Image* img, const std::string& fileName, osgText::Text* text = NULL) : _image(img), _text(text), _fileName(fileName) {}
+    PhotoCallback(osg::Image* img, const std::string& fileName, osgText::Text* text = NULL);
     virtual void operator() (osg::RenderInfo& renderInfo) const;
 
+    // Complete image path, whose extension gives the image format
     void setFileName(const std::string fileName) { _fileName = fileName; }
+    void setOptions(osgDB::Options* options) { _options = options; }
+
+protected:
+    // A capture waiting within a pixel buffer object, until next frame maps it
+    struct Readback {
+        GLuint pbo;
+        unsigned int size;
+        bool pending;
+        int width;
+        int height;
+        GLenum pixelFormat;
+        std::string fileName;
+    };
+
+    void startReadback(osg::GLBufferObject::Extensions* ext, Readback& readback, int width, int height, GLenum pixelFormat) const;
+    void finishReadback(osg::GLBufferObject::Extensions* ext, Readback& readback) const;
 
 protected:
     osg::ref_ptr<osg::Image> _image;
     osg::observer_ptr<osgText::Text> _text;
     //mutable int _fileIndex;
     std::string _fileName;
+    osg::ref_ptr<osgDB::Options> _options;
+
+    // Double buffered readback: one PBO is filled while the other one is mapped
+    mutable Readback _readbacks[2];
+    mutable unsigned int _currReadback;
 };
 
 
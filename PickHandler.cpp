@@ -2,11 +2,30 @@
 
 #include "LegoNode.h"
 #include "BrickNode.h"
+#include "World.h"
+#include "Profiler.h"
 
 #include <QDebug>
 
-// Enable to pseudo hide the selection box when nothing is selected
-#define RATIO 10.0f
+#include <osg/Camera>
+
+#include <algorithm>
+#include <cmath>
+
+// Under this mouse move, in pixels, a rubber band is a simple click
+#define RUBBER_BAND_MIN 4.0
+
+PickHandler::PickHandler(void) :
+    osgGA::GUIEventHandler(),
+    _world(NULL),
+    _boxPickingOnly(false),
+    _selectionRevision(-1),
+    _rubberBand(false),
+    _pushX(0.0),
+    _pushY(0.0),
+    _pushXNormalized(0.0),
+    _pushYNormalized(0.0) {
+}
 
 osg::Node* PickHandler::getOrCreateSelectionBox(void) {
     // If selection box doesn't exist, we create it
@@ -15,13 +34,52 @@ osg::Node* PickHandler::getOrCreateSelectionBox(void) {
         _selectionBox = new osg::MatrixTransform;
         _selectionBox->setNodeMask(0x1);
 
-        // Create box geode and asign it to _selectionBox
+        // Every selected box is drawn within a single lines geometry
+        _selectionLines = new osg::Geometry;
+        _selectionLines->setUseDisplayList(false);
+        _selectionLines->setUseVertexBufferObjects(true);
+        // Rebuilt in place while the draw thread may still render previous frame
+        _selectionLines->setDataVariance(osg::Object::DYNAMIC);
+        osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
+        colors->push_back(osg::Vec4(1.0f, 1.0f, 1.0f, 1.0f));
+        _selectionLines->setColorArray(colors.get());
+        _selectionLines->setColorBinding(osg::Geometry::BIND_OVERALL);
+
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+        geode->addDrawable(_selectionLines.get());
+        _selectionBox->addChild(geode.get());
+
+        // Rubber band is drawn over the scene, in normalized window coordinates
+        _rubberBandLines = new osg::Geometry;
+        _rubberBandLines->setUseDisplayList(false);
+        // Moved in place while the draw thread may still render previous frame
+        _rubberBandLines->setDataVariance(osg::Object::DYNAMIC);
+        _rubberBandLines->setVertexArray(new osg::Vec3Array(4));
+        _rubberBandLines->setColorArray(colors.get());
+        _rubberBandLines->setColorBinding(osg::Geometry::BIND_OVERALL);
+        _rubberBandLines->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::LINE_LOOP, 0, 4));
+
+        osg::ref_ptr<osg::Geode> rubberBandGeode = new osg::Geode;
+        rubberBandGeode->addDrawable(_rubberBandLines.get());
+
+        _rubberBandCamera = new osg::Camera;
+        _rubberBandCamera->setReferenceFrame(osg::Transform::ABSOLUTE_RF);
+        _rubberBandCamera->setProjectionMatrixAsOrtho2D(-1.0, 1.0, -1.0, 1.0);
+        _rubberBandCamera->setViewMatrix(osg::Matrix::identity());
+        _rubberBandCamera->setRenderOrder(osg::Camera::POST_RENDER);
+        _rubberBandCamera->setClearMask(0);
+        _rubberBandCamera->setAllowEventFocus(false);
+        _rubberBandCamera->getOrCreateStateSet()->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
+        _rubberBandCamera->addChild(rubberBandGeode.get());
+        _selectionBox->addChild(_rubberBandCamera.get());
+        hideRubberBand();
+
+        // Create empty selection
         initSelectionBox();
 
         // Give a nice rendering
         osg::StateSet* ss = _selectionBox->getOrCreateStateSet();
         ss->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
-        ss->setAttributeAndModes(new osg::PolygonMode(osg::PolygonMode::FRONT_AND_BACK, osg::PolygonMode::LINE));
     }
 
     // Return selection box
@@ -29,88 +87,215 @@ osg::Node* PickHandler::getOrCreateSelectionBox(void) {
 }
 
 bool PickHandler::handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa) {
-    // To select something, users have to press CTRL and release left mouse button
-    if (ea.getEventType() != osgGA::GUIEventAdapter::RELEASE
-    ||  ea.getButton()    != osgGA::GUIEventAdapter::LEFT_MOUSE_BUTTON
-    || !(ea.getModKeyMask()& osgGA::GUIEventAdapter::MODKEY_CTRL))
+    switch (ea.getEventType()) {
+    // Selection may have changed from elsewhere (undo/redo, deletion...)
+    case osgGA::GUIEventAdapter::FRAME:
+        if (_world && _selectionBox && _world->getSelectionRevision() != _selectionRevision)
+            updateSelectionBoxes();
         return false;
 
-    // Dynamic cast aa into viewer*
-    osgViewer::View* viewer = dynamic_cast<osgViewer::View*>(&aa);
+    // To select something, users have to press CTRL and left mouse button
+    case osgGA::GUIEventAdapter::PUSH:
+        if (ea.getButton() != osgGA::GUIEventAdapter::LEFT_MOUSE_BUTTON
+        || !(ea.getModKeyMask()& osgGA::GUIEventAdapter::MODKEY_CTRL))
+            return false;
 
-    qDebug() << "Clicking in viewer:" << viewer << "and using scene:" << viewer->getSceneData();
+        // Record first rubber band corner
+        _rubberBand = true;
+        _pushX = ea.getX();
+        _pushY = ea.getY();
+        _pushXNormalized = ea.getXnormalized();
+        _pushYNormalized = ea.getYnormalized();
 
-    // If dynamic cast worked
-    if (viewer) {
-        // Create intersector line according to mouse coordinates and window matrix
-        osg::ref_ptr<osgUtil::LineSegmentIntersector> intersector = new osgUtil::LineSegmentIntersector(osgUtil::Intersector::WINDOW, ea.getX(), ea.getY());
+        // Camera manipulator must not rotate while the rubber band is drawn
+        return true;
 
-        // Create intersection visitor according to previous intersector line
-        osgUtil::IntersectionVisitor iv(intersector.get());
+    case osgGA::GUIEventAdapter::DRAG:
+        if (_rubberBand)
+            updateRubberBand(ea.getXnormalized(), ea.getYnormalized());
+        return _rubberBand;
 
-        // Set traversal mask
-        iv.setTraversalMask(~0x1);
+    // Selection happens when left mouse button is released
+    case osgGA::GUIEventAdapter::RELEASE:
+        if (!_rubberBand || ea.getButton() != osgGA::GUIEventAdapter::LEFT_MOUSE_BUTTON)
+            return false;
+        _rubberBand = false;
+        hideRubberBand();
+        break;
 
-        // Assign intersector visitor to camera
-        viewer->getCamera()->accept(iv);
+    default:
+        return false;
+    }
 
-        // If there is at least one inttersection
-        if (intersector->containsIntersections()) {
-            // Get nearest result
-            osgUtil::LineSegmentIntersector::Intersection result = *(intersector->getIntersections().begin());
-
-            // Get result bounding box
-            osg::BoundingBox bb = result.drawable->getParent(0)->asGeode()->getBoundingBox();
-
-            // Get bounding box coordinates in world
-            osg::Vec3 worldCenter = bb.center() * osg::computeLocalToWorld(result.nodePath);
-
-            // Set _selectionBox according to previous bounding box
-            _selectionBox->setMatrix(osg::Matrix::scale(RATIO*(bb.xMax() - bb.xMin()), RATIO*(bb.yMax() - bb.yMin()), RATIO*(bb.zMax() - bb.zMin())) * osg::Matrix::translate(worldCenter));
-
-            LegoNode* legoNode = dynamic_cast<LegoNode*>(result.drawable->getParent(0)->getParent(0));
-            if (legoNode) {
-//                if (dynamic_cast<BrickNode*>(legoNode))
-//                    legoNode->getLego()->setColor(QColor(Qt::white));
-//                else
-//                    legoNode->getLego()->setColor(QColor(Qt::blue));
-
-                qDebug() << "Selected piece adress:" << legoNode;
-                legoNode->createGeode();
-
-//                osg::MatrixTransform* mt = dynamic_cast<osg::MatrixTransform*>(legoNode->getParent(0));
-//                if (mt) {
-//                    for (int i = 0; i < 4; i++) {
-//                        for (int j = 0; j < 3; j++) {
-//                            osg::Matrix mat = mt->getMatrix();
-//                            qDebug() << mat(i, j);
-//                        }
-//                    }
-//                    _selectionBox->postMult(mt->getMatrix());
-//                }
-
-//                qDebug() << QString::fromStdString(mt->getParent(0)->getName());
-
-            } else {
-                qDebug() << "Not a lego node";
-                initSelectionBox();
+    // Dynamic cast aa into viewer*
+    osgViewer::View* viewer = dynamic_cast<osgViewer::View*>(&aa);
+
+    // If dynamic cast worked
+    if (viewer && _world) {
+        // A simple click picks one piece, a rubber band every piece within
+        if (fabs(ea.getX() - _pushX) < RUBBER_BAND_MIN && fabs(ea.getY() - _pushY) < RUBBER_BAND_MIN) {
+            QVector<osg::MatrixTransform*> selection;
+            osg::MatrixTransform* piece = pickPiece(viewer, ea.getX(), ea.getY());
+
+            if (piece) {
+                LegoNode* legoNode = dynamic_cast<LegoNode*>(piece->getChild(0));
+                if (legoNode) {
+                    qDebug() << "Selected piece adress:" << legoNode;
+                    selection << piece;
+                } else {
+                    qDebug() << "Not a lego node";
+                }
             }
+
+            _world->setSelection(selection);
+        } else {
+            pickRectangle(viewer,
+                          std::min(_pushXNormalized, static_cast<double>(ea.getXnormalized())),
+                          std::min(_pushYNormalized, static_cast<double>(ea.getYnormalized())),
+                          std::max(_pushXNormalized, static_cast<double>(ea.getXnormalized())),
+                          std::max(_pushYNormalized, static_cast<double>(ea.getYnormalized())));
         }
+
+        updateSelectionBoxes();
     } else {
-        qDebug() << "Cannot cast to osgViewer::View* within PickHandler::handle.";
+        qDebug() << "Cannot cast to osgViewer::View* or no world attached within PickHandler::handle.";
     }
 
     // Return false anyway, to avoid callback issues
     return false;
 }
- void PickHandler::initSelectionBox(void) {
-     // Remove box geode child
-     _selectionBox->removeChildren(0, _selectionBox->getNumChildren());
 
-     // Create init box geode
-     osg::ref_ptr<osg::Geode> geode = new osg::Geode;
-     geode->addDrawable(new osg::ShapeDrawable(new osg::Box(osg::Vec3(), 1.0f/RATIO)));
+osg::MatrixTransform* PickHandler::pickPiece(osgViewer::View* viewer, double x, double y) {
+    PROFILE_SCOPE("PickHandler::pickPiece");
+
+    osg::Camera* camera = viewer->getCamera();
 
-     // Add box geode
-     _selectionBox->addChild(geode);
- }
+    // Create ray from near plane to far plane under the mouse, in world coordinates
+    osg::Matrix windowMatrix = camera->getViewMatrix() * camera->getProjectionMatrix() * camera->getViewport()->computeWindowMatrix();
+    osg::Matrix inverseWindowMatrix = osg::Matrix::inverse(windowMatrix);
+    osg::Vec3 start = osg::Vec3(x, y, 0.0f) * inverseWindowMatrix;
+    osg::Vec3 end = osg::Vec3(x, y, 1.0f) * inverseWindowMatrix;
+
+    // Get pieces whose box is crossed by the ray, nearest first, thanks to world BVH
+    QVector<SpatialIndex::Hit> candidates;
+    _world->getSpatialIndex()->intersect(start, end, candidates);
+
+    // Nearest piece found so far
+    osg::MatrixTransform* picked = NULL;
+    double pickedRatio = 2.0;
+
+    for (int k = 0; k < candidates.size(); k++) {
+        const SpatialIndex::Hit& candidate = candidates.at(k);
+
+        // Next boxes begin behind the nearest triangle found, no need to go further
+        if (candidate.ratio > pickedRatio)
+            break;
+
+        // At box granularity, the nearest box is the picked piece
+        if (_boxPickingOnly) {
+            picked = candidate.matrixTransform;
+            break;
+        }
+
+        // Otherwise, triangles are only tested within candidate piece
+        osg::ref_ptr<osgUtil::LineSegmentIntersector> intersector = new osgUtil::LineSegmentIntersector(start, end);
+        osgUtil::IntersectionVisitor iv(intersector.get());
+        iv.setTraversalMask(~0x1);
+        candidate.matrixTransform->accept(iv);
+
+        // Keep it if nearer
+        if (intersector->containsIntersections()) {
+            double ratio = intersector->getIntersections().begin()->ratio;
+            if (ratio < pickedRatio) {
+                pickedRatio = ratio;
+                picked = candidate.matrixTransform;
+            }
+        }
+    }
+
+    return picked;
+}
+
+
+void PickHandler::pickRectangle(osgViewer::View* viewer, double xMin, double yMin, double xMax, double yMax) {
+    PROFILE_SCOPE("PickHandler::pickRectangle");
+
+    osg::Camera* camera = viewer->getCamera();
+
+    // Sub-frustum of the rubber band, in clip coordinates: xMin*w <= x <= xMax*w, and so on
+    osg::Polytope polytope;
+    polytope.add(osg::Plane( 1.0,  0.0,  0.0, -xMin));
+    polytope.add(osg::Plane(-1.0,  0.0,  0.0,  xMax));
+    polytope.add(osg::Plane( 0.0,  1.0,  0.0, -yMin));
+    polytope.add(osg::Plane( 0.0, -1.0,  0.0,  yMax));
+    polytope.add(osg::Plane( 0.0,  0.0,  1.0,  1.0));
+    polytope.add(osg::Plane( 0.0,  0.0, -1.0,  1.0));
+
+    // Bring it back to world coordinates
+    polytope.transformProvidingInverse(camera->getViewMatrix() * camera->getProjectionMatrix());
+
+    // Only piece boxes are tested, thanks to world BVH
+    QVector<osg::MatrixTransform*> selection;
+    _world->getSpatialIndex()->select(polytope, selection);
+
+    _world->setSelection(selection);
+}
+
+void PickHandler::updateSelectionBoxes(void) {
+    // Selection boxes are created with the world viewer scene only
+    if (!_selectionLines)
+        return;
+
+    const World::PieceList& selection = _world->getSelection();
+
+    // 12 edges per box, given by corner indexes (bit 0: x, bit 1: y, bit 2: z)
+    static const unsigned int edges[24] = { 0, 1, 2, 3, 4, 5, 6, 7,
+                                            0, 2, 1, 3, 4, 6, 5, 7,
+                                            0, 4, 1, 5, 2, 6, 3, 7 };
+
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+    vertices->reserve(24*selection.size());
+    for (int k = 0; k < selection.size(); k++) {
+        osg::BoundingBox box = _world->getSpatialIndex()->getBoundingBox(selection.at(k).get());
+        if (!box.valid())
+            continue;
+        for (unsigned int i = 0; i < 24; i++)
+            vertices->push_back(box.corner(edges[i]));
+    }
+
+    // Replace previous lines
+    _selectionLines->setVertexArray(vertices.get());
+    _selectionLines->removePrimitiveSet(0, _selectionLines->getNumPrimitiveSets());
+    _selectionLines->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::LINES, 0, vertices->size()));
+    _selectionLines->dirtyBound();
+
+    _selectionRevision = _world->getSelectionRevision();
+}
+
+void PickHandler::updateRubberBand(double xNormalized, double yNormalized) {
+    // Selection box, and so rubber band, are created with the world viewer scene only
+    if (!_rubberBandLines)
+        return;
+
+    osg::Vec3Array* vertices = static_cast<osg::Vec3Array*>(_rubberBandLines->getVertexArray());
+    (*vertices)[0].set(_pushXNormalized, _pushYNormalized, 0.0f);
+    (*vertices)[1].set(xNormalized, _pushYNormalized, 0.0f);
+    (*vertices)[2].set(xNormalized, yNormalized, 0.0f);
+    (*vertices)[3].set(_pushXNormalized, yNormalized, 0.0f);
+    vertices->dirty();
+    _rubberBandLines->dirtyBound();
+
+    _rubberBandCamera->setNodeMask(0x1);
+}
+
+void PickHandler::hideRubberBand(void) {
+    if (_rubberBandCamera)
+        _rubberBandCamera->setNodeMask(0);
+}
+
+void PickHandler::initSelectionBox(void) {
+    // No box drawn
+    _selectionLines->setVertexArray(new osg::Vec3Array);
+    _selectionLines->removePrimitiveSet(0, _selectionLines->getNumPrimitiveSets());
+    _selectionRevision = -1;
+}
@@ -2,22 +2,50 @@
 #define PICKHANDLER_H
 
 #include <osg/MatrixTransform>
-#include <osg/ShapeDrawable>
-#include <osg/PolygonMode>
+#include <osg/Geometry>
+#include <osg/Polytope>
 #include <osgDB/ReadFile>
 #include <osgUtil/LineSegmentIntersector>
 #include "ViewerWidget.h"
 
+class World;
+
 
 class PickHandler : public osgGA::GUIEventHandler {
 
 public:
+    PickHandler(void);
+
     osg::Node* getOrCreateSelectionBox(void);
     virtual bool handle(const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& aa);
     void initSelectionBox(void);
 
+    void setWorld(World* world) { _world = world; }
+    void setBoxPickingOnly(bool boxPickingOnly) { _boxPickingOnly = boxPickingOnly; }
+    bool isBoxPickingOnly(void) const { return _boxPickingOnly; }
+
+protected:
+    osg::MatrixTransform* pickPiece(osgViewer::View* viewer, double x, double y);
+    void pickRectangle(osgViewer::View* viewer, double xMin, double yMin, double xMax, double yMax);
+    void updateSelectionBoxes(void);
+    void updateRubberBand(double xNormalized, double yNormalized);
+    void hideRubberBand(void);
+
 protected:
     osg::ref_ptr<osg::MatrixTransform> _selectionBox;
+    osg::ref_ptr<osg::Geometry> _selectionLines;
+    osg::ref_ptr<osg::Camera> _rubberBandCamera;
+    osg::ref_ptr<osg::Geometry> _rubberBandLines;
+    World* _world;
+    bool _boxPickingOnly;
+    int _selectionRevision;
+
+    // Rubber band corner, in window and normalized coordinates
+    bool _rubberBand;
+    double _pushX;
+    double _pushY;
+    double _pushXNormalized;
+    double _pushYNormalized;
 
 };
 
@@ -0,0 +1,262 @@
+#include "PlotCulling.h"
+
+#include "LegoNode.h"
+#include "Brick.h"
+#include "Corner.h"
+
+#include <osg/Geode>
+
+#include <cmath>
+
+// Bottom cylinders stand between plots: a quarter of Lego unit around their center reaches every neighbour cell
+#define BOTTOM_CYLINDER_REACH 0.25
+
+PlotCulling::PlotCulling(void) :
+    _enabled(true) {
+}
+
+quint64 PlotCulling::cellKey(int i, int j, int level) {
+    // 16 bits per coordinate, far beyond World limits
+    return (quint64(quint16(i)) << 32) | (quint64(quint16(j)) << 16) | quint64(quint16(level));
+}
+
+bool PlotCulling::collectParts(osg::MatrixTransform* matrixTransform, Piece& piece) {
+    if (matrixTransform->getNumChildren() == 0)
+        return false;
+
+    // Only bricks and corners have a full body: other pieces have holes, slopes... their plots stay visible
+    LegoNode* legoNode = dynamic_cast<LegoNode*>(matrixTransform->getChild(0));
+    if (!legoNode || !legoNode->getLego())
+        return false;
+    Lego* lego = legoNode->getLego();
+    if (!dynamic_cast<Brick*>(lego) && !dynamic_cast<Corner*>(lego))
+        return false;
+
+    BoundingBox box = lego->getBoundingBox();
+    piece.top = Lego::height_unit*box.getHeight()/2.0;
+    piece.bottom = -piece.top;
+
+    for (unsigned int k = 0; k < legoNode->getNumChildren(); k++) {
+        osg::Geode* geode = dynamic_cast<osg::Geode*>(legoNode->getChild(k));
+        if (!geode)
+            continue;
+
+        bool isPlot = (geode->getName() == LegoNode::plotName);
+        bool isBottomCylinder = (geode->getName() == LegoNode::bottomCylinderName);
+        if (!isPlot && !isBottomCylinder)
+            continue;
+
+        // Cloned LEGO nodes share their geodes with the preview, so each piece gets its own ones, drawables are still shared
+        osg::ref_ptr<osg::Geode> ownGeode = new osg::Geode(*geode);
+        legoNode->setChild(k, ownGeode.get());
+
+        osg::Vec3 center = ownGeode->getBoundingBox().center();
+        if (isPlot) {
+            piece.plots << ownGeode.get();
+            piece.plotPositions << osg::Vec3(center.x(), center.y(), piece.top);
+        } else {
+            piece.bottomCylinders << ownGeode.get();
+            piece.bottomCylinderPositions << osg::Vec3(center.x(), center.y(), piece.bottom);
+        }
+    }
+
+    // Piece covers the cells of its plots, flat bricks have none and cover their whole box
+    if (!piece.plots.isEmpty()) {
+        for (int k = 0; k < piece.plotPositions.size(); k++)
+            piece.footprint << osg::Vec3(piece.plotPositions.at(k).x(), piece.plotPositions.at(k).y(), 0);
+    } else {
+        for (int i = 0; i < box.getLength(); i++) {
+            for (int j = 0; j < box.getWidth(); j++)
+                piece.footprint << osg::Vec3(Lego::length_unit*(i + 0.5 - box.getLength()/2.0), Lego::length_unit*(j + 0.5 - box.getWidth()/2.0), 0);
+        }
+    }
+
+    return true;
+}
+
+void PlotCulling::insert(osg::MatrixTransform* matrixTransform) {
+    // Already tracked pieces are only moved
+    if (_pieces.contains(matrixTransform)) {
+        update(matrixTransform);
+        return;
+    }
+
+    Piece piece;
+    if (!collectParts(matrixTransform, piece))
+        return;
+
+    addPiece(matrixTransform, piece);
+    _pieces.insert(matrixTransform, piece);
+}
+
+void PlotCulling::update(osg::MatrixTransform* matrixTransform) {
+    QHash<osg::MatrixTransform*, Piece>::iterator it = _pieces.find(matrixTransform);
+    if (it == _pieces.end())
+        return;
+
+    // Parts are kept, only their cells change
+    removePiece(it.value());
+    addPiece(matrixTransform, it.value());
+}
+
+void PlotCulling::remove(osg::MatrixTransform* matrixTransform) {
+    QHash<osg::MatrixTransform*, Piece>::iterator it = _pieces.find(matrixTransform);
+    if (it == _pieces.end())
+        return;
+
+    removePiece(it.value());
+
+    // Piece may come back, by undo, and is shown whole until then
+    for (int k = 0; k < it.value().plots.size(); k++)
+        it.value().plots.at(k)->setNodeMask(~0u);
+    for (int k = 0; k < it.value().bottomCylinders.size(); k++)
+        it.value().bottomCylinders.at(k)->setNodeMask(~0u);
+
+    _pieces.erase(it);
+}
+
+void PlotCulling::clear(void) {
+    // Every part is shown again
+    bool enabled = _enabled;
+    setEnabled(false);
+    _enabled = enabled;
+
+    _pieces.clear();
+    _bottomCounts.clear();
+    _topCounts.clear();
+    _plots.clear();
+    _bottomCylinders.clear();
+    _bottomCylinderCells.clear();
+}
+
+void PlotCulling::setEnabled(bool enabled) {
+    _enabled = enabled;
+
+    // Hide covered parts again, or show them all
+    QMultiHash<quint64, osg::Node*>::const_iterator it;
+    for (it = _plots.constBegin(); it != _plots.constEnd(); ++it)
+        setVisible(it.value(), _bottomCounts.value(it.key()) == 0);
+    for (it = _bottomCylinders.constBegin(); it != _bottomCylinders.constEnd(); ++it)
+        refreshBottomCylinder(it.value());
+}
+
+void PlotCulling::addPiece(osg::MatrixTransform* matrixTransform, Piece& piece) {
+    const osg::Matrix& matrix = matrixTransform->getMatrix();
+
+    // Top and bottom levels within the world, in plates
+    int topLevel = qRound((osg::Vec3(0, 0, piece.top) * matrix).z() / Lego::height_unit);
+    int bottomLevel = qRound((osg::Vec3(0, 0, piece.bottom) * matrix).z() / Lego::height_unit);
+
+    // Covered cells
+    for (int k = 0; k < piece.footprint.size(); k++) {
+        osg::Vec3 position = piece.footprint.at(k) * matrix;
+        int i = static_cast<int>(floor(position.x() / Lego::length_unit));
+        int j = static_cast<int>(floor(position.y() / Lego::length_unit));
+
+        quint64 topCell = cellKey(i, j, topLevel);
+        piece.topCells << topCell;
+        if (_topCounts[topCell]++ == 0)
+            _dirtyCells.insert(topCell);
+
+        quint64 bottomCell = cellKey(i, j, bottomLevel);
+        piece.bottomCells << bottomCell;
+        if (_bottomCounts[bottomCell]++ == 0)
+            _dirtyCells.insert(bottomCell);
+    }
+
+    // Plots, one cell each
+    for (int k = 0; k < piece.plots.size(); k++) {
+        osg::Vec3 position = piece.plotPositions.at(k) * matrix;
+        quint64 cell = cellKey(static_cast<int>(floor(position.x() / Lego::length_unit)),
+                               static_cast<int>(floor(position.y() / Lego::length_unit)), topLevel);
+        piece.plotCells << cell;
+        _plots.insert(cell, piece.plots.at(k).get());
+        _dirtyCells.insert(cell);
+    }
+
+    // Bottom cylinders, up to four cells each
+    for (int k = 0; k < piece.bottomCylinders.size(); k++) {
+        osg::Vec3 position = piece.bottomCylinderPositions.at(k) * matrix;
+        int minI = static_cast<int>(floor(position.x() / Lego::length_unit - BOTTOM_CYLINDER_REACH));
+        int maxI = static_cast<int>(floor(position.x() / Lego::length_unit + BOTTOM_CYLINDER_REACH));
+        int minJ = static_cast<int>(floor(position.y() / Lego::length_unit - BOTTOM_CYLINDER_REACH));
+        int maxJ = static_cast<int>(floor(position.y() / Lego::length_unit + BOTTOM_CYLINDER_REACH));
+
+        osg::Node* bottomCylinder = piece.bottomCylinders.at(k).get();
+        QVector<quint64>& cells = _bottomCylinderCells[bottomCylinder];
+        cells.clear();
+        for (int i = minI; i <= maxI; i++) {
+            for (int j = minJ; j <= maxJ; j++) {
+                quint64 cell = cellKey(i, j, bottomLevel);
+                cells << cell;
+                _bottomCylinders.insert(cell, bottomCylinder);
+            }
+        }
+        _dirtyCells.insert(cells.first());
+    }
+
+    // Only parts around changed cells are checked again
+    foreach (quint64 cell, _dirtyCells)
+        refresh(cell);
+    _dirtyCells.clear();
+}
+
+void PlotCulling::removePiece(Piece& piece) {
+    for (int k = 0; k < piece.topCells.size(); k++) {
+        quint64 cell = piece.topCells.at(k);
+        if (--_topCounts[cell] == 0) {
+            _topCounts.remove(cell);
+            _dirtyCells.insert(cell);
+        }
+    }
+    for (int k = 0; k < piece.bottomCells.size(); k++) {
+        quint64 cell = piece.bottomCells.at(k);
+        if (--_bottomCounts[cell] == 0) {
+            _bottomCounts.remove(cell);
+            _dirtyCells.insert(cell);
+        }
+    }
+
+    // Forget own parts, their cells are computed again by addPiece
+    for (int k = 0; k < piece.plots.size(); k++)
+        _plots.remove(piece.plotCells.at(k), piece.plots.at(k).get());
+    for (int k = 0; k < piece.bottomCylinders.size(); k++) {
+        osg::Node* bottomCylinder = piece.bottomCylinders.at(k).get();
+        const QVector<quint64>& cells = _bottomCylinderCells[bottomCylinder];
+        for (int c = 0; c < cells.size(); c++)
+            _bottomCylinders.remove(cells.at(c), bottomCylinder);
+        _bottomCylinderCells.remove(bottomCylinder);
+    }
+    piece.topCells.clear();
+    piece.bottomCells.clear();
+    piece.plotCells.clear();
+
+    foreach (quint64 cell, _dirtyCells)
+        refresh(cell);
+    _dirtyCells.clear();
+}
+
+void PlotCulling::refresh(quint64 cell) {
+    bool covered = _bottomCounts.contains(cell);
+    QMultiHash<quint64, osg::Node*>::const_iterator it = _plots.constFind(cell);
+    for (; it != _plots.constEnd() && it.key() == cell; ++it)
+        setVisible(it.value(), !covered);
+
+    it = _bottomCylinders.constFind(cell);
+    for (; it != _bottomCylinders.constEnd() && it.key() == cell; ++it)
+        refreshBottomCylinder(it.value());
+}
+
+void PlotCulling::refreshBottomCylinder(osg::Node* bottomCylinder) {
+    // Hidden when the pieces below fill every cell around it
+    const QVector<quint64>& cells = _bottomCylinderCells[bottomCylinder];
+    bool covered = !cells.isEmpty();
+    for (int k = 0; k < cells.size() && covered; k++)
+        covered = _topCounts.contains(cells.at(k));
+    setVisible(bottomCylinder, !covered);
+}
+
+void PlotCulling::setVisible(osg::Node* node, bool visible) {
+    // When disabled, every part is drawn
+    node->setNodeMask((visible || !_enabled) ? ~0u : 0u);
+}
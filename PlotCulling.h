@@ -0,0 +1,66 @@
+#ifndef PLOTCULLING_H
+#define PLOTCULLING_H
+
+#include <QVector>
+#include <QHash>
+#include <QSet>
+
+#include <osg/MatrixTransform>
+#include <osg/ref_ptr>
+
+class PlotCulling {
+
+public:
+    PlotCulling(void);
+
+    void insert(osg::MatrixTransform* matrixTransform);
+    void update(osg::MatrixTransform* matrixTransform);
+    void remove(osg::MatrixTransform* matrixTransform);
+    void clear(void);
+
+    void setEnabled(bool enabled);
+    bool isEnabled(void) const { return _enabled; }
+
+private:
+    // Plots and bottom cylinders of a piece, with their positions in its own coordinates
+    struct Piece {
+        QVector<osg::ref_ptr<osg::Node> > plots;
+        QVector<osg::Vec3> plotPositions;
+        QVector<osg::ref_ptr<osg::Node> > bottomCylinders;
+        QVector<osg::Vec3> bottomCylinderPositions;
+        QVector<osg::Vec3> footprint;
+        float top;
+        float bottom;
+
+        // Cells covered within the world, recorded to be removed as they were added
+        QVector<quint64> topCells;
+        QVector<quint64> bottomCells;
+        QVector<quint64> plotCells;
+    };
+
+    static quint64 cellKey(int i, int j, int level);
+    static bool collectParts(osg::MatrixTransform* matrixTransform, Piece& piece);
+
+    void addPiece(osg::MatrixTransform* matrixTransform, Piece& piece);
+    void removePiece(Piece& piece);
+    void refresh(quint64 cell);
+    void refreshBottomCylinder(osg::Node* bottomCylinder);
+    void setVisible(osg::Node* node, bool visible);
+
+private:
+    QHash<osg::MatrixTransform*, Piece> _pieces;
+
+    // Number of pieces whose bottom (top) covers each cell, at the height of the cell level
+    QHash<quint64, int> _bottomCounts;
+    QHash<quint64, int> _topCounts;
+
+    // Plots are hidden when a bottom covers their cell, bottom cylinders when tops cover all their cells
+    QMultiHash<quint64, osg::Node*> _plots;
+    QMultiHash<quint64, osg::Node*> _bottomCylinders;
+    QHash<osg::Node*, QVector<quint64> > _bottomCylinderCells;
+
+    QSet<quint64> _dirtyCells;
+    bool _enabled;
+};
+
+#endif // PLOTCULLING_H
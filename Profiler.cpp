@@ -0,0 +1,126 @@
+#include "Profiler.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include <QHash>
+#include <QDebug>
+
+// Number of samples kept, older ones are overwritten
+#define RING_SIZE 65536
+
+QVector<Profiler::Sample> Profiler::_ring(RING_SIZE);
+int Profiler::_next = 0;
+int Profiler::_count = 0;
+QMutex Profiler::_mutex;
+bool Profiler::_enabled = true;
+QVector<QPair<const char*, qint64> > Profiler::_startupMarks;
+
+QElapsedTimer& Profiler::clock(void) {
+    // Started on first use, so that every time is relative to the same origin
+    static QElapsedTimer timer;
+    if (!timer.isValid())
+        timer.start();
+    return timer;
+}
+
+qint64 Profiler::now(void) {
+    return clock().nsecsElapsed()/1000;
+}
+
+void Profiler::record(const char* name, qint64 start, qint64 duration) {
+    Sample sample;
+    sample.name = name;
+    sample.start = start;
+    sample.duration = duration;
+    sample.threadId = reinterpret_cast<quintptr>(QThread::currentThreadId());
+
+    // Scopes may end on background threads (imports, OSG draw threads)
+    QMutexLocker locker(&_mutex);
+    _ring[_next] = sample;
+    _next = (_next+1)%RING_SIZE;
+    if (_count < RING_SIZE)
+        _count++;
+}
+
+QVector<Profiler::Sample> Profiler::getSamples(void) {
+    QMutexLocker locker(&_mutex);
+
+    // Oldest sample first
+    QVector<Sample> samples;
+    samples.reserve(_count);
+    int first = (_next - _count + RING_SIZE)%RING_SIZE;
+    for (int k = 0; k < _count; k++)
+        samples << _ring.at((first+k)%RING_SIZE);
+
+    return samples;
+}
+
+void Profiler::clear(void) {
+    QMutexLocker locker(&_mutex);
+    _next = 0;
+    _count = 0;
+}
+
+void Profiler::setEnabled(bool enabled) {
+    // Make sure the clock is started from the main thread
+    clock();
+    _enabled = enabled;
+}
+
+bool Profiler::exportChromeTrace(const QString& fileName) {
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qDebug() << "Cannot open" << fileName << "within Profiler::exportChromeTrace";
+        return false;
+    }
+
+    QVector<Sample> samples = getSamples();
+
+    // Chrome tracing wants small thread ids
+    QHash<quintptr, int> threadIds;
+
+    // Complete events ("ph": "X"), readable with chrome://tracing
+    QTextStream out(&file);
+    out << "{\"traceEvents\":[\n";
+    for (int k = 0; k < samples.size(); k++) {
+        const Sample& sample = samples.at(k);
+        if (!threadIds.contains(sample.threadId))
+            threadIds.insert(sample.threadId, threadIds.size()+1);
+
+        out << "{\"name\":\"" << sample.name << "\",\"ph\":\"X\",\"pid\":1"
+            << ",\"tid\":" << threadIds.value(sample.threadId)
+            << ",\"ts\":" << sample.start
+            << ",\"dur\":" << sample.duration << "}";
+        if (k < samples.size()-1)
+            out << ",";
+        out << "\n";
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+
+    return true;
+}
+
+void Profiler::markStartup(const char* step) {
+    // Recorded even when profiling is disabled, startup only happens once
+    QMutexLocker locker(&_mutex);
+    _startupMarks << qMakePair(step, now());
+}
+
+void Profiler::logStartup(void) {
+    QMutexLocker locker(&_mutex);
+
+    // Time of each step since application start, and since previous step
+    qint64 previous = 0;
+    for (int k = 0; k < _startupMarks.size(); k++) {
+        qint64 time = _startupMarks.at(k).second;
+        qDebug() << "Startup:" << _startupMarks.at(k).first << "at" << time/1000 << "ms (+" << (time - previous)/1000 << "ms)";
+        previous = time;
+    }
+}
+
+qint64 Profiler::getStartupTime(void) {
+    // Time of the last step
+    QMutexLocker locker(&_mutex);
+    return _startupMarks.isEmpty() ? 0 : _startupMarks.last().second;
+}
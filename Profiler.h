@@ -0,0 +1,67 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <QVector>
+#include <QPair>
+#include <QString>
+#include <QMutex>
+#include <QElapsedTimer>
+
+// Record a timing for the enclosing scope, name has to be a string literal
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+class Profiler {
+
+public:
+    // One timed scope, in microseconds since application start
+    struct Sample {
+        const char* name;
+        qint64 start;
+        qint64 duration;
+        quintptr threadId;
+    };
+
+    static void record(const char* name, qint64 start, qint64 duration);
+    static qint64 now(void);
+
+    static QVector<Sample> getSamples(void);
+    static void clear(void);
+    static bool exportChromeTrace(const QString& fileName);
+
+    static void setEnabled(bool enabled);
+    static bool isEnabled(void) { return _enabled; }
+
+    // Startup timeline, step name has to be a string literal
+    static void markStartup(const char* step);
+    static void logStartup(void);
+    static qint64 getStartupTime(void);
+
+private:
+    static QElapsedTimer& clock(void);
+
+private:
+    static QVector<Sample> _ring;
+    static int _next;
+    static int _count;
+    static QMutex _mutex;
+    static bool _enabled;
+    static QVector<QPair<const char*, qint64> > _startupMarks;
+};
+
+class ProfileScope {
+
+public:
+    ProfileScope(const char* name) : _name(name), _start(Profiler::isEnabled() ? Profiler::now() : -1) {}
+    ~ProfileScope(void) {
+        if (_start >= 0)
+            Profiler::record(_name, _start, Profiler::now() - _start);
+    }
+
+private:
+    const char* _name;
+    qint64 _start;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,104 @@
+#include "ProfilerWidget.h"
+
+#include "Profiler.h"
+
+// Refresh period of the live statistics, in ms
+#define REFRESH_PERIOD 500
+
+ProfilerWidget::ProfilerWidget(QWidget* parent) :
+    QWidget(parent) {
+
+    // Statistics, one line per profiled scope
+    _statsTree = new QTreeWidget(this);
+    _statsTree->setRootIsDecorated(false);
+    _statsTree->setSortingEnabled(true);
+    _statsTree->setHeaderLabels(QStringList() << "Scope" << "Count" << "Last (ms)" << "Mean (ms)" << "Max (ms)" << "Total (ms)");
+    _statsTree->sortByColumn(5, Qt::DescendingOrder);
+
+    // Buttons
+    _clearButton = new QPushButton("Clear", this);
+    connect(_clearButton, SIGNAL(clicked()), this, SLOT(clear()));
+    _exportButton = new QPushButton("Export trace...", this);
+    connect(_exportButton, SIGNAL(clicked()), this, SLOT(exportTrace()));
+
+    QHBoxLayout* buttonsLayout = new QHBoxLayout;
+    buttonsLayout->addWidget(_clearButton);
+    buttonsLayout->addWidget(_exportButton);
+
+    // Main layout
+    QVBoxLayout* mainLayout = new QVBoxLayout;
+    mainLayout->addWidget(_statsTree);
+    mainLayout->addLayout(buttonsLayout);
+    setLayout(mainLayout);
+
+    // Statistics are only computed while visible
+    connect(&_refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+}
+
+void ProfilerWidget::showEvent(QShowEvent* event) {
+    refresh();
+    _refreshTimer.start(REFRESH_PERIOD);
+    QWidget::showEvent(event);
+}
+
+void ProfilerWidget::hideEvent(QHideEvent* event) {
+    _refreshTimer.stop();
+    QWidget::hideEvent(event);
+}
+
+namespace {
+    // Statistics of one profiled scope, in microseconds
+    struct Stat {
+        int count;
+        qint64 last;
+        qint64 max;
+        qint64 total;
+    };
+}
+
+void ProfilerWidget::refresh(void) {
+    // Aggregate samples per scope name
+    QVector<Profiler::Sample> samples = Profiler::getSamples();
+    QMap<QString, Stat> stats;
+    for (int k = 0; k < samples.size(); k++) {
+        const Profiler::Sample& sample = samples.at(k);
+        QMap<QString, Stat>::iterator it = stats.find(sample.name);
+        if (it == stats.end()) {
+            Stat stat = { 0, 0, 0, 0 };
+            it = stats.insert(sample.name, stat);
+        }
+        it->count++;
+        it->last = sample.duration;
+        it->max = qMax(it->max, sample.duration);
+        it->total += sample.duration;
+    }
+
+    // Fill tree, keeping user sort
+    _statsTree->setSortingEnabled(false);
+    _statsTree->clear();
+    for (QMap<QString, Stat>::const_iterator it = stats.begin(); it != stats.end(); ++it) {
+        QTreeWidgetItem* item = new QTreeWidgetItem(_statsTree);
+        item->setText(0, it.key());
+        item->setData(1, Qt::DisplayRole, it->count);
+        item->setData(2, Qt::DisplayRole, it->last/1000.0);
+        item->setData(3, Qt::DisplayRole, it->total/1000.0/it->count);
+        item->setData(4, Qt::DisplayRole, it->max/1000.0);
+        item->setData(5, Qt::DisplayRole, it->total/1000.0);
+    }
+    _statsTree->setSortingEnabled(true);
+}
+
+void ProfilerWidget::clear(void) {
+    Profiler::clear();
+    refresh();
+}
+
+void ProfilerWidget::exportTrace(void) {
+    // Chrome trace files are JSON
+    QString fileName = QFileDialog::getSaveFileName(this, "Export trace", "trace.json", "Chrome trace (*.json)");
+    if (fileName.isEmpty())
+        return;
+
+    if (!Profiler::exportChromeTrace(fileName))
+        QMessageBox::critical(this, "Trace has not been exported", "An error occured while tempting to write "+fileName+" within ProfilerWidget::exportTrace.");
+}
@@ -0,0 +1,28 @@
+#ifndef PROFILERWIDGET_H
+#define PROFILERWIDGET_H
+
+#include <QtGui>
+
+class ProfilerWidget : public QWidget {
+    Q_OBJECT
+
+public:
+    ProfilerWidget(QWidget* parent = 0);
+
+public slots:
+    void refresh(void);
+    void clear(void);
+    void exportTrace(void);
+
+protected:
+    virtual void showEvent(QShowEvent* event);
+    virtual void hideEvent(QHideEvent* event);
+
+private:
+    QTreeWidget* _statsTree;
+    QPushButton* _clearButton;
+    QPushButton* _exportButton;
+    QTimer _refreshTimer;
+};
+
+#endif // PROFILERWIDGET_H
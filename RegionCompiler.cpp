@@ -0,0 +1,387 @@
+#include "RegionCompiler.h"
+
+#include "WallCompiler.h"
+#include "Profiler.h"
+#include "Lego.h"
+
+#include <QtConcurrentRun>
+#include <QDebug>
+
+#include <osg/Geode>
+#include <osg/Billboard>
+#include <osg/LOD>
+#include <osg/Camera>
+#include <osg/Projection>
+#include <osg/Transform>
+#include <osgUtil/Optimizer>
+
+#include <cmath>
+
+// Regions are as large as a road cell
+#define REGION_SIZE (32*Lego::length_unit)
+
+// Edits often come in series, regions are only rebuilt once left alone for a while
+#define REBUILD_DELAY 500
+
+// A single piece is drawn as well on its own
+#define MIN_REGION_PIECES 2
+
+namespace {
+    // Collect drawables of a piece, and tell whether it can be merged with others at all
+    class ItemCollector : public osg::NodeVisitor {
+    public:
+        ItemCollector(QVector<RegionCompiler::Item>& items) :
+            osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN),
+            _items(items),
+            _supported(true) {}
+
+        bool isSupported(void) const { return _supported; }
+
+        virtual void apply(osg::Node& node) {
+            // States are only kept at geode and drawable levels
+            if (node.getStateSet())
+                _supported = false;
+            traverse(node);
+        }
+
+        virtual void apply(osg::Transform& transform) {
+            if (transform.getReferenceFrame() != osg::Transform::RELATIVE_RF)
+                _supported = false;
+            osg::NodeVisitor::apply(transform);
+        }
+
+        virtual void apply(osg::Geode& geode) {
+            osg::Matrix matrix = osg::computeLocalToWorld(getNodePath());
+            for (unsigned int k = 0; k < geode.getNumDrawables(); k++) {
+                osg::Geometry* geometry = geode.getDrawable(k)->asGeometry();
+                if (!geometry || !dynamic_cast<osg::Vec3Array*>(geometry->getVertexArray())
+                    || (geometry->getNormalArray() && !dynamic_cast<osg::Vec3Array*>(geometry->getNormalArray()))) {
+                    _supported = false;
+                    return;
+                }
+
+                RegionCompiler::Item item;
+                item.geometry = geometry;
+                item.geodeStateSet = geode.getStateSet();
+                item.matrix = matrix;
+                _items << item;
+            }
+        }
+
+        // These ones depend on the camera
+        virtual void apply(osg::Billboard&) { _supported = false; }
+        virtual void apply(osg::LOD&) { _supported = false; }
+        virtual void apply(osg::Camera&) { _supported = false; }
+        virtual void apply(osg::Projection&) { _supported = false; }
+
+    private:
+        QVector<RegionCompiler::Item>& _items;
+        bool _supported;
+    };
+
+    // Regions are rebuilt by the update traversal, only while some of them are dirty
+    class RegionCallback : public osg::NodeCallback {
+    public:
+        RegionCallback(RegionCompiler* regionCompiler) : _regionCompiler(regionCompiler) {}
+
+        virtual void operator()(osg::Node* node, osg::NodeVisitor* nv) {
+            _regionCompiler->rebuildDirtyRegions();
+            traverse(node, nv);
+        }
+
+    private:
+        RegionCompiler* _regionCompiler;
+    };
+}
+
+RegionCompiler::RegionCompiler(void) :
+    _enabled(true) {
+
+    _root = new osg::Group;
+    _root->setName("Compiled regions group");
+    _updateCallback = new RegionCallback(this);
+    _clock.start();
+}
+
+RegionCompiler::~RegionCompiler(void) {
+    // The scene may outlive the compiler, running builds only use their own data
+    _root->setUpdateCallback(NULL);
+}
+
+quint32 RegionCompiler::regionKey(int i, int j) {
+    return (quint32(quint16(i)) << 16) | quint32(quint16(j));
+}
+
+quint32 RegionCompiler::regionKey(const osg::Vec3& position) {
+    return regionKey(static_cast<int>(floor(position.x() / REGION_SIZE)), static_cast<int>(floor(position.y() / REGION_SIZE)));
+}
+
+void RegionCompiler::insert(osg::MatrixTransform* matrixTransform) {
+    // Already tracked pieces are only moved
+    if (_pieceRegions.contains(matrixTransform)) {
+        update(matrixTransform);
+        return;
+    }
+
+    quint32 key = regionKey(matrixTransform->getBound().center());
+    _pieceRegions.insert(matrixTransform, key);
+    _regions[key].pieces.insert(matrixTransform);
+    markDirtyAround(matrixTransform);
+}
+
+void RegionCompiler::update(osg::MatrixTransform* matrixTransform) {
+    QHash<osg::MatrixTransform*, quint32>::iterator it = _pieceRegions.find(matrixTransform);
+    if (it == _pieceRegions.end()) {
+        insert(matrixTransform);
+        return;
+    }
+
+    // Old region loses the piece, new ones may see it or its effects on their plots
+    markDirty(it.value());
+    _regions[it.value()].pieces.remove(matrixTransform);
+
+    quint32 key = regionKey(matrixTransform->getBound().center());
+    it.value() = key;
+    _regions[key].pieces.insert(matrixTransform);
+    markDirtyAround(matrixTransform);
+}
+
+void RegionCompiler::remove(osg::MatrixTransform* matrixTransform) {
+    QHash<osg::MatrixTransform*, quint32>::iterator it = _pieceRegions.find(matrixTransform);
+    if (it == _pieceRegions.end())
+        return;
+
+    // Piece may come back, by undo: marked dirty, its region draws it on its own again
+    markDirtyAround(matrixTransform);
+    markDirty(it.value());
+    _regions[it.value()].pieces.remove(matrixTransform);
+    _pieceRegions.erase(it);
+}
+
+void RegionCompiler::clear(void) {
+    // Every piece is drawn on its own again, running builds end up thrown away
+    QHash<quint32, Region>::iterator it;
+    for (it = _regions.begin(); it != _regions.end(); ++it)
+        showPieces(it.value());
+
+    _regions.clear();
+    _pieceRegions.clear();
+    _root->setUpdateCallback(NULL);
+}
+
+void RegionCompiler::setEnabled(bool enabled) {
+    _enabled = enabled;
+
+    // Show pieces on their own, or compiled regions
+    QHash<quint32, Region>::iterator it;
+    for (it = _regions.begin(); it != _regions.end(); ++it)
+        applyMasks(it.value());
+}
+
+int RegionCompiler::getNbCompiledRegions(void) const {
+    int nbCompiledRegions = 0;
+    QHash<quint32, Region>::const_iterator it;
+    for (it = _regions.constBegin(); it != _regions.constEnd(); ++it) {
+        if (it.value().compiled.valid())
+            nbCompiledRegions++;
+    }
+
+    return nbCompiledRegions;
+}
+
+void RegionCompiler::markDirty(quint32 key) {
+    QHash<quint32, Region>::iterator it = _regions.find(key);
+    if (it == _regions.end())
+        return;
+
+    // Pieces are drawn on their own until the region is built again
+    Region& region = it.value();
+    showPieces(region);
+    region.revision++;
+    region.dirtySince = _clock.elapsed();
+
+    _root->setUpdateCallback(_updateCallback.get());
+}
+
+void RegionCompiler::markDirtyAround(osg::MatrixTransform* matrixTransform) {
+    // Pieces reaching other regions may cover their plots, those regions are built again too
+    const osg::BoundingSphere& bound = matrixTransform->getBound();
+    float reach = bound.radius() + Lego::length_unit;
+    int minI = static_cast<int>(floor((bound.center().x() - reach) / REGION_SIZE));
+    int maxI = static_cast<int>(floor((bound.center().x() + reach) / REGION_SIZE));
+    int minJ = static_cast<int>(floor((bound.center().y() - reach) / REGION_SIZE));
+    int maxJ = static_cast<int>(floor((bound.center().y() + reach) / REGION_SIZE));
+
+    for (int i = minI; i <= maxI; i++) {
+        for (int j = minJ; j <= maxJ; j++)
+            markDirty(regionKey(i, j));
+    }
+}
+
+void RegionCompiler::showPieces(Region& region) {
+    foreach (osg::MatrixTransform* piece, region.compiledPieces)
+        piece->setNodeMask(~0u);
+    region.compiledPieces.clear();
+
+    if (region.compiled.valid()) {
+        _root->removeChild(region.compiled.get());
+        region.compiled = NULL;
+    }
+}
+
+void RegionCompiler::applyMasks(Region& region) {
+    if (!region.compiled.valid())
+        return;
+
+    region.compiled->setNodeMask(_enabled ? ~0u : 0u);
+    foreach (osg::MatrixTransform* piece, region.compiledPieces)
+        piece->setNodeMask(_enabled ? compiledPieceMask : ~0u);
+}
+
+void RegionCompiler::rebuildDirtyRegions(void) {
+    PROFILE_SCOPE("RegionCompiler::rebuildDirtyRegions");
+
+    qint64 now = _clock.elapsed();
+    bool pending = false;
+
+    QHash<quint32, Region>::iterator it = _regions.begin();
+    while (it != _regions.end()) {
+        Region& region = it.value();
+
+        // Swap finished builds in
+        if (region.building && region.build.isFinished())
+            finishBuild(region);
+
+        // Start builds of regions left alone long enough, one at a time per region
+        if (!region.building && region.dirtySince >= 0 && now - region.dirtySince >= REBUILD_DELAY)
+            startBuild(region);
+
+        // Forget empty regions
+        if (region.pieces.isEmpty() && !region.building && !region.compiled.valid()) {
+            it = _regions.erase(it);
+            continue;
+        }
+
+        pending = pending || region.building || region.dirtySince >= 0;
+        ++it;
+    }
+
+    // Nothing left to do: no more update traversal, so that frames are only drawn on demand again
+    if (!pending)
+        _root->setUpdateCallback(NULL);
+}
+
+bool RegionCompiler::collectItems(osg::MatrixTransform* matrixTransform, QVector<Item>& items) {
+    QVector<Item> pieceItems;
+    ItemCollector collector(pieceItems);
+    // Bodies compiled into walls are drawn by their section
+    collector.setTraversalMask(~WallCompiler::compiledBodyMask);
+    matrixTransform->accept(collector);
+    if (!collector.isSupported() || pieceItems.isEmpty())
+        return false;
+
+    items << pieceItems;
+    return true;
+}
+
+void RegionCompiler::startBuild(Region& region) {
+    region.dirtySince = -1;
+
+    // Drawables are collected here, so that the build does not read the scene while it changes
+    QVector<Item> items;
+    region.buildPieces.clear();
+    foreach (osg::MatrixTransform* piece, region.pieces) {
+        if (collectItems(piece, items))
+            region.buildPieces.insert(piece);
+    }
+
+    if (region.buildPieces.size() < MIN_REGION_PIECES) {
+        region.buildPieces.clear();
+        return;
+    }
+
+    region.building = true;
+    region.buildRevision = region.revision;
+    region.build = QtConcurrent::run(buildRegion, items);
+}
+
+void RegionCompiler::finishBuild(Region& region) {
+    region.building = false;
+    osg::ref_ptr<osg::Node> compiled = region.build.result();
+    region.build = QFuture<osg::ref_ptr<osg::Node> >();
+
+    // Region was edited meanwhile: it is built again later
+    if (region.buildRevision != region.revision || !compiled.valid()) {
+        region.buildPieces.clear();
+        return;
+    }
+
+    region.compiled = compiled;
+    region.compiledPieces = region.buildPieces;
+    region.buildPieces.clear();
+    _root->addChild(region.compiled.get());
+    applyMasks(region);
+}
+
+osg::ref_ptr<osg::Node> RegionCompiler::buildRegion(const QVector<Item>& items) {
+    PROFILE_SCOPE("RegionCompiler::buildRegion");
+
+    osg::ref_ptr<osg::Group> root = new osg::Group;
+    root->setName("Compiled region");
+
+    // One geode per material, geometries are copied and moved within the world
+    QHash<osg::StateSet*, osg::Geode*> geodes;
+    for (int k = 0; k < items.size(); k++) {
+        const Item& item = items.at(k);
+
+        osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry(*item.geometry, osg::CopyOp::DEEP_COPY_ARRAYS | osg::CopyOp::DEEP_COPY_PRIMITIVES);
+        // Because LEGO bricks don't move, and the optimizer doesn't merge DYNAMIC geometries
+        geometry->setDataVariance(osg::Object::STATIC);
+        osg::Vec3Array* vertices = static_cast<osg::Vec3Array*>(geometry->getVertexArray());
+        for (unsigned int v = 0; v < vertices->size(); v++)
+            (*vertices)[v] = (*vertices)[v] * item.matrix;
+
+        osg::Vec3Array* normals = static_cast<osg::Vec3Array*>(geometry->getNormalArray());
+        if (normals) {
+            osg::Matrix inverse = osg::Matrix::inverse(item.matrix);
+            for (unsigned int n = 0; n < normals->size(); n++) {
+                (*normals)[n] = osg::Matrix::transform3x3(inverse, (*normals)[n]);
+                (*normals)[n].normalize();
+            }
+        }
+        geometry->dirtyBound();
+
+        osg::Geode* geode = geodes.value(item.geodeStateSet.get());
+        if (!geode) {
+            geode = new osg::Geode;
+            geode->setStateSet(item.geodeStateSet.get());
+            root->addChild(geode);
+            geodes.insert(item.geodeStateSet.get(), geode);
+        }
+        geode->addDrawable(geometry.get());
+    }
+
+    // Geometries sharing their material become a few large ones
+    osgUtil::Optimizer optimizer;
+    optimizer.optimize(root.get(), osgUtil::Optimizer::MERGE_GEOMETRY);
+
+    int nbDrawables = 0;
+    for (unsigned int k = 0; k < root->getNumChildren(); k++) {
+        osg::Geode* geode = root->getChild(k)->asGeode();
+        if (!geode)
+            continue;
+
+        for (unsigned int d = 0; d < geode->getNumDrawables(); d++) {
+            osg::Drawable* drawable = geode->getDrawable(d);
+            drawable->setUseDisplayList(false);
+            drawable->setUseVertexBufferObjects(true);
+        }
+        nbDrawables += geode->getNumDrawables();
+    }
+
+    // Pieces sharing a material should have been merged, or the region is drawn no faster than its pieces
+    if (nbDrawables >= items.size() && static_cast<int>(root->getNumChildren()) < items.size())
+        qDebug() << "Geometries of" << items.size() << "pieces not merged within RegionCompiler::buildRegion";
+
+    return root.get();
+}
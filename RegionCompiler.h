@@ -0,0 +1,85 @@
+#ifndef REGIONCOMPILER_H
+#define REGIONCOMPILER_H
+
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QFuture>
+#include <QElapsedTimer>
+
+#include <osg/Geometry>
+#include <osg/MatrixTransform>
+#include <osg/NodeCallback>
+#include <osg/ref_ptr>
+
+class RegionCompiler {
+
+public:
+    // Pieces drawn by their region mesh keep this mask: the world camera does not draw them, picking still finds them
+    static const osg::Node::NodeMask compiledPieceMask = 0x2;
+
+    // Drawables of a piece, with their place within the world
+    struct Item {
+        osg::ref_ptr<osg::Geometry> geometry;
+        osg::ref_ptr<osg::StateSet> geodeStateSet;
+        osg::Matrix matrix;
+    };
+
+public:
+    RegionCompiler(void);
+    ~RegionCompiler(void);
+
+    osg::Group* getRoot(void) const { return _root.get(); }
+
+    void insert(osg::MatrixTransform* matrixTransform);
+    void update(osg::MatrixTransform* matrixTransform);
+    void remove(osg::MatrixTransform* matrixTransform);
+    void clear(void);
+
+    void setEnabled(bool enabled);
+    bool isEnabled(void) const { return _enabled; }
+
+    void rebuildDirtyRegions(void);
+    int getNbCompiledRegions(void) const;
+
+private:
+    // Pieces of a region, by the center of their box, and their compiled meshes
+    struct Region {
+        Region(void) : revision(0), dirtySince(-1), building(false), buildRevision(0) {}
+
+        QSet<osg::MatrixTransform*> pieces;
+        osg::ref_ptr<osg::Node> compiled;
+        QSet<osg::MatrixTransform*> compiledPieces;
+
+        // Every edit makes a new revision, older builds are thrown away
+        int revision;
+        qint64 dirtySince;
+
+        bool building;
+        int buildRevision;
+        QSet<osg::MatrixTransform*> buildPieces;
+        QFuture<osg::ref_ptr<osg::Node> > build;
+    };
+
+    static quint32 regionKey(int i, int j);
+    static quint32 regionKey(const osg::Vec3& position);
+    static bool collectItems(osg::MatrixTransform* matrixTransform, QVector<Item>& items);
+    static osg::ref_ptr<osg::Node> buildRegion(const QVector<Item>& items);
+
+    void markDirty(quint32 key);
+    void markDirtyAround(osg::MatrixTransform* matrixTransform);
+    void startBuild(Region& region);
+    void finishBuild(Region& region);
+    void showPieces(Region& region);
+    void applyMasks(Region& region);
+
+private:
+    osg::ref_ptr<osg::Group> _root;
+    osg::ref_ptr<osg::NodeCallback> _updateCallback;
+    QHash<quint32, Region> _regions;
+    QHash<osg::MatrixTransform*, quint32> _pieceRegions;
+    QElapsedTimer _clock;
+    bool _enabled;
+};
+
+#endif // REGIONCOMPILER_H
@@ -1,12 +1,20 @@
 #include "ReverseTileDialog.h"
 
-ReverseTileDialog::ReverseTileDialog(QWidget *parent) :
+ReverseTileDialog::ReverseTileDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 ReverseTileDialog::ReverseTileDialog(const ReverseTileDialog& reverseTileDialog) :
     LegoDialog(reverseTileDialog) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void ReverseTileDialog::createWidgets(void) {
     // Reverse tile width
     _widthSpinBox = new QSpinBox(this);
     _widthSpinBox->setRange(2, 3);
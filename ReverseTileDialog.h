@@ -22,6 +22,8 @@ public slots:
     virtual void setLego(int);
 
 private:
+    void createWidgets(void);
+
     QSpinBox* _widthSpinBox;
     QSpinBox* _lengthSpinBox;
 };
@@ -1,4 +1,5 @@
 #include "ReverseTileNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Material>
@@ -20,6 +21,8 @@ ReverseTileNode::ReverseTileNode(const ReverseTileNode& reverseTileNode) :
 }
 
 void ReverseTileNode::createGeode(void) {
+    PROFILE_SCOPE("ReverseTileNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
 
@@ -2,11 +2,19 @@
 
 RoadDialog::RoadDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 RoadDialog::RoadDialog(const RoadDialog& roadDialog) :
     LegoDialog(roadDialog) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void RoadDialog::createWidgets(void) {
     // Road type
     _roadTypeComboBox = new QComboBox(this);
     QStringList roadTypeList;
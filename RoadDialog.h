@@ -23,6 +23,8 @@ public slots:
     virtual void setLego(int);
 
 private:
+    void createWidgets(void);
+
     QComboBox* _roadTypeComboBox;
 };
 
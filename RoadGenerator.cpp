@@ -0,0 +1,252 @@
+#include "RoadGenerator.h"
+
+#include "Profiler.h"
+
+#include <QDebug>
+
+// Solving again with following random numbers after a contradiction
+#define MAX_ATTEMPTS 16
+
+// A tile is a side mask: bit k is set when a road leaves the tile on side k.
+// Domains are 16 bit sets of tiles, so every constraint is a single AND.
+
+// Tiles with a road on side k: 0xAAAA for left, 0xCCCC for top, 0xF0F0 for right, 0xFF00 for bottom
+static const quint16 SIDE_SET[RoadGenerator::nbSides] = { 0xAAAA, 0xCCCC, 0xF0F0, 0xFF00 };
+// Every tile but dead ends, which have a road on one side only
+static const quint16 VALID_TILES = 0xFEE9;
+
+namespace {
+    struct Tile {
+        Road::RoadType roadType;
+        int nbRotations;
+        int weight;
+    };
+
+    // A quarter turn moves the road of side k to side k+1
+    int rotate(int mask, int nbRotations) {
+        for (int k = 0; k < nbRotations; k++)
+            mask = ((mask << 1) | (mask >> 3)) & 0xF;
+        return mask;
+    }
+
+    // Road type and rotation of each side mask, built once from the unrotated pieces
+    struct TileTable {
+        TileTable(void) {
+            add(Road::none, 0x0, 6);
+            add(Road::straight, 0xA, 4);
+            add(Road::curve, 0x9, 3);
+            add(Road::intersection, 0xE, 1);
+            add(Road::cross, 0xF, 1);
+
+            // Dead ends are never chosen, but shown as straight roads when asked
+            for (int side = 0; side < RoadGenerator::nbSides; side++) {
+                Tile& tile = tiles[1 << side];
+                tile.roadType = Road::straight;
+                tile.nbRotations = (side+1)%2;
+                tile.weight = 0;
+            }
+        }
+
+        // Symmetric pieces reach the same mask several times, the fewest rotations are kept
+        void add(Road::RoadType roadType, int mask, int weight) {
+            for (int k = 3; k >= 0; k--) {
+                Tile& tile = tiles[rotate(mask, k)];
+                tile.roadType = roadType;
+                tile.nbRotations = k;
+                tile.weight = weight;
+            }
+        }
+
+        Tile tiles[16];
+    };
+
+    const TileTable& tileTable(void) {
+        static const TileTable table;
+        return table;
+    }
+}
+
+RoadGenerator::RoadGenerator(int width, int length, quint32 seed) :
+    _width(width),
+    _length(length),
+    // xorshift must never reach 0
+    _state(seed ^ 0x9e3779b9) {
+
+    if (_state == 0)
+        _state = 0x9e3779b9;
+}
+
+quint32 RoadGenerator::random(void) {
+    // xorshift32: same seed, same numbers, whatever the platform rand() is
+    _state ^= _state << 13;
+    _state ^= _state >> 17;
+    _state ^= _state << 5;
+    return _state;
+}
+
+void RoadGenerator::tile(int sideMask, Road::RoadType& roadType, int& nbRotations) {
+    // Road piece and rotation for the given sides, dead ends being shown as straight roads
+    const Tile& tile = tileTable().tiles[sideMask & 0xF];
+    roadType = tile.roadType;
+    nbRotations = tile.nbRotations;
+}
+
+int RoadGenerator::neighbour(int cell, int side) const {
+    int i = cell / _length;
+    int j = cell % _length;
+    switch (side) {
+    case left:
+        return (i > 0) ? cell-_length : -1;
+    case top:
+        return (j < _length-1) ? cell+1 : -1;
+    case right:
+        return (i < _width-1) ? cell+_length : -1;
+    default:
+        return (j > 0) ? cell-1 : -1;
+    }
+}
+
+bool RoadGenerator::restrict(int cell, quint16 allowed) {
+    quint16 domain = _domains.at(cell) & allowed;
+    if (domain == 0)
+        return false;
+
+    // Neighbours are only checked again when something changed
+    if (domain != _domains.at(cell)) {
+        _domains[cell] = domain;
+        _propagationStack << cell;
+    }
+    return true;
+}
+
+bool RoadGenerator::propagate(void) {
+    while (!_propagationStack.isEmpty()) {
+        int cell = _propagationStack.last();
+        _propagationStack.pop_back();
+        quint16 domain = _domains.at(cell);
+
+        // Each neighbour keeps the tiles agreeing with at least one tile left here
+        for (int side = 0; side < nbSides; side++) {
+            int next = neighbour(cell, side);
+            if (next == -1)
+                continue;
+
+            int opposite = (side+2)%nbSides;
+            quint16 allowed = 0;
+            if (domain & SIDE_SET[side])
+                allowed |= SIDE_SET[opposite];
+            if (domain & quint16(~SIDE_SET[side]))
+                allowed |= quint16(~SIDE_SET[opposite]);
+
+            if (!restrict(next, allowed))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool RoadGenerator::solve(void) {
+    int nbCells = _width*_length;
+    _domains.fill(VALID_TILES, nbCells);
+    _propagationStack.clear();
+
+    // Roads don't leave the map
+    for (int cell = 0; cell < nbCells; cell++) {
+        for (int side = 0; side < nbSides; side++) {
+            if (neighbour(cell, side) == -1 && !restrict(cell, quint16(~SIDE_SET[side])))
+                return false;
+        }
+    }
+    if (!propagate())
+        return false;
+
+    // Collapse cells in scanline order, choosing among remaining tiles according to their weight
+    const Tile* tiles = tileTable().tiles;
+    for (int cell = 0; cell < nbCells; cell++) {
+        quint16 domain = _domains.at(cell);
+
+        int totalWeight = 0;
+        for (int mask = 0; mask < 16; mask++) {
+            if (domain & (1 << mask))
+                totalWeight += tiles[mask].weight;
+        }
+
+        int choice = random() % totalWeight;
+        int mask = 0;
+        for (; mask < 16; mask++) {
+            if (domain & (1 << mask)) {
+                choice -= tiles[mask].weight;
+                if (choice < 0)
+                    break;
+            }
+        }
+
+        if (!restrict(cell, 1 << mask) || !propagate())
+            return false;
+    }
+
+    return true;
+}
+
+const QVector<RoadGenerator::Placement>& RoadGenerator::generate(void) {
+    PROFILE_SCOPE("RoadGenerator::generate");
+
+    _placements.clear();
+    _roads.clear();
+
+    if (_width <= 0 || _length <= 0)
+        return _placements;
+
+    // Contradictions are rare, random numbers go on so the result only depends on the seed
+    bool solved = false;
+    for (int attempt = 0; attempt < MAX_ATTEMPTS && !solved; attempt++)
+        solved = solve();
+
+    if (!solved) {
+        qDebug() << "Cannot solve road constraints within RoadGenerator::generate";
+        return _placements;
+    }
+
+    // Record roads and the pieces to place
+    const Tile* tiles = tileTable().tiles;
+    int nbCells = _width*_length;
+    _roads.resize(4*nbCells);
+    _placements.reserve(nbCells);
+    for (int cell = 0; cell < nbCells; cell++) {
+        // Domains of solved cells hold a single tile
+        int mask = 0;
+        while (!(_domains.at(cell) & (1 << mask)))
+            mask++;
+
+        for (int side = 0; side < nbSides; side++)
+            _roads.setBit(4*cell+side, mask & (1 << side));
+
+        Placement placement;
+        placement.i = cell / _length;
+        placement.j = cell % _length;
+        placement.roadType = tiles[mask].roadType;
+        placement.nbRotations = tiles[mask].nbRotations;
+        _placements << placement;
+    }
+
+    return _placements;
+}
+
+RoadGenerator::RoadGrid RoadGenerator::getRoadGrid(const osg::Vec3& origin) const {
+    RoadGrid roadGrid;
+    roadGrid.width = _width;
+    roadGrid.length = _length;
+    roadGrid.origin = origin;
+
+    // Nothing generated yet, or no solution: no road at all
+    int nbCells = _roads.size()/nbSides;
+    roadGrid.sideMasks.fill(0, qMax(0, _width*_length));
+    for (int cell = 0; cell < nbCells; cell++) {
+        for (int side = 0; side < nbSides; side++) {
+            if (_roads.testBit(4*cell+side))
+                roadGrid.sideMasks[cell] |= 1 << side;
+        }
+    }
+
+    return roadGrid;
+}
@@ -0,0 +1,67 @@
+#ifndef ROADGENERATOR_H
+#define ROADGENERATOR_H
+
+#include <QVector>
+#include <QBitArray>
+
+#include <osg/Vec3>
+
+#include "Road.h"
+
+class RoadGenerator {
+
+public:
+    // Road tile to place at cell (i, j), turned nbRotations quarter turns like World::rotation(true)
+    struct Placement {
+        int i;
+        int j;
+        Road::RoadType roadType;
+        int nbRotations;
+    };
+
+    // Sides of a cell, as recorded in the road grid
+    enum Side { left, top, right, bottom, nbSides };
+
+    // Roads of a whole map: one side mask per cell, cell (i, j) being centered on origin + 32 studs * (i, j)
+    struct RoadGrid {
+        int width;
+        int length;
+        QVector<quint8> sideMasks;
+        osg::Vec3 origin;
+
+        int sideMask(int i, int j) const { return sideMasks.at(i*length+j); }
+    };
+
+public:
+    RoadGenerator(int width, int length, quint32 seed);
+
+    const QVector<Placement>& generate(void);
+
+    static void tile(int sideMask, Road::RoadType& roadType, int& nbRotations);
+
+    const QVector<Placement>& getPlacements(void) const { return _placements; }
+    bool hasRoad(int i, int j, Side side) const { return _roads.testBit(4*(i*_length+j)+side); }
+    RoadGrid getRoadGrid(const osg::Vec3& origin) const;
+
+private:
+    quint32 random(void);
+    bool solve(void);
+    bool restrict(int cell, quint16 allowed);
+    bool propagate(void);
+    int neighbour(int cell, int side) const;
+
+private:
+    int _width;
+    int _length;
+    quint32 _state;
+
+    // Possible tiles of every cell, one bit per side mask
+    QVector<quint16> _domains;
+    QVector<int> _propagationStack;
+
+    // 4 bits per cell, one per side: true when a road leaves the cell on this side
+    QBitArray _roads;
+    QVector<Placement> _placements;
+};
+
+#endif // ROADGENERATOR_H
@@ -1,11 +1,17 @@
 #include "RoadNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osgDB/ReadFile>
-#include <osg/TextureRectangle>
-#include <osg/TexMat>
+#include <osg/Texture2D>
+
+#include <QMutex>
+#include <QHash>
+#include <QPair>
+#include <QDebug>
 
 #include <cmath>
+#include <cstring>
 
 
 RoadNode::RoadNode() :
@@ -22,20 +28,105 @@ RoadNode::RoadNode(const RoadNode& roadNode) :
     LegoNode(roadNode) {
 }
 
+namespace {
+    // Road textures share a 2x2 atlas, in Road::RoadType order
+    const char* ROAD_IMAGES[] = { "../LEGO_CREATOR/IMG/Straightb.png", "../LEGO_CREATOR/IMG/Curveb.png",
+                                  "../LEGO_CREATOR/IMG/Intersectionb.png", "../LEGO_CREATOR/IMG/Crossb.png" };
+    // Size of each road within the atlas, power of two so that the atlas can be mipmapped
+    const int ATLAS_TILE_SIZE = 512;
+    // Mipmap levels used on the atlas, and padding around each road so that these levels never mix two roads
+    const int ATLAS_MIPMAP_LEVELS = 4;
+    const int ATLAS_PADDING = 1 << ATLAS_MIPMAP_LEVELS;
+
+    // Road subgraphs only depend on road type and color, so they are built once and shared by every road
+    QMutex sharedRoadsMutex;
+    QHash<QPair<int, QRgb>, osg::ref_ptr<osg::Group> > sharedRoads;
+    osg::ref_ptr<osg::StateSet> atlasStateSet;
+
+    // Smaller mipmaps would average the padding away, so sampling stops at ATLAS_MIPMAP_LEVELS
+    class AtlasTexture : public osg::Texture2D {
+    public:
+        AtlasTexture(osg::Image* image) :
+            osg::Texture2D(image) {
+        }
+
+        virtual void apply(osg::State& state) const {
+            osg::Texture2D::apply(state);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ATLAS_MIPMAP_LEVELS);
+        }
+    };
+
+    // Road images differ in format, so they are copied texel per texel into an RGBA atlas
+    osg::StateSet* createAtlasStateSet(void) {
+        osg::ref_ptr<osg::Image> atlas = new osg::Image;
+        atlas->allocateImage(2*ATLAS_TILE_SIZE, 2*ATLAS_TILE_SIZE, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+        memset(atlas->data(), 255, atlas->getTotalSizeInBytes());
+
+        for (int k = 0; k < 4; k++) {
+            osg::ref_ptr<osg::Image> image = osgDB::readImageFile(ROAD_IMAGES[k]);
+            if (!image) {
+                qDebug() << "Cannot read" << ROAD_IMAGES[k] << "within RoadNode createAtlasStateSet";
+                continue;
+            }
+
+            // Road fills the tile minus the padding, which repeats the road edges
+            int originS = (k%2)*ATLAS_TILE_SIZE;
+            int originT = (k/2)*ATLAS_TILE_SIZE;
+            int roadSize = ATLAS_TILE_SIZE - 2*ATLAS_PADDING;
+            for (int t = 0; t < ATLAS_TILE_SIZE; t++) {
+                int roadT = osg::clampBetween(t - ATLAS_PADDING, 0, roadSize-1);
+                for (int s = 0; s < ATLAS_TILE_SIZE; s++) {
+                    int roadS = osg::clampBetween(s - ATLAS_PADDING, 0, roadSize-1);
+                    osg::Vec4 color = image->getColor(roadS*image->s()/roadSize, roadT*image->t()/roadSize);
+                    unsigned char* texel = atlas->data(originS+s, originT+t);
+                    for (int c = 0; c < 4; c++)
+                        texel[c] = static_cast<unsigned char>(osg::clampBetween(color[c], 0.0f, 1.0f)*255.0f);
+                }
+            }
+        }
+
+        osg::ref_ptr<osg::Texture2D> texture = new AtlasTexture(atlas.get());
+        texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+        texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+        texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR_MIPMAP_LINEAR);
+        texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+
+        osg::ref_ptr<osg::StateSet> stateSet = new osg::StateSet;
+        stateSet->setTextureAttributeAndModes(0, texture.get(), osg::StateAttribute::ON);
+        stateSet->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+        return stateSet.release();
+    }
+}
+
 void RoadNode::createGeode(void) {
+    PROFILE_SCOPE("RoadNode::createGeode");
+
     // Remove previous children
     removeChildren(0, getNumChildren());
 
-    // Create geode
-    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
-    // add geode
-    addChild(geode);
-
     // Get the road
     Road* road = static_cast<Road*>(_lego);
 
-    // Get road type
-    Road::RoadType roadType = road->getRoadType();
+    // Roads are built within generator threads too
+    QMutexLocker locker(&sharedRoadsMutex);
+
+    // Every road of the same type and color shares its quads, texture and plots: rotation is within the matrix transform
+    QPair<int, QRgb> key(road->getRoadType(), road->getColor().rgba());
+    osg::ref_ptr<osg::Group>& sharedRoad = sharedRoads[key];
+    if (!sharedRoad)
+        sharedRoad = createRoad(road->getRoadType());
+
+    addChild(sharedRoad.get());
+}
+
+osg::Group* RoadNode::createRoad(Road::RoadType roadType) const {
+    osg::ref_ptr<osg::Group> group = new osg::Group;
+    // Because roads don't move
+    group->setDataVariance(osg::Object::STATIC);
+
+    // Create geode
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    group->addChild(geode);
 
     // Get integer sizes
     int length = 32;
@@ -68,14 +159,6 @@ void RoadNode::createGeode(void) {
     verticesDown->push_back(osg::Vec3(l, b, -EPS));
     downGeometry->setVertexArray(verticesDown);
 
-    // Create texture coords for up face
-    osg::ref_ptr<osg::Vec2Array> texCoords = new osg::Vec2Array;
-    texCoords->push_back(osg::Vec2(0.0f, 0.0f));
-    texCoords->push_back(osg::Vec2(1.0f, 0.0f));
-    texCoords->push_back(osg::Vec2(1.0f, 1.0f));
-    texCoords->push_back(osg::Vec2(0.0f, 1.0f));
-    roadGeometry->setTexCoordArray(0, texCoords);
-
     // Create normal for up face...
     osg::ref_ptr<osg::Vec3Array> normalsUp = new osg::Vec3Array;
     normalsUp->push_back(osg::Vec3(0.0f, 0.0f, 1.0f));
@@ -106,69 +189,43 @@ void RoadNode::createGeode(void) {
     // and down face
     downGeometry->addPrimitiveSet(new osg::DrawArrays(GL_QUADS, 0, 4));
 
-    // Disable display list to show up the texture
-    roadGeometry->setUseDisplayList(false);
-
-    // Create image
-    osg::ref_ptr<osg::Image> img = NULL;
-    switch (roadType) {
-    case Road::straight:
-        img = osgDB::readImageFile("../LEGO_CREATOR/IMG/Straightb.png");
-        break;
-    case Road::curve:
-        img = osgDB::readImageFile("../LEGO_CREATOR/IMG/Curveb.png");
-        break;
-    case Road::intersection:
-        img = osgDB::readImageFile("../LEGO_CREATOR/IMG/Intersectionb.png");
-        break;
-    case Road::cross:
-        img = osgDB::readImageFile("../LEGO_CREATOR/IMG/Crossb.png");
-        break;
-    case Road::none:
-        img = NULL;
-        break;
-    }
-
-    // Get state
-    osg::ref_ptr<osg::StateSet> state = roadGeometry->getOrCreateStateSet();
-
-    // If the road exists
+    // If the road exists, its texture is a quarter of the atlas
     if (roadType != Road::none) {
-        // Set texture
-        osg::ref_ptr<osg::TextureRectangle> tex = new osg::TextureRectangle(img);
-
-        osg::ref_ptr<osg::TexMat> texMat = new osg::TexMat;
-        texMat->setScaleByTextureRectangleSize(true);
-
-        // Set state
-        state->setTextureAttributeAndModes(0, tex, osg::StateAttribute::ON);
-        state->setTextureAttributeAndModes(0, texMat, osg::StateAttribute::ON);
+        if (!atlasStateSet)
+            atlasStateSet = createAtlasStateSet();
+        roadGeometry->setStateSet(atlasStateSet.get());
+
+        // Skip the padding, so that neighbour roads of the atlas don't bleed on the edges
+        double inset = static_cast<double>(ATLAS_PADDING)/(2*ATLAS_TILE_SIZE);
+        double s0 = (roadType%2)*0.5 + inset;
+        double s1 = (roadType%2)*0.5 + 0.5 - inset;
+        double t0 = (roadType/2)*0.5 + inset;
+        double t1 = (roadType/2)*0.5 + 0.5 - inset;
+
+        osg::ref_ptr<osg::Vec2Array> texCoords = new osg::Vec2Array;
+        texCoords->push_back(osg::Vec2(s0, t0));
+        texCoords->push_back(osg::Vec2(s1, t0));
+        texCoords->push_back(osg::Vec2(s1, t1));
+        texCoords->push_back(osg::Vec2(s0, t1));
+        roadGeometry->setTexCoordArray(0, texCoords);
+    } else {
+        // Turn off light for grass up face
+        roadGeometry->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
     }
 
-    // Turn off light for up face...
-    state->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
     // ... and for down face
     downGeometry->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
 
-    // Set drawables to this (RoadNode)
-    geode->removeDrawables(0, geode->getDrawableList().size());
-    geode->addDrawable(roadGeometry.release());
-    geode->addDrawable(downGeometry.release());
+    geode->addDrawable(roadGeometry.get());
+    geode->addDrawable(downGeometry.get());
 
     // Calculate plots according to road shape
-    calculatePlots();
-}
-
-void RoadNode::calculatePlots(void) {
-    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
-    addChild(geode);
+    calculatePlots(group.get(), roadType);
 
-    // Get the brick
-    Road* road = static_cast<Road*>(_lego);
-
-    // Get brick type
-    Road::RoadType roadType = road->getRoadType();
+    return group.release();
+}
 
+void RoadNode::calculatePlots(osg::Group* group, Road::RoadType roadType) const {
     // Distance between two plots equal to Lego length unit
     double distPlot = Lego::length_unit;
 
@@ -180,10 +237,10 @@ void RoadNode::calculatePlots(void) {
             // There are two regions to add plots: the four corners
             for (int j = 0; j < 32; j++) {
                 // left side
-                addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 // Right side
-                addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(19*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
             }
         }
@@ -193,7 +250,7 @@ void RoadNode::calculatePlots(void) {
             for (int j = 0; j < 32; j++) {
                 // Above the curve OR Under the curve
                 if (i*i+j*j >= 25*25 || i*i+j*j <= 6*6) {
-                    addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
+                    group->addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                     //geode->addDrawable(createPlotTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 }
             }
@@ -205,15 +262,15 @@ void RoadNode::calculatePlots(void) {
             // There are three regions to add plots: the four corners
             for (int j = 0; j < 32; j++) {
                 // left side
-                addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
             }
             for (int j = 0; j < 7; j++) {
                 // Top right corner
-                addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, 19*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, 19*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(19*distPlot/2+i*distPlot, 19*distPlot/2+j*distPlot, EPS));
                 // Bottom right corner
-                addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(19*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
             }
         }
@@ -224,16 +281,16 @@ void RoadNode::calculatePlots(void) {
             // There are four regions to add plots: the four corners
             for (int j = 0; j < 7; j++) {
                 // Top left corner
-                addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, 19*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, 19*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(-31*distPlot/2+i*distPlot, 19*distPlot/2+j*distPlot, EPS));
                 // Top right corner
-                addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, 19*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, 19*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(19*distPlot/2+i*distPlot, 19*distPlot/2+j*distPlot, EPS));
                 // Bottom left corner
-                addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 // Bottom right corner
-                addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(19*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(19*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
             }
         }
@@ -242,7 +299,7 @@ void RoadNode::calculatePlots(void) {
         // No road
         for (int i = 0; i < 32; i++) {
             for (int j = 0; j < 32; j++) {
-                addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
+                group->addChild(createPlotCylinderAndTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
                 //geode->addDrawable(createPlotTop(-31*distPlot/2+i*distPlot, -31*distPlot/2+j*distPlot, EPS));
             }
         }
@@ -12,9 +12,12 @@ public:
     RoadNode(const RoadNode& roadNode);
 
     virtual void createGeode(void);
-    virtual void calculatePlots(void);
 
     virtual RoadNode* cloning(void) const;
+
+private:
+    osg::Group* createRoad(Road::RoadType roadType) const;
+    void calculatePlots(osg::Group* group, Road::RoadType roadType) const;
 };
 
 #endif // RoadNode_H
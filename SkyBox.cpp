@@ -1,9 +1,33 @@
 #include "SkyBox.h"
 
+#include <QtConcurrentRun>
+#include <QFile>
+#include <QDebug>
+
 #include <osg/Depth>
+#include <osgDB/ReadFile>
 #include <osgUtil/CullVisitor>
 
-SkyBox::SkyBox() {
+namespace {
+    // Faces in setEnvironmentMap order
+    const char* FACE_NAMES[6] = { "right", "left", "front", "back", "top", "bottom" };
+    // Pre-compressed faces are preferred, they come with their own mipmaps
+    const char* FACE_EXTENSIONS[3] = { "dds", "ktx", "png" };
+
+    // Cube map is set by the update traversal, only while faces are read
+    class LoadingCallback : public osg::NodeCallback {
+    public:
+        virtual void operator()(osg::Node* node, osg::NodeVisitor* nv) {
+            static_cast<SkyBox*>(node)->finishLoading();
+            traverse(node, nv);
+        }
+    };
+}
+
+SkyBox::SkyBox() :
+    _loadingUnit(0),
+    _hidden(0) {
+
     setReferenceFrame(osg::Transform::ABSOLUTE_RF);
     setCullingActive(false);
 
@@ -14,7 +38,7 @@ SkyBox::SkyBox() {
     ss->setRenderBinDetails(5, "RenderBin");
 }
 
-void SkyBox::setEnvironmentMap(unsigned int unit, osg::Image* posX, osg::Image* negX,
+bool SkyBox::setEnvironmentMap(unsigned int unit, osg::Image* posX, osg::Image* negX,
                                                   osg::Image* posY, osg::Image* negY,
                                                   osg::Image* posZ, osg::Image* negZ) {
 
@@ -32,13 +56,84 @@ void SkyBox::setEnvironmentMap(unsigned int unit, osg::Image* posX, osg::Image*
         cubemap->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
         cubemap->setWrap(osg::Texture::WRAP_R, osg::Texture::CLAMP_TO_EDGE);
 
-        cubemap->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR_MIPMAP_LINEAR);
+        // Mipmaps are read with compressed faces, and can only be generated for the other ones
+        bool compressed = osg::Texture::isCompressedInternalFormat(posX->getInternalTextureFormat());
+        if (compressed && !posX->isMipmap())
+            cubemap->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+        else
+            cubemap->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR_MIPMAP_LINEAR);
         cubemap->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
 
         cubemap->setResizeNonPowerOfTwoHint(false);
 
-        getOrCreateStateSet()->setTextureAttributeAndModes(unit, cubemap.get());
+        // The current state may still be drawn by the other viewer: a new one replaces it,
+        // and the delete handler keeps the old one until it is not drawn anymore
+        osg::ref_ptr<osg::StateSet> stateSet = new osg::StateSet(*getOrCreateStateSet(), osg::CopyOp::SHALLOW_COPY);
+        stateSet->setTextureAttributeAndModes(unit, cubemap.get());
+        setStateSet(stateSet.get());
     }
+
+    // Check the cube map is really there
+    return dynamic_cast<osg::TextureCubeMap*>(getOrCreateStateSet()->getTextureAttribute(unit, osg::StateAttribute::TEXTURE)) != NULL;
+}
+
+void SkyBox::loadEnvironmentMap(unsigned int unit, const QString& directory) {
+    // Not drawn until its faces are read, so that the camera clear color is seen meanwhile.
+    // The node itself stays traversed, its update callback has to be called
+    _hidden.exchange(1);
+
+    _loadingUnit = unit;
+    _loading = QtConcurrent::run(readFaces, directory);
+
+    if (!_loadingCallback)
+        _loadingCallback = new LoadingCallback;
+    setUpdateCallback(_loadingCallback.get());
+}
+
+void SkyBox::finishLoading(void) {
+    if (!_loading.isFinished())
+        return;
+
+    // No more update traversal, frames are drawn on demand again
+    setUpdateCallback(NULL);
+
+    QVector<osg::ref_ptr<osg::Image> > faces = _loading.result();
+    _loading = QFuture<QVector<osg::ref_ptr<osg::Image> > >();
+    for (int k = 0; k < faces.size(); k++) {
+        if (!faces.at(k))
+            return;
+    }
+
+    if (!setEnvironmentMap(_loadingUnit, faces.at(0).get(), faces.at(1).get(), faces.at(2).get(),
+                                         faces.at(3).get(), faces.at(4).get(), faces.at(5).get())) {
+        qDebug() << "Cube map not installed within SkyBox::finishLoading";
+        return;
+    }
+    _hidden.exchange(0);
+}
+
+void SkyBox::traverse(osg::NodeVisitor& nv) {
+    // Children are drawn once the cube map is installed, cull threads read the flag while the GUI thread sets it
+    if (_hidden != 0 && nv.getVisitorType() == osg::NodeVisitor::CULL_VISITOR)
+        return;
+
+    osg::Transform::traverse(nv);
+}
+
+QVector<osg::ref_ptr<osg::Image> > SkyBox::readFaces(const QString& directory) {
+    QVector<osg::ref_ptr<osg::Image> > faces(6);
+    for (int k = 0; k < 6; k++) {
+        for (int e = 0; e < 3 && !faces.at(k); e++) {
+            QString fileName = directory + "/" + FACE_NAMES[k] + "." + FACE_EXTENSIONS[e];
+            if (QFile::exists(fileName))
+                faces[k] = osgDB::readImageFile(fileName.toStdString());
+        }
+
+        if (!faces.at(k))
+            qDebug() << "Cannot read" << FACE_NAMES[k] << "face from" << directory << "within SkyBox::readFaces";
+    }
+
+    return faces;
 }
 
 bool SkyBox::computeLocalToWorldMatrix(osg::Matrix& matrix, osg::NodeVisitor* nv) const {
@@ -1,25 +1,43 @@
 #ifndef SKYBOX_H
 #define SKYBOX_H
 
+#include <QString>
+#include <QVector>
+#include <QFuture>
+
 #include <osg/TextureCubeMap>
 #include <osg/Transform>
+#include <osg/NodeCallback>
+#include <OpenThreads/Atomic>
 
 class SkyBox : public osg::Transform {
 public:
     SkyBox();
-    SkyBox(const SkyBox& copy, osg::CopyOp copyop = osg::CopyOp::SHALLOW_COPY) : osg::Transform(copy, copyop) {}
+    SkyBox(const SkyBox& copy, osg::CopyOp copyop = osg::CopyOp::SHALLOW_COPY) : osg::Transform(copy, copyop), _loadingUnit(0), _hidden(0) {}
 
     META_Node(osg, SkyBox)
 
-    void setEnvironmentMap(unsigned int unit, osg::Image* posX, osg::Image* negX,
+    bool setEnvironmentMap(unsigned int unit, osg::Image* posX, osg::Image* negX,
                                               osg::Image* posY, osg::Image* negY,
                                               osg::Image* posZ, osg::Image* negZ);
+    void loadEnvironmentMap(unsigned int unit, const QString& directory);
+    void finishLoading(void);
+
+    virtual void traverse(osg::NodeVisitor& nv);
 
     virtual bool computeLocalToWorldMatrix( osg::Matrix& matrix, osg::NodeVisitor* nv ) const;
     virtual bool computeWorldToLocalMatrix( osg::Matrix& matrix, osg::NodeVisitor* nv ) const;
 
 protected:
     virtual ~SkyBox() {}
+
+    static QVector<osg::ref_ptr<osg::Image> > readFaces(const QString& directory);
+
+protected:
+    QFuture<QVector<osg::ref_ptr<osg::Image> > > _loading;
+    unsigned int _loadingUnit;
+    OpenThreads::Atomic _hidden;
+    osg::ref_ptr<osg::NodeCallback> _loadingCallback;
 };
 
 #endif // SKYBOX_H
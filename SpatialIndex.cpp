@@ -0,0 +1,403 @@
+#include "SpatialIndex.h"
+
+#include <osg/ComputeBoundsVisitor>
+
+#include <algorithm>
+#include <limits>
+
+// Number of pieces stored in a BVH leaf, which is split once it holds twice as many
+#define LEAF_SIZE 4
+
+namespace {
+    // Sort positions according to their box center along one axis
+    struct AxisLess {
+        AxisLess(const QVector<osg::Vec3>& centers, int axis) : _centers(centers), _axis(axis) {}
+        bool operator()(int a, int b) const { return _centers.at(a)[_axis] < _centers.at(b)[_axis]; }
+        const QVector<osg::Vec3>& _centers;
+        int _axis;
+    };
+
+    bool hitLess(const SpatialIndex::Hit& a, const SpatialIndex::Hit& b) {
+        return a.ratio < b.ratio;
+    }
+
+    // Half of the box surface, which measures how likely a random ray hits it
+    double halfArea(const osg::BoundingBox& box) {
+        if (!box.valid())
+            return 0.0;
+
+        osg::Vec3 extent = box._max - box._min;
+        return extent[0]*extent[1] + extent[1]*extent[2] + extent[2]*extent[0];
+    }
+
+    // Surface added to a node box by a new box
+    double enlargement(const osg::BoundingBox& nodeBox, const osg::BoundingBox& box) {
+        osg::BoundingBox unionBox(nodeBox);
+        unionBox.expandBy(box);
+        return halfArea(unionBox) - halfArea(nodeBox);
+    }
+}
+
+SpatialIndex::SpatialIndex(void) {
+}
+
+void SpatialIndex::insert(osg::MatrixTransform* matrixTransform) {
+    // Already indexed pieces are only moved
+    if (_itemIndex.contains(matrixTransform)) {
+        update(matrixTransform);
+        return;
+    }
+
+    // Compute piece box once, in its own coordinates: moves only change its world box, see updateShape otherwise
+    Item item;
+    item.matrixTransform = matrixTransform;
+    item.localBox = computeLocalBox(matrixTransform);
+    item.worldBox = transformBox(item.localBox, matrixTransform->getMatrix());
+    item.leaf = -1;
+
+    // Record it
+    _itemIndex.insert(matrixTransform, _items.size());
+    _items << item;
+
+    // Only the path from its leaf to the root changes, however many pieces are indexed
+    insertItem(_items.size()-1);
+}
+
+void SpatialIndex::update(osg::MatrixTransform* matrixTransform) {
+    // Get item, if indexed
+    QHash<osg::MatrixTransform*, int>::const_iterator it = _itemIndex.find(matrixTransform);
+    if (it == _itemIndex.end())
+        return;
+
+    // The piece may have gone far from its leaf: it is taken out of the tree and inserted again where it is now
+    int index = it.value();
+    removeItem(index);
+    _items[index].worldBox = transformBox(_items.at(index).localBox, matrixTransform->getMatrix());
+    insertItem(index);
+}
+
+void SpatialIndex::updateShape(osg::MatrixTransform* matrixTransform) {
+    // Get item, if indexed
+    QHash<osg::MatrixTransform*, int>::const_iterator it = _itemIndex.find(matrixTransform);
+    if (it == _itemIndex.end())
+        return;
+
+    // Geodes of the piece were replaced: its box is computed again
+    _items[it.value()].localBox = computeLocalBox(matrixTransform);
+    update(matrixTransform);
+}
+
+void SpatialIndex::remove(osg::MatrixTransform* matrixTransform) {
+    // Get item, if indexed
+    QHash<osg::MatrixTransform*, int>::iterator it = _itemIndex.find(matrixTransform);
+    if (it == _itemIndex.end())
+        return;
+
+    // Take it out of the tree
+    int index = it.value();
+    _itemIndex.erase(it);
+    removeItem(index);
+
+    // Swap with last item to keep items contiguous, its leaf refers to it by index
+    int last = _items.size()-1;
+    if (index != last) {
+        _items[index] = _items.at(last);
+        _itemIndex[_items.at(index).matrixTransform] = index;
+        QVector<int>& leafItems = _nodes[_items.at(index).leaf].items;
+        leafItems[leafItems.indexOf(last)] = index;
+    }
+    _items.pop_back();
+}
+
+void SpatialIndex::clear(void) {
+    _items.clear();
+    _itemIndex.clear();
+    _nodes.clear();
+    _freeNodes.clear();
+}
+
+osg::BoundingBox SpatialIndex::getBoundingBox(osg::MatrixTransform* matrixTransform) const {
+    // Return world box of the piece, or an invalid box if unknown
+    QHash<osg::MatrixTransform*, int>::const_iterator it = _itemIndex.find(matrixTransform);
+    if (it == _itemIndex.end())
+        return osg::BoundingBox();
+
+    return _items.at(it.value()).worldBox;
+}
+
+void SpatialIndex::intersect(const osg::Vec3& start, const osg::Vec3& end, QVector<Hit>& hits) {
+    hits.clear();
+
+    if (_nodes.isEmpty())
+        return;
+
+    // Precompute inverse direction for slab tests
+    osg::Vec3 dir = end - start;
+    osg::Vec3 invDir;
+    for (int k = 0; k < 3; k++)
+        invDir[k] = (dir[k] != 0.0f) ? 1.0f/dir[k] : std::numeric_limits<float>::max();
+
+    // Iterative traversal, so deep trees cannot overflow the stack
+    QVector<int> stack;
+    stack.reserve(64);
+    stack << 0;
+    while (!stack.isEmpty()) {
+        const Node& node = _nodes.at(stack.last());
+        stack.pop_back();
+
+        double ratio;
+        if (!intersectRay(node.box, start, invDir, ratio))
+            continue;
+
+        // Leaf: test every piece box
+        if (node.left < 0) {
+            for (int k = 0; k < node.items.size(); k++) {
+                const Item& item = _items.at(node.items.at(k));
+                if (intersectRay(item.worldBox, start, invDir, ratio)) {
+                    Hit hit;
+                    hit.matrixTransform = item.matrixTransform;
+                    hit.ratio = ratio;
+                    hits << hit;
+                }
+            }
+        // Inner node: go on with children
+        } else {
+            stack << node.left << node.right;
+        }
+    }
+
+    // Nearest pieces first
+    std::sort(hits.begin(), hits.end(), hitLess);
+}
+
+void SpatialIndex::select(const osg::Polytope& polytope, QVector<osg::MatrixTransform*>& pieces) {
+    pieces.clear();
+
+    if (_nodes.isEmpty())
+        return;
+
+    // Polytope tests record which planes are still relevant, so work on a copy
+    osg::Polytope frustum(polytope);
+
+    // Only boxes are tested: selecting thousands of pieces never goes down to triangles
+    QVector<int> stack;
+    stack.reserve(64);
+    stack << 0;
+    while (!stack.isEmpty()) {
+        int nodeIndex = stack.last();
+        const Node& node = _nodes.at(nodeIndex);
+        stack.pop_back();
+
+        if (!node.box.valid() || !frustum.contains(node.box))
+            continue;
+
+        // Whole node within the frustum: take every piece below without further tests
+        if (frustum.containsAllOf(node.box)) {
+            addSubtree(nodeIndex, pieces);
+            continue;
+        }
+
+        // Leaf: test every piece box
+        if (node.left < 0) {
+            for (int k = 0; k < node.items.size(); k++) {
+                const Item& item = _items.at(node.items.at(k));
+                if (item.worldBox.valid() && frustum.contains(item.worldBox))
+                    pieces << item.matrixTransform;
+            }
+        // Inner node: go on with children
+        } else {
+            stack << node.left << node.right;
+        }
+    }
+}
+
+void SpatialIndex::addSubtree(int nodeIndex, QVector<osg::MatrixTransform*>& pieces) const {
+    const Node& node = _nodes.at(nodeIndex);
+    if (node.left < 0) {
+        for (int k = 0; k < node.items.size(); k++)
+            pieces << _items.at(node.items.at(k)).matrixTransform;
+    } else {
+        addSubtree(node.left, pieces);
+        addSubtree(node.right, pieces);
+    }
+}
+
+osg::BoundingBox SpatialIndex::computeLocalBox(osg::MatrixTransform* matrixTransform) {
+    // Box of the piece in its own coordinates
+    osg::ComputeBoundsVisitor cbv;
+    for (unsigned int k = 0; k < matrixTransform->getNumChildren(); k++)
+        matrixTransform->getChild(k)->accept(cbv);
+    return cbv.getBoundingBox();
+}
+
+osg::BoundingBox SpatialIndex::transformBox(const osg::BoundingBox& box, const osg::Matrix& matrix) {
+    // Transform the 8 corners and take their bounds
+    osg::BoundingBox worldBox;
+    if (box.valid()) {
+        for (unsigned int k = 0; k < 8; k++)
+            worldBox.expandBy(box.corner(k) * matrix);
+    }
+    return worldBox;
+}
+
+bool SpatialIndex::intersectRay(const osg::BoundingBox& box, const osg::Vec3& start, const osg::Vec3& invDir, double& ratio) {
+    if (!box.valid())
+        return false;
+
+    // Slab test on segment [0, 1]
+    double tmin = 0.0;
+    double tmax = 1.0;
+    for (int k = 0; k < 3; k++) {
+        double t0 = (box._min[k] - start[k]) * invDir[k];
+        double t1 = (box._max[k] - start[k]) * invDir[k];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
+        if (tmin > tmax)
+            return false;
+    }
+
+    ratio = tmin;
+    return true;
+}
+
+int SpatialIndex::createNode(int parent) {
+    Node node;
+    node.parent = parent;
+    node.left = -1;
+    node.right = -1;
+
+    // Nodes freed by removals are used again first
+    if (!_freeNodes.isEmpty()) {
+        int nodeIndex = _freeNodes.last();
+        _freeNodes.pop_back();
+        _nodes[nodeIndex] = node;
+        return nodeIndex;
+    }
+
+    _nodes << node;
+    return _nodes.size()-1;
+}
+
+void SpatialIndex::insertItem(int itemIndex) {
+    if (_nodes.isEmpty())
+        createNode(-1);
+
+    // Go down the child whose box grows the least
+    const osg::BoundingBox& box = _items.at(itemIndex).worldBox;
+    int nodeIndex = 0;
+    while (_nodes.at(nodeIndex).left >= 0) {
+        const Node& node = _nodes.at(nodeIndex);
+        if (enlargement(_nodes.at(node.left).box, box) <= enlargement(_nodes.at(node.right).box, box))
+            nodeIndex = node.left;
+        else
+            nodeIndex = node.right;
+    }
+
+    _nodes[nodeIndex].items << itemIndex;
+    _items[itemIndex].leaf = nodeIndex;
+
+    if (_nodes.at(nodeIndex).items.size() > 2*LEAF_SIZE)
+        splitLeaf(nodeIndex);
+    refitPath(nodeIndex);
+}
+
+void SpatialIndex::removeItem(int itemIndex) {
+    int leaf = _items.at(itemIndex).leaf;
+    QVector<int>& leafItems = _nodes[leaf].items;
+    leafItems.remove(leafItems.indexOf(itemIndex));
+    _items[itemIndex].leaf = -1;
+
+    // Empty leaves are removed, but the root
+    if (leafItems.isEmpty() && _nodes.at(leaf).parent >= 0)
+        collapseLeaf(leaf);
+    else
+        refitPath(leaf);
+}
+
+void SpatialIndex::splitLeaf(int nodeIndex) {
+    QVector<int> items = _nodes.at(nodeIndex).items;
+
+    // Split at median along the longest axis of the box centers
+    QVector<osg::Vec3> centers(items.size());
+    QVector<int> positions(items.size());
+    osg::BoundingBox centerBox;
+    for (int k = 0; k < items.size(); k++) {
+        centers[k] = _items.at(items.at(k)).worldBox.center();
+        positions[k] = k;
+        centerBox.expandBy(centers.at(k));
+    }
+    osg::Vec3 extent = centerBox._max - centerBox._min;
+    int axis = 0;
+    if (extent[1] > extent[axis])
+        axis = 1;
+    if (extent[2] > extent[axis])
+        axis = 2;
+
+    int half = items.size()/2;
+    std::nth_element(positions.begin(), positions.begin()+half, positions.end(), AxisLess(centers, axis));
+
+    // The leaf becomes the parent of two new leaves
+    int left = createNode(nodeIndex);
+    int right = createNode(nodeIndex);
+    for (int k = 0; k < positions.size(); k++) {
+        int child = (k < half) ? left : right;
+        int itemIndex = items.at(positions.at(k));
+        _nodes[child].items << itemIndex;
+        _items[itemIndex].leaf = child;
+    }
+    refitNode(left);
+    refitNode(right);
+
+    Node& node = _nodes[nodeIndex];
+    node.items.clear();
+    node.left = left;
+    node.right = right;
+}
+
+void SpatialIndex::collapseLeaf(int nodeIndex) {
+    int parent = _nodes.at(nodeIndex).parent;
+    int sibling = (_nodes.at(parent).left == nodeIndex) ? _nodes.at(parent).right : _nodes.at(parent).left;
+
+    // The sibling takes the place of its parent, so that the root always stays node 0
+    Node& parentNode = _nodes[parent];
+    const Node& siblingNode = _nodes.at(sibling);
+    parentNode.box = siblingNode.box;
+    parentNode.left = siblingNode.left;
+    parentNode.right = siblingNode.right;
+    parentNode.items = siblingNode.items;
+
+    if (parentNode.left >= 0) {
+        _nodes[parentNode.left].parent = parent;
+        _nodes[parentNode.right].parent = parent;
+    }
+    for (int k = 0; k < parentNode.items.size(); k++)
+        _items[parentNode.items.at(k)].leaf = parent;
+
+    _nodes[nodeIndex].items.clear();
+    _nodes[sibling].items.clear();
+    _freeNodes << nodeIndex << sibling;
+
+    refitPath(_nodes.at(parent).parent);
+}
+
+void SpatialIndex::refitNode(int nodeIndex) {
+    Node& node = _nodes[nodeIndex];
+    node.box.init();
+    if (node.left < 0) {
+        for (int k = 0; k < node.items.size(); k++)
+            node.box.expandBy(_items.at(node.items.at(k)).worldBox);
+    } else {
+        node.box.expandBy(_nodes.at(node.left).box);
+        node.box.expandBy(_nodes.at(node.right).box);
+    }
+}
+
+void SpatialIndex::refitPath(int nodeIndex) {
+    // Boxes from the given node up to the root
+    while (nodeIndex >= 0) {
+        refitNode(nodeIndex);
+        nodeIndex = _nodes.at(nodeIndex).parent;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QVector>
+#include <QHash>
+
+#include <osg/BoundingBox>
+#include <osg/MatrixTransform>
+#include <osg/Polytope>
+
+class SpatialIndex {
+
+public:
+    // A piece hit by a ray, with the ray ratio [0, 1] where it enters the piece box
+    struct Hit {
+        osg::MatrixTransform* matrixTransform;
+        double ratio;
+    };
+
+public:
+    SpatialIndex(void);
+
+    void insert(osg::MatrixTransform* matrixTransform);
+    void update(osg::MatrixTransform* matrixTransform);
+    void updateShape(osg::MatrixTransform* matrixTransform);
+    void remove(osg::MatrixTransform* matrixTransform);
+    void clear(void);
+
+    int size(void) const { return _items.size(); }
+    osg::BoundingBox getBoundingBox(osg::MatrixTransform* matrixTransform) const;
+
+    void intersect(const osg::Vec3& start, const osg::Vec3& end, QVector<Hit>& hits);
+    void select(const osg::Polytope& polytope, QVector<osg::MatrixTransform*>& pieces);
+
+private:
+    struct Item {
+        osg::MatrixTransform* matrixTransform;
+        osg::BoundingBox localBox;
+        osg::BoundingBox worldBox;
+        int leaf;
+    };
+
+    // BVH node: inner nodes use left/right children, leaves hold a few items. The root is node 0
+    struct Node {
+        osg::BoundingBox box;
+        int parent;
+        int left;
+        int right;
+        QVector<int> items;
+    };
+
+    static osg::BoundingBox computeLocalBox(osg::MatrixTransform* matrixTransform);
+    static osg::BoundingBox transformBox(const osg::BoundingBox& box, const osg::Matrix& matrix);
+    static bool intersectRay(const osg::BoundingBox& box, const osg::Vec3& start, const osg::Vec3& invDir, double& ratio);
+
+    int createNode(int parent);
+    void insertItem(int itemIndex);
+    void removeItem(int itemIndex);
+    void splitLeaf(int nodeIndex);
+    void collapseLeaf(int nodeIndex);
+    void refitNode(int nodeIndex);
+    void refitPath(int nodeIndex);
+    void addSubtree(int nodeIndex, QVector<osg::MatrixTransform*>& pieces) const;
+
+private:
+    QVector<Item> _items;
+    QHash<osg::MatrixTransform*, int> _itemIndex;
+    QVector<Node> _nodes;
+    QVector<int> _freeNodes;
+};
+
+#endif // SPATIALINDEX_H
@@ -0,0 +1,124 @@
+#include "ThumbnailRenderer.h"
+
+#include <osg/LightSource>
+
+#include "ImageWriter.h"
+
+#include <QDebug>
+
+ThumbnailRenderer::ThumbnailRenderer(int width, int height) :
+    _width(width),
+    _height(height) {
+}
+
+bool ThumbnailRenderer::init(void) {
+    // One offscreen context for the whole run
+    osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+    traits->x = 0;
+    traits->y = 0;
+    traits->width = _width;
+    traits->height = _height;
+    traits->red = 8;
+    traits->green = 8;
+    traits->blue = 8;
+    traits->alpha = 8;
+    traits->depth = 24;
+    traits->windowDecoration = false;
+    traits->pbuffer = true;
+    traits->doubleBuffer = false;
+    traits->sharedContext = 0;
+
+    osg::ref_ptr<osg::GraphicsContext> gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+
+    // Some drivers have no pbuffer, a window does the job too
+    if (!gc) {
+        qDebug() << "Cannot create pbuffer, using a window instead within ThumbnailRenderer::init";
+        traits->pbuffer = false;
+        traits->doubleBuffer = true;
+        gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+    }
+    if (!gc) {
+        qDebug() << "Cannot create graphics context within ThumbnailRenderer::init";
+        return false;
+    }
+
+    // Capture callback, images are written as compressed PNG
+    _image = new osg::Image;
+    _photoCallback = new PhotoCallback(_image.get(), "");
+    _pngOptions = new osgDB::Options("PNG_COMPRESSION 9");
+    _photoCallback->setOptions(_pngOptions.get());
+
+    // Viewer camera renders and reads back within the same buffer
+    _viewer = new osgViewer::Viewer;
+    _viewer->setThreadingModel(osgViewer::ViewerBase::SingleThreaded);
+    osg::Camera* camera = _viewer->getCamera();
+    camera->setGraphicsContext(gc.get());
+    camera->setViewport(new osg::Viewport(0, 0, _width, _height));
+    GLenum buffer = traits->doubleBuffer ? GL_BACK : GL_FRONT;
+    camera->setDrawBuffer(buffer);
+    camera->setReadBuffer(buffer);
+    camera->setClearColor(osg::Vec4(252.0/255.0, 254.0/255.0 ,234.0/255.0, 1.0));
+    camera->setPostDrawCallback(_photoCallback.get());
+
+    // Scene: lights, and the part to render
+    osg::ref_ptr<osg::Group> root = new osg::Group;
+    root->addChild(createLight(0, osg::Vec4(1.f, 1.f, 1.f, 1.f)));
+    root->addChild(createLight(1, osg::Vec4(-1.f, -1.f, -1.f, 1.f)));
+    osg::StateSet* state = root->getOrCreateStateSet();
+    state->setMode(GL_LIGHTING, osg::StateAttribute::ON);
+    state->setMode(GL_LIGHT0, osg::StateAttribute::ON);
+    state->setMode(GL_LIGHT1, osg::StateAttribute::ON);
+
+    _partGroup = new osg::Group;
+    root->addChild(_partGroup.get());
+
+    _viewer->setSceneData(root.get());
+    _viewer->realize();
+
+    return true;
+}
+
+void ThumbnailRenderer::render(osg::Node* part, const QString& fileName) {
+    // Replace previous part
+    _partGroup->removeChildren(0, _partGroup->getNumChildren());
+    _partGroup->addChild(part);
+
+    // Same point of view for every part
+    osg::Vec3 lookDir = osg::Z_AXIS+osg::Y_AXIS-osg::X_AXIS;
+    osg::Vec3 up = -osg::Y_AXIS-osg::X_AXIS+osg::Z_AXIS;
+    osg::Vec3 center = part->getBound().center();
+    double radius = part->getBound().radius();
+    osg::Camera* camera = _viewer->getCamera();
+    camera->setViewMatrixAsLookAt(center - lookDir*(radius*2.0), center, up);
+    camera->setProjectionMatrixAsPerspective(30.0f, static_cast<double>(_width)/static_cast<double>(_height), 1.0f, 10000.0f);
+
+    // Render and capture
+    _photoCallback->setFileName(fileName.toStdString());
+    _image->setUserValue("Capture", true);
+    _viewer->frame();
+}
+
+void ThumbnailRenderer::finish(void) {
+    // Last capture is still within a PBO: one more frame maps it
+    _partGroup->removeChildren(0, _partGroup->getNumChildren());
+    _viewer->frame();
+
+    // Wait for every image to be on disk
+    ImageWriter::instance()->waitForDone();
+}
+
+osg::LightSource* ThumbnailRenderer::createLight(int num, const osg::Vec4& position) {
+    osg::ref_ptr<osg::Light> light = new osg::Light;
+    light->setLightNum(num);
+    light->setAmbient(osg::Vec4(.1f, .1f, .1f, 1.f));
+    light->setDiffuse(osg::Vec4(.8f, .8f, .1f, 1.f));
+    light->setSpecular(osg::Vec4(.8f, .8f, .8f, 1.f));
+    light->setPosition(position);
+    light->setDirection(osg::Vec3(1.f, 0.f, 0.f));
+
+    osg::ref_ptr<osg::LightSource> lightSource = new osg::LightSource;
+    lightSource->setLight(light.get());
+    lightSource->setReferenceFrame(osg::LightSource::ABSOLUTE_RF);
+
+    return lightSource.release();
+}
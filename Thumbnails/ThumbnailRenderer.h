@@ -0,0 +1,34 @@
+#ifndef THUMBNAILRENDERER_H
+#define THUMBNAILRENDERER_H
+
+#include <QString>
+
+#include <osg/Group>
+#include <osg/Image>
+#include <osgViewer/Viewer>
+
+#include "PhotoCallback.h"
+
+class ThumbnailRenderer {
+
+public:
+    ThumbnailRenderer(int width, int height);
+
+    bool init(void);
+    void render(osg::Node* part, const QString& fileName);
+    void finish(void);
+
+private:
+    static osg::LightSource* createLight(int num, const osg::Vec4& position);
+
+private:
+    int _width;
+    int _height;
+    osg::ref_ptr<osgViewer::Viewer> _viewer;
+    osg::ref_ptr<osg::Group> _partGroup;
+    osg::ref_ptr<osg::Image> _image;
+    osg::ref_ptr<PhotoCallback> _photoCallback;
+    osg::ref_ptr<osgDB::Options> _pngOptions;
+};
+
+#endif // THUMBNAILRENDERER_H
@@ -0,0 +1,31 @@
+# Headless thumbnail renderer of the whole LDraw parts library
+TARGET = LEGO_Thumbnails
+
+CONFIG += console thread
+CONFIG -= app_bundle
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    main.cpp \
+    ThumbnailRenderer.cpp \
+    ../LDrawParser.cpp \
+    ../PhotoCallback.cpp \
+    ../ImageWriter.cpp \
+    ../Profiler.cpp
+
+HEADERS += \
+    ThumbnailRenderer.h \
+    ../LDrawParser.h \
+    ../PhotoCallback.h \
+    ../ImageWriter.h \
+    ../Profiler.h
+
+LIBS += \
+    -losg \
+    -losgDB \
+    -losgViewer \
+    -lOpenThreads \
+    -losgUtil \
+    -losgText \
+    -losgGA
@@ -0,0 +1,138 @@
+// Render a thumbnail of every LDraw part.
+// Usage: LEGO_Thumbnails [ldrawPath] [outputPath] [size]
+// Paths default to LDrawPath and ThumbnailsPath settings. Parts already rendered,
+// and not modified since, are skipped: an interrupted run can be launched again.
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QtConcurrentMap>
+#include <QDebug>
+
+#include "LDrawParser.h"
+#include "ThumbnailRenderer.h"
+#include "ImageWriter.h"
+
+// Parts parsed ahead of rendering
+#define BATCH_SIZE 64
+
+// Parse one part within a worker thread
+static osg::ref_ptr<osg::Node> parsePart(const QString& fileName) {
+    try {
+        LDrawParser parser(fileName);
+        return parser.createNode();
+    } catch (const LDrawParser::OpenFailed&) {
+        qDebug() << "Cannot parse" << fileName << "within parsePart";
+        return NULL;
+    }
+}
+
+int main(int argc, char** argv) {
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+
+    // Get paths from command line, or from settings
+    QSettings settings(QSettings::UserScope, "Perso", "Lego Creator");
+    QString ldrawPath = (args.size() > 1) ? args.at(1) : settings.value("LDrawPath", LDrawParser::getLDrawPath()).toString();
+    QString outputPath = (args.size() > 2) ? args.at(2) : settings.value("ThumbnailsPath", "../LEGO_CREATOR/IMG/Parts/").toString();
+    int size = (args.size() > 3) ? args.at(3).toInt() : 256;
+    if (!outputPath.endsWith('/'))
+        outputPath += '/';
+
+    LDrawParser::setLDrawPath(ldrawPath);
+    QDir().mkpath(outputPath);
+
+    // Progress file: one "part modification time" line per rendered part
+    QHash<QString, qint64> rendered;
+    QFile progressFile(outputPath + "thumbnails.progress");
+    if (progressFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        QTextStream inProgress(&progressFile);
+        while (!inProgress.atEnd()) {
+            QStringList line = inProgress.readLine().split('\t');
+            if (line.size() == 2)
+                rendered.insert(line.at(0), line.at(1).toLongLong());
+        }
+        progressFile.close();
+    }
+
+    // Keep parts not rendered yet, or modified since
+    QDir partsDir(LDrawParser::getLDrawPath() + "parts/");
+    QStringList allParts = partsDir.entryList(QStringList() << "*.dat", QDir::Files);
+    QStringList pendingParts;
+    QList<qint64> pendingTimes;
+    for (int k = 0; k < allParts.size(); k++) {
+        qint64 modified = QFileInfo(partsDir, allParts.at(k)).lastModified().toTime_t();
+        if (rendered.value(allParts.at(k), -1) != modified) {
+            pendingParts << allParts.at(k);
+            pendingTimes << modified;
+        }
+    }
+    qDebug() << allParts.size() - pendingParts.size() << "parts already rendered," << pendingParts.size() << "to go";
+
+    // Single offscreen context for every part
+    ThumbnailRenderer renderer(size, size);
+    if (!renderer.init())
+        return 1;
+
+    if (!progressFile.open(QIODevice::Append | QIODevice::Text)) {
+        qDebug() << "Cannot open" << progressFile.fileName() << "within main";
+        return 1;
+    }
+    QTextStream outProgress(&progressFile);
+
+    // Parts whose image is being written: "part modification time" line, by image name
+    QHash<QString, QString> writing;
+
+    // Full paths of pending parts
+    QStringList pendingPaths;
+    for (int k = 0; k < pendingParts.size(); k++)
+        pendingPaths << partsDir.absoluteFilePath(pendingParts.at(k));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Next batch is parsed in parallel while current one is rendered
+    QFuture<osg::ref_ptr<osg::Node> > nextBatch = QtConcurrent::mapped(pendingPaths.mid(0, BATCH_SIZE), parsePart);
+    for (int first = 0; first < pendingPaths.size(); first += BATCH_SIZE) {
+        QFuture<osg::ref_ptr<osg::Node> > currBatch = nextBatch;
+        if (first+BATCH_SIZE < pendingPaths.size())
+            nextBatch = QtConcurrent::mapped(pendingPaths.mid(first+BATCH_SIZE, BATCH_SIZE), parsePart);
+
+        int count = qMin(BATCH_SIZE, pendingPaths.size()-first);
+        for (int k = 0; k < count; k++) {
+            osg::ref_ptr<osg::Node> part = currBatch.resultAt(k);
+            if (!part)
+                continue;
+
+            // Render it, image is written in background
+            QString partName = pendingParts.at(first+k);
+            QString imageName = outputPath + QFileInfo(partName).completeBaseName() + ".png";
+            writing.insert(imageName, partName + '\t' + QString::number(pendingTimes.at(first+k)));
+            renderer.render(part.get(), imageName);
+
+            // Parts are recorded as done once their image is really on disk
+            QStringList written = ImageWriter::instance()->takeWritten();
+            for (int i = 0; i < written.size(); i++)
+                outProgress << writing.take(written.at(i)) << '\n';
+            outProgress.flush();
+
+            qDebug() << first+k+1 << "/" << pendingParts.size() << partName;
+        }
+    }
+
+    // Flush last images
+    renderer.finish();
+    QStringList written = ImageWriter::instance()->takeWritten();
+    for (int i = 0; i < written.size(); i++)
+        outProgress << writing.take(written.at(i)) << '\n';
+    outProgress.flush();
+
+    qDebug() << "Rendered" << pendingParts.size() << "parts in" << timer.elapsed()/1000 << "s";
+
+    return 0;
+}
@@ -1,12 +1,20 @@
 #include "TileDialog.h"
 
-TileDialog::TileDialog(QWidget *parent) :
+TileDialog::TileDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 TileDialog::TileDialog(const TileDialog& tileDialog) :
     LegoDialog(tileDialog) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void TileDialog::createWidgets(void) {
     // Tile type
     _tileTypeComboBox = new QComboBox(this);
     QStringList tileTypeList;
@@ -25,6 +25,8 @@ public slots:
     virtual void updateMaxWidth(int tileType);
 
 private:
+    void createWidgets(void);
+
     QSpinBox* _widthSpinBox;
     QSpinBox* _lengthSpinBox;
     QSpinBox* _sizeSpinBox;
@@ -1,4 +1,5 @@
 #include "TileNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Material>
@@ -20,6 +21,8 @@ TileNode::TileNode(const TileNode& tileNode) :
 }
 
 void TileNode::createGeode(void) {
+    PROFILE_SCOPE("TileNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
 
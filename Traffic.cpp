@@ -1,57 +1,143 @@
 #include "Traffic.h"
 
-#include <QSettings>
-#include <QDir>
-#include <QDebug>
+#include "Profiler.h"
+#include "Lego.h"
 
-Traffic::Traffic() {
-    // Add all vehicules
-    createTraffic();
-}
+#include <osg/Program>
+#include <osg/Shader>
+#include <osg/Texture2D>
 
-void Traffic::addVehicules(void) {
-    // Create animation path
-    _trafficPath = new osg::AnimationPath;
+#include <QtConcurrentMap>
+#include <QDebug>
 
-    // Create vehicules switch node
-    _vehicules = new osg::Switch;
+#include <algorithm>
+#include <cmath>
 
-    // In case _vehicules is not empty
-    _vehicules->removeChildren(0, _vehicules->getNumChildren());
+// Road cells are 32 studs wide, vehicules drive LANE_OFFSET studs on the right of their middle
+#define CELL_SIZE 32
+#define LANE_OFFSET 4
 
-    // Get settings
-    QSettings settings(QSettings::UserScope, "Perso", "Lego Creator");
+// Vehicules, in studs and plates
+#define VEHICULE_LENGTH 6
+#define VEHICULE_WIDTH 4
+#define VEHICULE_HEIGHT 3
 
-    // Get record path
-    QString recordPath = settings.value("RecordPath").toString();
-    if (!recordPath.endsWith('/'))
-        recordPath += '/';
+// Driving, in studs and seconds
+#define MAX_SPEED 40.0f
+#define ACCELERATION 20.0f
+#define MIN_GAP 2.0f
+#define TIME_HEADWAY 0.8f
+// Longest simulation step, so that a frame freeze doesn't send vehicules through each other
+#define MAX_STEP 0.1
 
-    // Get record file name
-    QString recordFileName = settings.value("RecordFileName").toString();
+// Vehicule poses are stored in a float texture, POSES_WIDTH vehicules per row
+#define POSES_WIDTH 256
+// Below PARALLEL_VEHICULES, threads cost more than they give
+#define PARALLEL_VEHICULES 4096
+#define CHUNK_SIZE 2048
 
-    // Get Vehicules directory path
-    QString vehiculesPath = settings.value("VehiculesPath").toString();
-    if (!vehiculesPath.endsWith('/'))
-        vehiculesPath += '/';
+namespace {
+    // Outgoing direction of each side, in RoadGenerator::Side order
+    const osg::Vec3 SIDE_DIRECTIONS[RoadGenerator::nbSides] = { osg::Vec3(-1, 0, 0), osg::Vec3(0, 1, 0),
+                                                                 osg::Vec3(1, 0, 0), osg::Vec3(0, -1, 0) };
 
-    // Get every vehicules in vehicules directory
-    QDir vehiculesDir = QDir(vehiculesPath);
-    QStringList vehiculesList = vehiculesDir.entryList(QDir::Files | QDir::NoDotAndDotDot);
+    quint32 nextRandom(quint32& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
 
-    // Create vehicules from vehicules directory
-    foreach (QString v, vehiculesList) {
-        _vehicules->addChild(osgDB::readNodeFile((vehiculesPath+v).toStdString()));
+    // Right hand traffic: lanes are on the right of the driving direction
+    osg::Vec3 rightOf(const osg::Vec3& direction) {
+        return osg::Vec3(direction.y(), -direction.x(), 0);
     }
 
-    // Reading animation
-    std::ifstream file((recordPath+recordFileName).toStdString().c_str(), std::ios::in);
-    if (file) {
-        _trafficPath->read(file);
-        file.close();
-    } else {
-        qDebug() << "Cannot open record path within Traffic::addVehicules.";
+    osg::Vec3 bezier(const osg::Vec3& start, const osg::Vec3& control, const osg::Vec3& end, float t) {
+        return start*((1-t)*(1-t)) + control*(2*(1-t)*t) + end*(t*t);
     }
+
+    // Sort vehicules of a lane from the start of the lane
+    struct DistanceLess {
+        DistanceLess(const QVector<float>& distances) : _distances(distances) {}
+        bool operator()(int a, int b) const { return _distances.at(a) < _distances.at(b); }
+        const QVector<float>& _distances;
+    };
+
+    // Simulation is driven by the update traversal, only while traffic is shown
+    class TrafficCallback : public osg::NodeCallback {
+    public:
+        TrafficCallback(Traffic* traffic) : _traffic(traffic) {}
+
+        virtual void operator()(osg::Node* node, osg::NodeVisitor* nv) {
+            if (nv->getFrameStamp())
+                _traffic->update(nv->getFrameStamp()->getSimulationTime());
+            traverse(node, nv);
+        }
+
+    private:
+        Traffic* _traffic;
+    };
+
+    // Every vehicule is one instance of the same geometry, moved and turned according to its pose texel
+    const char* VERTEX_SHADER =
+        "#version 120\n"
+        "#extension GL_ARB_draw_instanced : enable\n"
+        "uniform sampler2D poses;\n"
+        "uniform vec2 posesSize;\n"
+        "varying vec3 color;\n"
+        "varying vec3 normal;\n"
+        "const vec3 palette[6] = vec3[6](vec3(0.8, 0.0, 0.0), vec3(0.0, 0.3, 0.8), vec3(0.9, 0.8, 0.0),\n"
+        "                                vec3(0.1, 0.6, 0.1), vec3(0.9, 0.9, 0.9), vec3(0.2, 0.2, 0.2));\n"
+        "void main() {\n"
+        "    float id = float(gl_InstanceIDARB);\n"
+        "    vec2 coords = vec2((mod(id, posesSize.x) + 0.5) / posesSize.x, (floor(id / posesSize.x) + 0.5) / posesSize.y);\n"
+        "    vec4 pose = texture2DLod(poses, coords, 0.0);\n"
+        "    mat3 rotation = mat3(cos(pose.w), sin(pose.w), 0.0, -sin(pose.w), cos(pose.w), 0.0, 0.0, 0.0, 1.0);\n"
+        "    gl_Position = gl_ModelViewProjectionMatrix * vec4(rotation * gl_Vertex.xyz + pose.xyz, 1.0);\n"
+        "    normal = normalize(gl_NormalMatrix * (rotation * gl_Normal));\n"
+        "    color = mix(gl_Color.rgb, gl_Color.rgb * palette[int(mod(id, 6.0))], gl_Color.a);\n"
+        "}\n";
+
+    const char* FRAGMENT_SHADER =
+        "#version 120\n"
+        "varying vec3 color;\n"
+        "varying vec3 normal;\n"
+        "void main() {\n"
+        "    float light = 0.4 + 0.6 * max(dot(normalize(normal), normalize(vec3(0.3, 0.5, 1.0))), 0.0);\n"
+        "    gl_FragColor = vec4(color * light, 1.0);\n"
+        "}\n";
+
+    // Box faces as quads, counter clockwise seen from outside. Color alpha tells whether the vehicule color applies
+    void addBox(osg::Vec3Array* vertices, osg::Vec3Array* normals, osg::Vec4Array* colors,
+                const osg::Vec3& min, const osg::Vec3& max, const osg::Vec4& color) {
+        static const int FACES[6][4] = { {0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6} };
+        static const osg::Vec3 FACE_NORMALS[6] = { osg::Vec3(-1, 0, 0), osg::Vec3(1, 0, 0), osg::Vec3(0, -1, 0),
+                                                   osg::Vec3(0, 1, 0), osg::Vec3(0, 0, -1), osg::Vec3(0, 0, 1) };
+
+        for (int face = 0; face < 6; face++) {
+            for (int k = 0; k < 4; k++) {
+                int corner = FACES[face][k];
+                vertices->push_back(osg::Vec3((corner & 1) ? max.x() : min.x(),
+                                              (corner & 2) ? max.y() : min.y(),
+                                              (corner & 4) ? max.z() : min.z()));
+                normals->push_back(FACE_NORMALS[face]);
+                colors->push_back(color);
+            }
+        }
+    }
+}
+
+Traffic::Traffic(void) :
+    _lastTime(-1.0) {
+
+    createTraffic();
+    clearRoads();
+}
+
+Traffic::~Traffic(void) {
+    // The scene may outlive traffic
+    _root->setUpdateCallback(NULL);
 }
 
 void Traffic::createTraffic(void) {
@@ -61,41 +147,369 @@ void Traffic::createTraffic(void) {
     // Give a name to traffic to erase it when saving file
     _root->setName("TrafficNode");
 
-    // By default, when adding a child, it has to be hidden
+    // Hidden until switched on
     _root->setNewChildDefaultValue(false);
+    _updateCallback = new TrafficCallback(this);
+
+    // One vehicule, along x, wheels on z = 0
+    osg::Vec3 halfSize(Lego::length_unit*VEHICULE_LENGTH/2.0, Lego::length_unit*VEHICULE_WIDTH/2.0, 0);
+    osg::Vec3 cabinSize(Lego::length_unit*VEHICULE_LENGTH/4.0, Lego::length_unit*VEHICULE_WIDTH/2.0 - 1, 0);
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
+    addBox(vertices.get(), normals.get(), colors.get(), -halfSize, halfSize + osg::Vec3(0, 0, Lego::height_unit*VEHICULE_HEIGHT), osg::Vec4(1, 1, 1, 1));
+    addBox(vertices.get(), normals.get(), colors.get(), -cabinSize + osg::Vec3(0, 0, Lego::height_unit*VEHICULE_HEIGHT),
+           cabinSize + osg::Vec3(0, 0, 2*Lego::height_unit*VEHICULE_HEIGHT), osg::Vec4(0.3, 0.3, 0.35, 0));
+
+    _vehiculeGeometry = new osg::Geometry;
+    _vehiculeGeometry->setVertexArray(vertices.get());
+    _vehiculeGeometry->setNormalArray(normals.get());
+    _vehiculeGeometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+    _vehiculeGeometry->setColorArray(colors.get());
+    _vehiculeGeometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
+
+    // Every vehicule is drawn with a single instanced call
+    _vehiculeDrawArrays = new osg::DrawArrays(GL_QUADS, 0, vertices->size(), 0);
+    _vehiculeGeometry->addPrimitiveSet(_vehiculeDrawArrays.get());
+    _vehiculeGeometry->setUseDisplayList(false);
+    _vehiculeGeometry->setUseVertexBufferObjects(true);
+    _vehiculeGeometry->setDataVariance(osg::Object::DYNAMIC);
+
+    // Poses texture, one RGBA float texel per vehicule: position and heading
+    osg::ref_ptr<osg::Texture2D> posesTexture = new osg::Texture2D;
+    posesTexture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+    posesTexture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+    posesTexture->setResizeNonPowerOfTwoHint(false);
+    posesTexture->setInternalFormat(GL_RGBA32F_ARB);
+    posesTexture->setDataVariance(osg::Object::DYNAMIC);
+
+    osg::ref_ptr<osg::Program> program = new osg::Program;
+    program->addShader(new osg::Shader(osg::Shader::VERTEX, VERTEX_SHADER));
+    program->addShader(new osg::Shader(osg::Shader::FRAGMENT, FRAGMENT_SHADER));
+
+    _posesSize = new osg::Uniform("posesSize", osg::Vec2(POSES_WIDTH, 1));
+
+    // Poses are written by the update traversal while the previous frame may still be drawn
+    osg::StateSet* stateSet = _vehiculeGeometry->getOrCreateStateSet();
+    stateSet->setDataVariance(osg::Object::DYNAMIC);
+    stateSet->setTextureAttributeAndModes(0, posesTexture.get());
+    stateSet->setAttributeAndModes(program.get());
+    stateSet->addUniform(new osg::Uniform("poses", 0));
+    stateSet->addUniform(_posesSize.get());
+
+    _vehiculesGeode = new osg::Geode;
+    _vehiculesGeode->setName("vehicules");
+    _vehiculesGeode->addDrawable(_vehiculeGeometry.get());
+    _root->addChild(_vehiculesGeode.get());
+
+    resizePoses();
+}
+
+void Traffic::setRoads(const RoadGenerator::RoadGrid& roadGrid) {
+    PROFILE_SCOPE("Traffic::setRoads");
+
+    _roadGrid = roadGrid;
+
+    _starts.clear();
+    _controls.clear();
+    _ends.clear();
+    _lengths.clear();
+    _nextEntries.clear();
+
+    // Movements are grouped by entry, so each entry is a range of movements
+    int nbCells = _roadGrid.width*_roadGrid.length;
+    _firstMovements.resize(4*nbCells+1);
+    for (int cell = 0; cell < nbCells; cell++) {
+        for (int side = 0; side < RoadGenerator::nbSides; side++) {
+            _firstMovements[4*cell+side] = _lengths.size();
+            if (_roadGrid.sideMasks.at(cell) & (1 << side))
+                addMovements(cell, side);
+        }
+    }
+    _firstMovements[4*nbCells] = _lengths.size();
+
+    // Vehicules can't be drawn outside of the road grid, whatever their instances
+    osg::BoundingBox bound;
+    float halfCell = Lego::length_unit*CELL_SIZE/2.0;
+    bound.expandBy(_roadGrid.origin - osg::Vec3(halfCell, halfCell, 0));
+    bound.expandBy(_roadGrid.origin + osg::Vec3(Lego::length_unit*CELL_SIZE*_roadGrid.width - halfCell,
+                                                Lego::length_unit*CELL_SIZE*_roadGrid.length - halfCell,
+                                                2*Lego::height_unit*VEHICULE_HEIGHT));
+    _vehiculeGeometry->setInitialBound(bound);
+    _vehiculeGeometry->dirtyBound();
+
+    // Lanes changed: place vehicules again
+    addVehicules(0, _lanes.size());
+}
+
+void Traffic::clearRoads(void) {
+    RoadGenerator::RoadGrid roadGrid;
+    roadGrid.width = 0;
+    roadGrid.length = 0;
+    setRoads(roadGrid);
+}
+
+void Traffic::addMovements(int cell, int entrySide) {
+    int i = cell / _roadGrid.length;
+    int j = cell % _roadGrid.length;
+    int sideMask = _roadGrid.sideMasks.at(cell);
+    osg::Vec3 center = _roadGrid.origin + osg::Vec3(Lego::length_unit*CELL_SIZE*i, Lego::length_unit*CELL_SIZE*j, 0);
+    float halfCell = Lego::length_unit*CELL_SIZE/2.0;
+    float laneOffset = Lego::length_unit*LANE_OFFSET;
+
+    // Dead ends: vehicules turn back
+    int exitMask = sideMask & ~(1 << entrySide);
+    if (exitMask == 0)
+        exitMask = 1 << entrySide;
+
+    osg::Vec3 entryDirection = -SIDE_DIRECTIONS[entrySide];
+    osg::Vec3 start = center - entryDirection*halfCell + rightOf(entryDirection)*laneOffset;
+
+    for (int exitSide = 0; exitSide < RoadGenerator::nbSides; exitSide++) {
+        if (!(exitMask & (1 << exitSide)))
+            continue;
+
+        osg::Vec3 exitDirection = SIDE_DIRECTIONS[exitSide];
+        osg::Vec3 end = center + exitDirection*halfCell + rightOf(exitDirection)*laneOffset;
+
+        // Turns go through the crossing of both lanes, straight lines and U-turns through the cell
+        osg::Vec3 control;
+        if (exitSide == (entrySide+2)%RoadGenerator::nbSides)
+            control = (start + end)/2;
+        else if (exitSide == entrySide)
+            control = (start + end)/2 + entryDirection*halfCell;
+        else
+            control = start + entryDirection*((end - start)*entryDirection);
+
+        // Curve length, close enough with a few segments
+        float length = 0;
+        osg::Vec3 previous = start;
+        for (int k = 1; k <= 8; k++) {
+            osg::Vec3 point = bezier(start, control, end, k/8.0);
+            length += (point - previous).length();
+            previous = point;
+        }
+
+        // Next entry is the neighbour cell, or this very cell when the road stops at the map border
+        int nextEntry = 4*cell + exitSide;
+        int nextI = i + static_cast<int>(exitDirection.x());
+        int nextJ = j + static_cast<int>(exitDirection.y());
+        int oppositeSide = (exitSide+2)%RoadGenerator::nbSides;
+        if (nextI >= 0 && nextI < _roadGrid.width && nextJ >= 0 && nextJ < _roadGrid.length
+                && (_roadGrid.sideMask(nextI, nextJ) & (1 << oppositeSide)))
+            nextEntry = 4*(nextI*_roadGrid.length + nextJ) + oppositeSide;
 
-    // Add vehicules from files
-    addVehicules();
-
-    // Loop on vehicules
-    for (unsigned int i = 0 ; i < _vehicules->getNumChildren(); i++) {
-        // Apply animationPathCallback
-        osg::ref_ptr<osg::MatrixTransform> t = new osg::MatrixTransform;
-        t->setName("transformation");
-        osg::ref_ptr<osg::AnimationPathCallback> aniCallback = new osg::AnimationPathCallback(_trafficPath.get(),i+5,i+1); // depart, vitesse
-        t->setUpdateCallback(aniCallback.get());
-
-        // Transformation on vehicule
-        osg::ref_ptr<osg::MatrixTransform> t2 = new osg::MatrixTransform;
-        t2->setName("transformation");
-        osg::Matrix m;
-        //m.preMultScale(osg::Vec3(20.0, 20.0, 20.0));
-        m.preMultRotate(osg::Quat(-M_PI/2, osg::Vec3d(1.0, 0.0, 0.0)));
-        m.preMultRotate(osg::Quat(M_PI, osg::Vec3d(0.0, 0.0, 1.0)));
-        //m.makeTranslate(osg::Vec3(0,0,-3.8));
-        t2->setMatrix(m);
-
-        // Add vehicule and transformations
-        Node* currVehicule = _vehicules->getChild(i);
-        currVehicule->setName("vehicule");
-        t2->addChild(currVehicule);
-        t->addChild(t2);
-        _root->addChild(t.get());
+        _starts << start;
+        _controls << control;
+        _ends << end;
+        _lengths << length;
+        _nextEntries << nextEntry;
     }
 }
 
+void Traffic::setNbVehicules(int nbVehicules) {
+    // Existing vehicules keep driving, new ones are added on random lanes
+    int previous = _lanes.size();
+    _lanes.resize(nbVehicules);
+    _nextLanes.resize(nbVehicules);
+    _distances.resize(nbVehicules);
+    _speeds.resize(nbVehicules);
+    _maxSpeeds.resize(nbVehicules);
+    _randoms.resize(nbVehicules);
+    _ranks.resize(nbVehicules);
+    addVehicules(previous, nbVehicules);
+
+    resizePoses();
+}
+
+void Traffic::addVehicules(int first, int last) {
+    for (int k = first; k < last; k++) {
+        // Each vehicule has its own random numbers, so that threads never share them
+        quint32 random = 0x9e3779b9 * (k+1);
+        if (random == 0)
+            random = 0x9e3779b9;
+
+        // Vehicules start standing, anywhere on the roads
+        if (!_lengths.isEmpty()) {
+            _lanes[k] = nextRandom(random) % _lengths.size();
+            _distances[k] = _lengths.at(_lanes.at(k)) * (nextRandom(random) % 1000) / 1000.0f;
+            int nextEntry = _nextEntries.at(_lanes.at(k));
+            int nbMovements = _firstMovements.at(nextEntry+1) - _firstMovements.at(nextEntry);
+            _nextLanes[k] = _firstMovements.at(nextEntry) + nextRandom(random) % nbMovements;
+        } else {
+            _lanes[k] = -1;
+            _nextLanes[k] = -1;
+            _distances[k] = 0;
+        }
+        _speeds[k] = 0;
+        _maxSpeeds[k] = Lego::length_unit*MAX_SPEED * (0.6f + 0.4f*(nextRandom(random) % 1000)/1000.0f);
+        _randoms[k] = random;
+    }
+
+    // Nothing to draw without roads. No instance at all would draw the vehicule once, the geode is hidden instead
+    int nbInstances = _lengths.isEmpty() ? 0 : _lanes.size();
+    _vehiculeDrawArrays->setNumInstances(nbInstances);
+    _vehiculesGeode->setNodeMask(nbInstances > 0 ? ~0u : 0u);
+}
+
+void Traffic::resizePoses(void) {
+    int nbRows = qMax(1, (_lanes.size() + POSES_WIDTH-1) / POSES_WIDTH);
+    if (_poses.valid() && _poses->t() == nbRows)
+        return;
+
+    // A new image, so that the texture is allocated again with its new size
+    _poses = new osg::Image;
+    _poses->allocateImage(POSES_WIDTH, nbRows, 1, GL_RGBA, GL_FLOAT);
+    _poses->setInternalTextureFormat(GL_RGBA32F_ARB);
+    _poses->setDataVariance(osg::Object::DYNAMIC);
+    std::fill(reinterpret_cast<float*>(_poses->data()), reinterpret_cast<float*>(_poses->data()) + 4*POSES_WIDTH*nbRows, 0.0f);
+
+    osg::StateSet* stateSet = _vehiculeGeometry->getStateSet();
+    static_cast<osg::Texture2D*>(stateSet->getTextureAttribute(0, osg::StateAttribute::TEXTURE))->setImage(_poses.get());
+    _posesSize->set(osg::Vec2(POSES_WIDTH, nbRows));
+}
+
 void Traffic::switchTraffic(bool b) {
-    // Show or hide traffic, according to b value, thanks to switch node function
-    for (unsigned int k = 0; k < _root->getNumChildren(); k++)
-        _root->setValue(k, b);
+    // Show or hide traffic, and only simulate it while shown: frames are drawn on demand
+    if (b) {
+        _root->setAllChildrenOn();
+        _root->setUpdateCallback(_updateCallback.get());
+    } else {
+        _root->setAllChildrenOff();
+        _root->setUpdateCallback(NULL);
+    }
+
+    // No time jump when switched on again
+    _lastTime = -1.0;
+}
+
+void Traffic::update(double time) {
+    PROFILE_SCOPE("Traffic::update");
+
+    float dt = (_lastTime < 0.0) ? 0.0f : static_cast<float>(qBound(0.0, time - _lastTime, MAX_STEP));
+    _lastTime = time;
+
+    if (_lengths.isEmpty() || _lanes.isEmpty())
+        return;
+
+    // Speeds only read positions, then positions only read speeds: both passes can be split among threads
+    sortVehicules();
+    forEachChunk(&Traffic::updateSpeeds, dt);
+    forEachChunk(&Traffic::updatePositions, dt);
+
+    _poses->dirty();
+}
+
+void Traffic::sortVehicules(void) {
+    // Counting sort by lane
+    int nbLanes = _lengths.size();
+    _firstVehicules.fill(0, nbLanes+1);
+    for (int k = 0; k < _lanes.size(); k++)
+        _firstVehicules[_lanes.at(k)+1]++;
+    for (int lane = 0; lane < nbLanes; lane++)
+        _firstVehicules[lane+1] += _firstVehicules.at(lane);
+
+    _laneVehicules.resize(_lanes.size());
+    for (int k = 0; k < _lanes.size(); k++)
+        _laneVehicules[_firstVehicules[_lanes.at(k)]++] = k;
+
+    // Starts were moved to the next lane start while filling
+    for (int lane = nbLanes-1; lane > 0; lane--)
+        _firstVehicules[lane] = _firstVehicules.at(lane-1);
+    _firstVehicules[0] = 0;
+
+    // Then by distance within each lane, lanes only hold a few vehicules
+    DistanceLess distanceLess(_distances);
+    for (int lane = 0; lane < nbLanes; lane++) {
+        if (_firstVehicules.at(lane+1) - _firstVehicules.at(lane) > 1)
+            std::sort(_laneVehicules.begin()+_firstVehicules.at(lane), _laneVehicules.begin()+_firstVehicules.at(lane+1), distanceLess);
+    }
+
+    for (int k = 0; k < _laneVehicules.size(); k++)
+        _ranks[_laneVehicules.at(k)] = k;
+}
+
+void Traffic::updateSpeeds(int first, int last, float dt) {
+    const float length = Lego::length_unit*(VEHICULE_LENGTH + MIN_GAP);
+    const float acceleration = Lego::length_unit*ACCELERATION*dt;
+
+    for (int k = first; k < last; k++) {
+        int lane = _lanes.at(k);
+        int next = _ranks.at(k)+1;
+
+        // Gap to the vehicule ahead, on this lane or at the start of the next one
+        float gap = -1.0f;
+        if (next < _firstVehicules.at(lane+1)) {
+            gap = _distances.at(_laneVehicules.at(next)) - _distances.at(k);
+        } else {
+            int nextLane = _nextLanes.at(k);
+            if (_firstVehicules.at(nextLane) < _firstVehicules.at(nextLane+1))
+                gap = _lengths.at(lane) - _distances.at(k) + _distances.at(_laneVehicules.at(_firstVehicules.at(nextLane)));
+        }
+
+        // Keep TIME_HEADWAY seconds behind, braking at once so that vehicules never overlap
+        float speed = _speeds.at(k) + acceleration;
+        if (gap >= 0.0f)
+            speed = qMin(speed, qMax(0.0f, gap - length) / TIME_HEADWAY);
+        _speeds[k] = qMin(speed, _maxSpeeds.at(k));
+    }
+}
+
+void Traffic::updatePositions(int first, int last, float dt) {
+    float* poses = reinterpret_cast<float*>(_poses->data());
+
+    for (int k = first; k < last; k++) {
+        int lane = _lanes.at(k);
+        float distance = _distances.at(k) + _speeds.at(k)*dt;
+
+        // Go on with the next lane, chosen ahead so that followers know about it
+        while (distance >= _lengths.at(lane)) {
+            distance -= _lengths.at(lane);
+            lane = _nextLanes.at(k);
+            int nextEntry = _nextEntries.at(lane);
+            int nbMovements = _firstMovements.at(nextEntry+1) - _firstMovements.at(nextEntry);
+            _nextLanes[k] = _firstMovements.at(nextEntry) + nextRandom(_randoms[k]) % nbMovements;
+        }
+        _lanes[k] = lane;
+        _distances[k] = distance;
+
+        // Position and heading along the curve
+        float t = distance / _lengths.at(lane);
+        const osg::Vec3& start = _starts.at(lane);
+        const osg::Vec3& control = _controls.at(lane);
+        const osg::Vec3& end = _ends.at(lane);
+        osg::Vec3 position = bezier(start, control, end, t);
+        osg::Vec3 tangent = (control - start)*(1-t) + (end - control)*t;
+
+        float* pose = poses + 4*k;
+        pose[0] = position.x();
+        pose[1] = position.y();
+        pose[2] = position.z();
+        pose[3] = atan2(tangent.y(), tangent.x());
+    }
+}
+
+void Traffic::updateChunk(Chunk& chunk) {
+    (chunk.traffic->*chunk.step)(chunk.first, chunk.last, chunk.dt);
+}
+
+void Traffic::forEachChunk(void (Traffic::*step)(int, int, float), float dt) {
+    int nbVehicules = _lanes.size();
+    if (nbVehicules < PARALLEL_VEHICULES) {
+        (this->*step)(0, nbVehicules, dt);
+        return;
+    }
+
+    // Vehicules only write their own entries, so chunks are independent
+    _chunks.clear();
+    for (int first = 0; first < nbVehicules; first += CHUNK_SIZE) {
+        Chunk chunk;
+        chunk.traffic = this;
+        chunk.step = step;
+        chunk.dt = dt;
+        chunk.first = first;
+        chunk.last = qMin(first + CHUNK_SIZE, nbVehicules);
+        _chunks << chunk;
+    }
+    QtConcurrent::blockingMap(_chunks, updateChunk);
 }
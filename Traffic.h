@@ -1,47 +1,92 @@
 #ifndef TRAFFIC_H
 #define TRAFFIC_H
 
-#include <osgTerrain/TerrainTile>
-#include <osgTerrain/GeometryTechnique>
-#include <osgTerrain/Layer>
+#include <QVector>
+
 #include <osg/Geode>
-#include <osg/MatrixTransform>
 #include <osg/Geometry>
+#include <osg/Image>
+#include <osg/NodeCallback>
+#include <osg/Switch>
+#include <osg/Uniform>
 #include <osg/ref_ptr>
-#include <osgDB/WriteFile>
-#include <osgDB/ReadFile>
-#include <osg/Notify>
-#include <osgViewer/Viewer>
-#include <osg/Camera>
-#include <osg/ShapeDrawable>
-#include <osg/Material>
-#include <osg/Texture2D>
-#include <osg/Light>
-#include <osgText/Font>
-#include <osgText/Text>
-#include <osg/PositionAttitudeTransform>
-#include <osgGA/TrackballManipulator>
-#include <osgGA/FlightManipulator>
-#include <osgGA/DriveManipulator>
-#include <osgGA/KeySwitchMatrixManipulator>
-#include <osgGA/AnimationPathManipulator>
-#include <osgGA/TerrainManipulator>
-#include <osgViewer/ViewerEventHandlers>
-
-class Traffic : public osg::Node {
+
+#include "RoadGenerator.h"
+
+class Traffic {
 
 public:
     Traffic(void);
-    void addVehicules(void);
-    void createTraffic(void);
+    virtual ~Traffic(void);
+
+    void setRoads(const RoadGenerator::RoadGrid& roadGrid);
+    void clearRoads(void);
+    const RoadGenerator::RoadGrid& getRoads(void) const { return _roadGrid; }
+    void setNbVehicules(int nbVehicules);
+    int getNbVehicules(void) const { return _lanes.size(); }
     void switchTraffic(bool b);
+    void update(double time);
+
+    osg::Switch* getRoot(void) const { return _root.get(); }
+
+private:
+    // A range of vehicules, updated by one thread
+    struct Chunk {
+        Traffic* traffic;
+        void (Traffic::*step)(int, int, float);
+        float dt;
+        int first;
+        int last;
+    };
 
-    osg::Switch* getRoot(void) const { return _root; }
+    void createTraffic(void);
+    void addMovements(int cell, int entrySide);
+    void addVehicules(int first, int last);
+    void resizePoses(void);
+
+    void sortVehicules(void);
+    void updateSpeeds(int first, int last, float dt);
+    void updatePositions(int first, int last, float dt);
+    void forEachChunk(void (Traffic::*step)(int, int, float), float dt);
+    static void updateChunk(Chunk& chunk);
 
 private:
     osg::ref_ptr<osg::Switch> _root;
-    osg::ref_ptr<osg::Group> _vehicules;
-    osg::ref_ptr<osg::AnimationPath> _trafficPath;
+    osg::ref_ptr<osg::Geode> _vehiculesGeode;
+    osg::ref_ptr<osg::Geometry> _vehiculeGeometry;
+    osg::ref_ptr<osg::DrawArrays> _vehiculeDrawArrays;
+    osg::ref_ptr<osg::Image> _poses;
+    osg::ref_ptr<osg::Uniform> _posesSize;
+    osg::ref_ptr<osg::NodeCallback> _updateCallback;
+
+    // Road grid, kept to build lanes again when vehicules are added
+    RoadGenerator::RoadGrid _roadGrid;
+
+    // Movements through a cell, from an entry side to an exit side, as quadratic Bezier curves on the right of the road
+    QVector<osg::Vec3> _starts;
+    QVector<osg::Vec3> _controls;
+    QVector<osg::Vec3> _ends;
+    QVector<float> _lengths;
+    QVector<int> _nextEntries;
+
+    // Movements are grouped by entry (4*cell + side): [_firstMovements[entry], _firstMovements[entry+1][
+    QVector<int> _firstMovements;
+
+    // Vehicules, as structure of arrays
+    QVector<int> _lanes;
+    QVector<int> _nextLanes;
+    QVector<float> _distances;
+    QVector<float> _speeds;
+    QVector<float> _maxSpeeds;
+    QVector<quint32> _randoms;
+
+    // Vehicules sorted by lane, then by distance: [_firstVehicules[lane], _firstVehicules[lane+1][
+    QVector<int> _firstVehicules;
+    QVector<int> _laneVehicules;
+    QVector<int> _ranks;
+
+    QVector<Chunk> _chunks;
+    double _lastTime;
 };
 
 #endif // TRAFFIC_H
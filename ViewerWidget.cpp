@@ -1,18 +1,75 @@
 #include "ViewerWidget.h"
 
 #include <osg/MatrixTransform>
+#include <osg/DeleteHandler>
+#include <OpenThreads/ScopedLock>
+
+#include <list>
 
 #include <QSettings>
+#include <QMouseEvent>
 #include <QDebug>
 #include <QDir>
 
 #include "PickHandler.h"
+#include "RegionCompiler.h"
+#include "WallCompiler.h"
+#include "Profiler.h"
+
+// Minimal delay between two frames in continuous mode, in ms
+#define FRAME_INTERVAL 10
+// Frames before deleting a removed object, when draw is threaded. Frames of both viewers are
+// counted on the same clock, so it is larger than the 2 frames OSG needs for a single viewer
+#define RETAINED_FRAMES 4
+
+namespace {
+    // Both viewers flush the same delete handler once per frame, each with its own frame numbers:
+    // the handler counts these flushes instead of trusting the frame number it was given last
+    class SharedDeleteHandler : public osg::DeleteHandler {
+    public:
+        SharedDeleteHandler(int numberOfFramesToRetainObjects) :
+            osg::DeleteHandler(numberOfFramesToRetainObjects),
+            _nbFlushes(0) {}
+
+        virtual void flush(void) {
+            std::list<const osg::Referenced*> deletionList;
+            {
+                OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+                _nbFlushes++;
+
+                // Objects are requested in order, so the oldest ones come first
+                ObjectsToDeleteList::iterator it = _objectsToDelete.begin();
+                while (it != _objectsToDelete.end() && it->first + _numFramesToRetainObjects <= _nbFlushes) {
+                    deletionList.push_back(it->second);
+                    ++it;
+                }
+                _objectsToDelete.erase(_objectsToDelete.begin(), it);
+            }
+
+            for (std::list<const osg::Referenced*>::iterator it = deletionList.begin(); it != deletionList.end(); ++it)
+                doDelete(*it);
+        }
+
+        virtual void requestDelete(const osg::Referenced* object) {
+            OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_mutex);
+            _objectsToDelete.push_back(FrameNumberObjectPair(_nbFlushes, object));
+        }
+
+    private:
+        unsigned int _nbFlushes;
+    };
+}
 
 ViewerWidget::ViewerWidget(bool isWorld, osgViewer::ViewerBase::ThreadingModel threadingModel) :
     QWidget(),
-    _isWorld(isWorld) {
+    _isWorld(isWorld),
+    _firstFrameDrawn(false) {
     setThreadingModel(threadingModel);
 
+    // With threaded draw, nodes removed from the scene may still be drawn: delete them some frames later
+    if (threadingModel != osgViewer::ViewerBase::SingleThreaded && !osg::Referenced::getDeleteHandler())
+        osg::Referenced::setDeleteHandler(new SharedDeleteHandler(RETAINED_FRAMES));
+
     // Init pointers
     _view = NULL;
     _camera = NULL;
@@ -25,14 +82,75 @@ ViewerWidget::ViewerWidget(bool isWorld, osgViewer::ViewerBase::ThreadingModel t
         _picker = new PickHandler;
     }
 
-    // Update view
+    // Frames are drawn on demand: the timer only fires when a frame is requested
+    _timer.setSingleShot(true);
     connect(&_timer, SIGNAL(timeout()), this, SLOT(update()));
-    _timer.start(10);
+
+    // Resizing the viewer needs a new frame, events of its GL widget are filtered by initWidget
+    installEventFilter(this);
+
+    // First frame
+    requestFrame();
 }
 
 ViewerWidget::~ViewerWidget() {
 }
 
+void ViewerWidget::paintEvent(QPaintEvent*) {
+    {
+        PROFILE_SCOPE("ViewerWidget::frame");
+        frame();
+    }
+
+    // Startup ends with the first frame
+    if (!_firstFrameDrawn) {
+        _firstFrameDrawn = true;
+        emit firstFrameDrawn();
+    }
+
+    // Keep drawing while something is going on: animation callbacks, manipulator throw, pending events...
+    if (checkNeedToDoFrame()) {
+        if (!_timer.isActive())
+            _timer.start(FRAME_INTERVAL);
+    }
+}
+
+bool ViewerWidget::eventFilter(QObject* /*object*/, QEvent* event) {
+    switch (event->type()) {
+    // Mouse and keyboard events on the viewer may move the camera, or pick LEGO pieces.
+    // Scene edits from the rest of the GUI request their frame explicitly
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease:
+    case QEvent::MouseButtonDblClick:
+    case QEvent::Wheel:
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease:
+        requestFrame();
+        break;
+    // Mouse moves only matter while dragging
+    case QEvent::MouseMove:
+        if (static_cast<QMouseEvent*>(event)->buttons() != Qt::NoButton)
+            requestFrame();
+        break;
+    // Viewer resizing
+    case QEvent::Resize:
+    case QEvent::Show:
+        requestFrame();
+        break;
+    default:
+        break;
+    }
+
+    // Never filter out events
+    return false;
+}
+
+void ViewerWidget::requestFrame(void) {
+    // Several requests before the next frame only draw once
+    if (!_timer.isActive())
+        _timer.start(0);
+}
+
 osg::Camera* ViewerWidget::createCamera(const osg::Vec4& color, int x, int y, int w, int h) {
     // Set all traits
     osg::DisplaySettings* ds = osg::DisplaySettings::instance().get();
@@ -109,6 +227,10 @@ void ViewerWidget::changeCamera(osg::Camera* camera) {
     // Set camera
     _camera = camera;
     _view->setCamera(_camera);
+
+    // Pieces drawn by their region mesh or wall section are still picked, but not drawn twice
+    if (_isWorld)
+        _camera->setCullMask(~(RegionCompiler::compiledPieceMask | WallCompiler::compiledBodyMask));
 }
 
 void ViewerWidget::changeScene(osg::Node* scene) {
@@ -127,6 +249,7 @@ void ViewerWidget::initWidget(void) {
     // Create widget according to camera graphic context
     if (osgQt::GraphicsWindowQt* gw = dynamic_cast<osgQt::GraphicsWindowQt*>(_camera->getGraphicsContext())) {
         _widget = gw->getGLWidget();
+        _widget->installEventFilter(this);
         _widget->show();
     } else
         qDebug() << "Cannot set ViewerWidget widget in ViewerWidget::setWidget(QWidget* widget)";
@@ -136,3 +259,15 @@ void ViewerWidget::initWidget(void) {
     mainLayout->addWidget(_widget);
     setLayout(mainLayout);
 }
+
+void ViewerWidget::setWorld(World* world) {
+    // Picking queries the world spatial index
+    if (_isWorld)
+        _picker->setWorld(world);
+}
+
+void ViewerWidget::setBoxPickingOnly(bool boxPickingOnly) {
+    // Pick pieces at box granularity, without any triangle test
+    if (_isWorld)
+        _picker->setBoxPickingOnly(boxPickingOnly);
+}
@@ -23,6 +23,7 @@
 #include <osgQt/GraphicsWindowQt>
 
 class PickHandler;
+class World;
 
 
 class ViewerWidget : public QWidget, public osgViewer::CompositeViewer {
@@ -36,14 +37,21 @@ public:
 
     osg::Camera* getCamera(void) const { return _camera.get(); }
 
-    virtual void paintEvent(QPaintEvent*) { frame(); }
+    virtual void paintEvent(QPaintEvent*);
+    virtual bool eventFilter(QObject* object, QEvent* event);
 
 public slots:
+    void requestFrame(void);
     void initView(void);
     void initManipulators(void);
     void changeCamera(osg::Camera* camera);
     void changeScene(osg::Node* scene);
     void initWidget(void);
+    void setWorld(World* world);
+    void setBoxPickingOnly(bool boxPickingOnly);
+
+signals:
+    void firstFrameDrawn(void);
 
 protected:
     QTimer _timer;
@@ -53,6 +61,7 @@ protected:
     osg::ref_ptr<osgGA::KeySwitchMatrixManipulator> _keyswitchManipulator;
     osg::ref_ptr<PickHandler> _picker;
     bool _isWorld;
+    bool _firstFrameDrawn;
 };
 
 #endif // VIEWERWIDGET_H
@@ -0,0 +1,325 @@
+#include "WallCompiler.h"
+
+#include "Profiler.h"
+#include "LegoNode.h"
+#include "Brick.h"
+
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Sides of a cell: +x, -x, +y, -y, +z, -z
+    const int NB_DIRECTIONS = 6;
+
+    quint64 cellKey(int x, int y, int z) {
+        return (quint64(quint16(x + 32768)) << 32) | (quint64(quint16(y + 32768)) << 16) | quint64(quint16(z + 32768));
+    }
+
+    // Faces are merged among faces of the same direction, plane and color
+    quint64 groupKey(int direction, int slice, QRgb color) {
+        return (quint64(direction) << 48) | (quint64(quint16(slice + 32768)) << 32) | quint64(color);
+    }
+
+    struct Cell {
+        int coords[3];
+        QRgb color;
+    };
+
+    struct Face {
+        int u;
+        int v;
+    };
+
+    // One quad of a merged face, counter clockwise seen from outside
+    void addQuad(int direction, int slice, int u0, int v0, int u1, int v1, QRgb color,
+                 osg::Vec3Array* vertices, osg::Vec3Array* normals, osg::Vec4Array* colors) {
+        int axis = direction/2;
+        bool positive = (direction%2 == 0);
+
+        int corners[4][2] = { {u0, v0}, {u1, v0}, {u1, v1}, {u0, v1} };
+        if (!positive) {
+            std::swap(corners[1][0], corners[3][0]);
+            std::swap(corners[1][1], corners[3][1]);
+        }
+
+        osg::Vec3 normal;
+        normal[axis] = positive ? 1.0f : -1.0f;
+        osg::Vec4 osgColor(qRed(color)/255.0f, qGreen(color)/255.0f, qBlue(color)/255.0f, 1.0f);
+
+        for (int k = 0; k < 4; k++) {
+            int coords[3];
+            coords[axis] = slice;
+            coords[(axis+1)%3] = corners[k][0];
+            coords[(axis+2)%3] = corners[k][1];
+            vertices->push_back(osg::Vec3(coords[0]*Lego::length_unit, coords[1]*Lego::length_unit, coords[2]*Lego::height_unit));
+            normals->push_back(normal);
+            colors->push_back(osgColor);
+        }
+    }
+}
+
+WallCompiler::WallCompiler(void) :
+    _nextSectionId(0),
+    _enabled(true) {
+
+    _root = new osg::Group;
+    _root->setName("Compiled walls group");
+}
+
+bool WallCompiler::brickBox(osg::MatrixTransform* matrixTransform, Box& box) {
+    if (matrixTransform->getNumChildren() == 0)
+        return false;
+
+    // Only bricks are boxes
+    LegoNode* legoNode = dynamic_cast<LegoNode*>(matrixTransform->getChild(0));
+    if (!legoNode || !dynamic_cast<Brick*>(legoNode->getLego()))
+        return false;
+
+    // Bricks have to be turned by quarter turns around z
+    const osg::Matrix& matrix = matrixTransform->getMatrix();
+    for (int row = 0; row < 2; row++) {
+        for (int col = 0; col < 2; col++) {
+            double value = fabs(matrix(row, col));
+            if (value > 1e-3 && fabs(value - 1.0) > 1e-3)
+                return false;
+        }
+    }
+    if (fabs(matrix(2, 2) - 1.0) > 1e-3)
+        return false;
+
+    // Box within the world, pieces being centered on their origin
+    BoundingBox legoBox = legoNode->getLego()->getBoundingBox();
+    osg::Vec3 halfSize(Lego::length_unit*legoBox.getLength()/2.0, Lego::length_unit*legoBox.getWidth()/2.0, Lego::height_unit*legoBox.getHeight()/2.0);
+    osg::BoundingBox worldBox;
+    worldBox.expandBy(-halfSize * matrix);
+    worldBox.expandBy(halfSize * matrix);
+
+    for (int axis = 0; axis < 3; axis++) {
+        double unit = (axis == 2) ? Lego::height_unit : Lego::length_unit;
+        box.min[axis] = qRound(worldBox._min[axis] / unit);
+        box.max[axis] = qRound(worldBox._max[axis] / unit);
+    }
+    box.color = legoNode->getLego()->getColor().rgb();
+
+    return true;
+}
+
+osg::Node* WallCompiler::ownBody(osg::MatrixTransform* matrixTransform) {
+    LegoNode* legoNode = static_cast<LegoNode*>(matrixTransform->getChild(0));
+    for (unsigned int k = 0; k < legoNode->getNumChildren(); k++) {
+        osg::Geode* geode = dynamic_cast<osg::Geode*>(legoNode->getChild(k));
+        if (!geode || geode->getName() != LegoNode::bodyName)
+            continue;
+
+        // Cloned LEGO nodes share their geodes with the preview, hidden bodies have to be their own
+        osg::ref_ptr<osg::Geode> body = new osg::Geode(*geode);
+        legoNode->setChild(k, body.get());
+        return body.get();
+    }
+
+    return NULL;
+}
+
+int WallCompiler::compile(const QVector<osg::MatrixTransform*>& pieces) {
+    PROFILE_SCOPE("WallCompiler::compile");
+
+    // Compiled pieces are compiled again with the new ones
+    for (int k = 0; k < pieces.size(); k++)
+        invalidate(pieces.at(k));
+
+    Section section;
+    QVector<Box> boxes;
+    for (int k = 0; k < pieces.size(); k++) {
+        Box box;
+        if (!brickBox(pieces.at(k), box))
+            continue;
+
+        osg::Node* body = ownBody(pieces.at(k));
+        if (!body)
+            continue;
+
+        boxes << box;
+        section.pieces << pieces.at(k);
+        section.bodies << body;
+    }
+
+    // A single brick is already as simple as it can be
+    if (boxes.size() < 2)
+        return 0;
+
+    section.geode = new osg::Geode;
+    section.geode->setName("Compiled wall");
+    section.geode->addDrawable(createGeometry(boxes));
+    section.geode->setDataVariance(osg::Object::STATIC);
+    _root->addChild(section.geode.get());
+
+    // Bodies are replaced by the section geometry, plots and bottom cylinders are kept
+    int sectionId = _nextSectionId++;
+    for (int k = 0; k < section.pieces.size(); k++) {
+        section.bodies.at(k)->setNodeMask(_enabled ? compiledBodyMask : ~0u);
+        _pieceSections.insert(section.pieces.at(k).get(), sectionId);
+    }
+    section.geode->setNodeMask(_enabled ? ~0u : 0u);
+    _sections.insert(sectionId, section);
+
+    return section.pieces.size();
+}
+
+osg::Geometry* WallCompiler::createGeometry(const QVector<Box>& boxes) {
+    PROFILE_SCOPE("WallCompiler::createGeometry");
+
+    // Fill cells: one Lego unit wide, one plate high
+    QHash<quint64, QRgb> occupied;
+    QVector<Cell> cells;
+    for (int k = 0; k < boxes.size(); k++) {
+        const Box& box = boxes.at(k);
+        for (int x = box.min[0]; x < box.max[0]; x++) {
+            for (int y = box.min[1]; y < box.max[1]; y++) {
+                for (int z = box.min[2]; z < box.max[2]; z++) {
+                    quint64 key = cellKey(x, y, z);
+                    if (occupied.contains(key))
+                        continue;
+                    occupied.insert(key, box.color);
+
+                    Cell cell;
+                    cell.coords[0] = x;
+                    cell.coords[1] = y;
+                    cell.coords[2] = z;
+                    cell.color = box.color;
+                    cells << cell;
+                }
+            }
+        }
+    }
+
+    // Keep faces without neighbour cell: faces between two bricks are never seen
+    QHash<quint64, QVector<Face> > groups;
+    for (int k = 0; k < cells.size(); k++) {
+        const Cell& cell = cells.at(k);
+        for (int direction = 0; direction < NB_DIRECTIONS; direction++) {
+            int axis = direction/2;
+            int step = (direction%2 == 0) ? 1 : -1;
+
+            int neighbour[3] = { cell.coords[0], cell.coords[1], cell.coords[2] };
+            neighbour[axis] += step;
+            if (occupied.contains(cellKey(neighbour[0], neighbour[1], neighbour[2])))
+                continue;
+
+            int slice = cell.coords[axis] + (step > 0 ? 1 : 0);
+            Face face;
+            face.u = cell.coords[(axis+1)%3];
+            face.v = cell.coords[(axis+2)%3];
+            groups[groupKey(direction, slice, cell.color)] << face;
+        }
+    }
+
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
+
+    // Greedy merge within each plane: grow rectangles along u, then along v
+    QHash<quint64, QVector<Face> >::const_iterator it;
+    QVector<char> mask;
+    for (it = groups.constBegin(); it != groups.constEnd(); ++it) {
+        int direction = static_cast<int>(it.key() >> 48);
+        int slice = static_cast<int>((it.key() >> 32) & 0xFFFF) - 32768;
+        QRgb color = static_cast<QRgb>(it.key() & 0xFFFFFFFF);
+        const QVector<Face>& faces = it.value();
+
+        int minU = faces.first().u, maxU = minU, minV = faces.first().v, maxV = minV;
+        for (int k = 1; k < faces.size(); k++) {
+            minU = qMin(minU, faces.at(k).u);
+            maxU = qMax(maxU, faces.at(k).u);
+            minV = qMin(minV, faces.at(k).v);
+            maxV = qMax(maxV, faces.at(k).v);
+        }
+        int width = maxU - minU + 1;
+        int height = maxV - minV + 1;
+        mask.fill(0, width*height);
+        for (int k = 0; k < faces.size(); k++)
+            mask[(faces.at(k).v - minV)*width + faces.at(k).u - minU] = 1;
+
+        for (int v = 0; v < height; v++) {
+            for (int u = 0; u < width; u++) {
+                if (!mask.at(v*width + u))
+                    continue;
+
+                int du = 1;
+                while (u+du < width && mask.at(v*width + u+du))
+                    du++;
+
+                int dv = 1;
+                bool fullRow = true;
+                while (v+dv < height && fullRow) {
+                    for (int i = u; i < u+du && fullRow; i++)
+                        fullRow = mask.at((v+dv)*width + i);
+                    if (fullRow)
+                        dv++;
+                }
+
+                for (int j = v; j < v+dv; j++) {
+                    for (int i = u; i < u+du; i++)
+                        mask[j*width + i] = 0;
+                }
+
+                addQuad(direction, slice, minU+u, minV+v, minU+u+du, minV+v+dv, color, vertices.get(), normals.get(), colors.get());
+            }
+        }
+    }
+
+    osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+    geometry->setVertexArray(vertices.get());
+    geometry->setNormalArray(normals.get());
+    geometry->setNormalBinding(osg::Geometry::BIND_PER_VERTEX);
+    geometry->setColorArray(colors.get());
+    geometry->setColorBinding(osg::Geometry::BIND_PER_VERTEX);
+    geometry->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::QUADS, 0, vertices->size()));
+
+    // Because LEGO bricks don't move
+    geometry->setDataVariance(osg::Object::STATIC);
+
+    return geometry.release();
+}
+
+void WallCompiler::invalidate(osg::MatrixTransform* matrixTransform) {
+    // Edited pieces bring their whole section back to separate bricks
+    QHash<osg::MatrixTransform*, int>::const_iterator it = _pieceSections.find(matrixTransform);
+    if (it != _pieceSections.end())
+        uncompile(it.value());
+}
+
+void WallCompiler::uncompile(int sectionId) {
+    QHash<int, Section>::iterator it = _sections.find(sectionId);
+    if (it == _sections.end())
+        return;
+
+    const Section& section = it.value();
+    for (int k = 0; k < section.pieces.size(); k++) {
+        section.bodies.at(k)->setNodeMask(~0u);
+        _pieceSections.remove(section.pieces.at(k).get());
+    }
+    _root->removeChild(section.geode.get());
+
+    _sections.erase(it);
+}
+
+void WallCompiler::clear(void) {
+    while (!_sections.isEmpty())
+        uncompile(_sections.constBegin().key());
+    _nextSectionId = 0;
+}
+
+void WallCompiler::setEnabled(bool enabled) {
+    _enabled = enabled;
+
+    // Show separate bricks, or compiled sections
+    QHash<int, Section>::const_iterator it;
+    for (it = _sections.constBegin(); it != _sections.constEnd(); ++it) {
+        const Section& section = it.value();
+        for (int k = 0; k < section.bodies.size(); k++)
+            section.bodies.at(k)->setNodeMask(_enabled ? compiledBodyMask : ~0u);
+        section.geode->setNodeMask(_enabled ? ~0u : 0u);
+    }
+}
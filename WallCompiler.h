@@ -0,0 +1,62 @@
+#ifndef WALLCOMPILER_H
+#define WALLCOMPILER_H
+
+#include <QVector>
+#include <QHash>
+#include <QColor>
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/MatrixTransform>
+#include <osg/ref_ptr>
+
+class WallCompiler {
+
+public:
+    // Bodies drawn by their section keep this mask: the world camera does not draw them, picking still finds them
+    static const osg::Node::NodeMask compiledBodyMask = 0x4;
+
+public:
+    WallCompiler(void);
+
+    osg::Group* getRoot(void) const { return _root.get(); }
+
+    int compile(const QVector<osg::MatrixTransform*>& pieces);
+    void invalidate(osg::MatrixTransform* matrixTransform);
+    void clear(void);
+
+    void setEnabled(bool enabled);
+    bool isEnabled(void) const { return _enabled; }
+    bool isCompiled(osg::MatrixTransform* matrixTransform) const { return _pieceSections.contains(matrixTransform); }
+
+    // An axis aligned brick, in Lego units on x and y, plates on z: [min, max[
+    struct Box {
+        int min[3];
+        int max[3];
+        QRgb color;
+    };
+
+    static osg::Geometry* createGeometry(const QVector<Box>& boxes);
+
+private:
+    // Bricks compiled together, drawn as a single geometry
+    struct Section {
+        osg::ref_ptr<osg::Geode> geode;
+        QVector<osg::ref_ptr<osg::MatrixTransform> > pieces;
+        QVector<osg::ref_ptr<osg::Node> > bodies;
+    };
+
+    static bool brickBox(osg::MatrixTransform* matrixTransform, Box& box);
+    static osg::Node* ownBody(osg::MatrixTransform* matrixTransform);
+
+    void uncompile(int sectionId);
+
+private:
+    osg::ref_ptr<osg::Group> _root;
+    QHash<int, Section> _sections;
+    QHash<osg::MatrixTransform*, int> _pieceSections;
+    int _nextSectionId;
+    bool _enabled;
+};
+
+#endif // WALLCOMPILER_H
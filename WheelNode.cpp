@@ -1,7 +1,6 @@
 #include "WheelNode.h"
+#include "Profiler.h"
 
-#include <osg/ShapeDrawable>
-#include <osg/MatrixTransform>
 #include <osg/Geometry>
 #include <osg/Material>
 
@@ -20,6 +19,8 @@ WheelNode::WheelNode(const WheelNode& wheelNode) :
 }
 
 void WheelNode::createGeode(void) {
+    PROFILE_SCOPE("WheelNode::createGeode");
+
     // Remove children
     removeChildren(0, getNumChildren());
 
@@ -66,53 +67,21 @@ void WheelNode::createWheel(bool isLeftWheel) {
     if (isLeftWheel)
         leftShift = -1;
 
-    // Create matrix to handle transformation
-    osg::Matrix m;
+    // Wheel axis is along x, on the side given by shift value
+    osg::Vec3 center(leftShift*1.5*Lego::length_unit, 0, 0);
+    osg::Vec3 axis(1, 0, 0);
+
     // Create geode
     osg::ref_ptr<osg::Geode> geode = new osg::Geode;
 
-    // Create wheel black cylinder
-    osg::ref_ptr<osg::ShapeDrawable> wheelPart = new osg::ShapeDrawable(
-                                                     new osg::Cylinder(
-                                                         osg::Vec3(0, 0, 0),
-                                                         Lego::length_unit,
-                                                         Lego::length_unit-2*EPS
-                                                )
-                                            );
-    // Paint it black
-    wheelPart->setColor(osg::Vec4(.0, .0, .0, 1.));
-
-    // Add drawable created to geode
-    geode->addDrawable(wheelPart.get());
-
-    // Create white center cylinder and shift it to be seen
-    osg::ref_ptr<osg::ShapeDrawable> wheelcenter = new osg::ShapeDrawable(
-                                                       new osg::Cylinder(
-                                                           osg::Vec3(0, 0, 0),
-                                                           Lego::length_unit/2,
-                                                           Lego::length_unit-EPS
-                                                  )
-                                              );
-    // Paint it white
-    wheelcenter->setColor(osg::Vec4(1., 1., 1., 1.));
-
-    // Add drawable created to geode
-    geode->addDrawable(wheelcenter.get());
-
-    // Create matrix transform
-    osg::ref_ptr<osg::MatrixTransform> mt = new osg::MatrixTransform;
-    mt->addChild(geode);
-
-    // Rotate the cylinder, because cylinder basis is on the floor
-    m.makeRotate(osg::Quat(M_PI/2, osg::Vec3(0, 1, 0)));
-    mt->setMatrix(m*mt->getMatrix());
-
-    // Translate according to side value
-    m.makeTranslate(leftShift*1.5*Lego::length_unit, 0, 0);
-    mt->setMatrix(mt->getMatrix()*m);
+    // Create wheel black cylinder, already placed: no matrix transform, and every wheel on this side shares the same arrays
+    geode->addDrawable(makeSolidCylinder(center, axis, Lego::length_unit, Lego::length_unit-2*EPS, osg::Vec4(.0, .0, .0, 1.)));
+
+    // Create white center cylinder, a bit longer to be seen
+    geode->addDrawable(makeSolidCylinder(center, axis, Lego::length_unit/2, Lego::length_unit-EPS, osg::Vec4(1., 1., 1., 1.)));
 
     // Add wheel
-    addChild(mt);
+    addChild(geode);
 }
 
 void WheelNode::createPlate(void) {
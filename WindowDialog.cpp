@@ -2,11 +2,19 @@
 
 WindowDialog::WindowDialog(QWidget* parent) :
     LegoDialog(parent) {
+
+    // Build dialog widgets
+    createWidgets();
 }
 
 WindowDialog::WindowDialog(const WindowDialog& windowDialog) :
     LegoDialog(windowDialog) {
 
+    // Build dialog widgets
+    createWidgets();
+}
+
+void WindowDialog::createWidgets(void) {
     // Window type
     _windowTypeComboBox = new QComboBox(this);
     QStringList windowTypeList;
@@ -23,6 +23,8 @@ public slots:
     virtual void isPannelUsed(void);
 
 private:
+    void createWidgets(void);
+
     QComboBox* _windowTypeComboBox;
     QCheckBox* _useLeftPannel;
     QCheckBox* _useRightPannel;
@@ -1,4 +1,5 @@
 #include "WindowNode.h"
+#include "Profiler.h"
 
 #include <osg/Geometry>
 #include <osg/Material>
@@ -21,6 +22,8 @@ WindowNode::WindowNode(const WindowNode& windowNode) :
 }
 
 void WindowNode::createGeode(void) {
+    PROFILE_SCOPE("WindowNode::createGeode");
+
     // Remove children if any
     removeChildren(0, getNumChildren());
 
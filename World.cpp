@@ -2,13 +2,14 @@
 
 #include <QDebug>
 #include <QSettings>
+#include <QSet>
 
-#include "LegoFactory.h"
 #include "SkyBox.h"
+#include "Profiler.h"
 
 #include <osgDB/WriteFile>
-#include <osgDB/ReadFile>
 #include <osg/TexGen>
+#include <osg/Geometry>
 
 int World::minHeight = 0;
 int World::maxHeight = 100;
@@ -18,7 +19,8 @@ int World::minLength = -500;
 int World::maxLength = 500;
 int World::count = 0;
 
-World::World() {
+World::World() :
+    _selectionRevision(0) {
     // Initialize matrix transform indexes
     _matTransIndexes = QVector<unsigned int>(0);
 
@@ -31,6 +33,8 @@ World::World() {
     _constructionScene = new osg::Group;
     _constructionScene->setName("Construction scene group");
     _scene->addChild(_constructionScene.get());
+    _scene->addChild(_wallCompiler.getRoot());
+    _scene->addChild(_regionCompiler.getRoot());
 
     // Create current matrix transform
     _currMatrixTransform = new osg::MatrixTransform;
@@ -90,45 +94,39 @@ void World::createGuideLines(void) {
         // Calculate whether background color is dark or light
         bool isViewerBgDark = (bgColor.black() > 127);
 
+        // Every line within a single geometry: lines along y first, then lines along x
+        osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
         for (int i = -width; i <= width; i+=2) {
-            for (int j = -length; j <= length; j+=2) {
-                // Create four points
-                osg::Vec3 v0(i*Lego::length_unit, -length*Lego::length_unit, -0.1);
-                osg::Vec3 v1(i*Lego::length_unit, length*Lego::length_unit, -0.1);
-                osg::Vec3 v2(-width*Lego::length_unit, j*Lego::length_unit, -0.1);
-                osg::Vec3 v3(width*Lego::length_unit, j*Lego::length_unit, -0.1);
-
-                // Add points
-                osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
-                vertices->push_back(v0);
-                vertices->push_back(v1);
-                vertices->push_back(v2);
-                vertices->push_back(v3);
-
-                // Create geometry
-                osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
-                geometry->setVertexArray(vertices);
-
-                // Create color according to viewer color :
-                // if background color is dark, grid is white
-                // otherwise, grid is black
-                osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
-                osg::Vec4 colorVec(0.0, 0.0, 0.0, 1.0);
-                if (isViewerBgDark)
-                    colorVec.set(1.0, 1.0, 1.0, 1.0);
-                colors->push_back(colorVec);
-
-                // Match color
-                geometry->setColorArray(colors);
-                geometry->setColorBinding(osg::Geometry::BIND_OVERALL);
-
-                // Define line
-                geometry->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::LINES, 0, 4));
-
-                // Add drawables geode
-                line->addDrawable(geometry);
-            }
+            vertices->push_back(osg::Vec3(i*Lego::length_unit, -length*Lego::length_unit, -0.1));
+            vertices->push_back(osg::Vec3(i*Lego::length_unit, length*Lego::length_unit, -0.1));
         }
+        for (int j = -length; j <= length; j+=2) {
+            vertices->push_back(osg::Vec3(-width*Lego::length_unit, j*Lego::length_unit, -0.1));
+            vertices->push_back(osg::Vec3(width*Lego::length_unit, j*Lego::length_unit, -0.1));
+        }
+
+        // Create geometry
+        osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+        geometry->setVertexArray(vertices);
+
+        // Create color according to viewer color :
+        // if background color is dark, grid is white
+        // otherwise, grid is black
+        osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
+        osg::Vec4 colorVec(0.0, 0.0, 0.0, 1.0);
+        if (isViewerBgDark)
+            colorVec.set(1.0, 1.0, 1.0, 1.0);
+        colors->push_back(colorVec);
+
+        // Match color
+        geometry->setColorArray(colors);
+        geometry->setColorBinding(osg::Geometry::BIND_OVERALL);
+
+        // Define lines
+        geometry->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::LINES, 0, vertices->size()));
+
+        // Add drawables geode
+        line->addDrawable(geometry);
 
         // Give a name to guide lines node, in order to being able to remove it
         line->setName("GuideLines");
@@ -196,41 +194,31 @@ void World::createSkybox(void) {
     // Remove previous skybox
     removeSkybox();
 
-    // Create sphere
-    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
-    geode->addDrawable(new osg::ShapeDrawable(new osg::Sphere(osg::Vec3(), _decorScene->getBound().radius())));
-    geode->setCullingActive(false);
-
-    // Create Skybox
-    osg::ref_ptr<SkyBox> sb = new SkyBox;
+    // Skybox is created once, and shared with the preview scene
+    if (!_skybox) {
+        // Create sphere
+        osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+        geode->addDrawable(LegoNode::makeSphere(_decorScene->getBound().radius(), osg::Vec4(1, 1, 1, 1)));
+        geode->setCullingActive(false);
 
-    // Modify state set
-    sb->getOrCreateStateSet()->setTextureAttributeAndModes(0, new osg::TexGen);
+        // Create Skybox
+        _skybox = new SkyBox;
 
-    // Create right image
-    osg::ref_ptr<osg::Image> right = osgDB::readImageFile("../LEGO_CREATOR/IMG/skybox/skybox1/right.png");
-    // Create left image
-    osg::ref_ptr<osg::Image> left = osgDB::readImageFile("../LEGO_CREATOR/IMG/skybox/skybox1/left.png");
-    // Create front image
-    osg::ref_ptr<osg::Image> front = osgDB::readImageFile("../LEGO_CREATOR/IMG/skybox/skybox1/front.png");
-    // Create front image
-    osg::ref_ptr<osg::Image> back = osgDB::readImageFile("../LEGO_CREATOR/IMG/skybox/skybox1/back.png");
-    // Create front image
-    osg::ref_ptr<osg::Image> top = osgDB::readImageFile("../LEGO_CREATOR/IMG/skybox/skybox1/top.png");
-    // Create front image
-    osg::ref_ptr<osg::Image> bottom = osgDB::readImageFile("../LEGO_CREATOR/IMG/skybox/skybox1/bottom.png");
+        // Modify state set
+        _skybox->getOrCreateStateSet()->setTextureAttributeAndModes(0, new osg::TexGen);
 
-    // Map 6 cube faces
-    sb->setEnvironmentMap(0, right.get(), left.get(), front.get(), back.get(), top.get(), bottom.get());
+        // Add sphere to the sky box
+        _skybox->addChild(geode.get());
 
-    // Add sphere to the sky box
-    sb->addChild(geode.get());
+        // Give a name to skybox node, in order to being able to remove it
+        _skybox->setName("Skybox");
 
-    // Give a name to skybox node, in order to being able to remove it
-    sb->setName("Skybox");
+        // Map 6 cube faces, read in background: DDS or KTX faces if any, PNG otherwise
+        _skybox->loadEnvironmentMap(0, "../LEGO_CREATOR/IMG/skybox/skybox1");
+    }
 
     // Add sky box to the scene
-    _decorScene->addChild(sb);
+    _decorScene->addChild(_skybox.get());
 }
 
 void World::removeSkybox(void) {
@@ -246,11 +234,30 @@ void World::removeSkybox(void) {
 void World::eraseConstructionScene(void) {
     // Remove every child within construction scene
     _constructionScene->removeChildren(0, _constructionScene->getNumChildren());
+
+    // And forget their boxes, covered plots and selection
+    _spatialIndex.clear();
+    _plotCulling.clear();
+    _wallCompiler.clear();
+    _regionCompiler.clear();
+    clearSelection();
 }
 
 bool World::writeFile(const QString& fileName) {
+    PROFILE_SCOPE("World::writeFile");
+
+    // Covered plots, compiled bodies and pieces are hidden with node masks, which must not be saved
+    _plotCulling.setEnabled(false);
+    _wallCompiler.setEnabled(false);
+    _regionCompiler.setEnabled(false);
+
     // Try to write the construction scene elements in fileName file
-    return (osgDB::writeNodeFile(*(_constructionScene), fileName.toStdString()));
+    bool written = osgDB::writeNodeFile(*(_constructionScene), fileName.toStdString());
+
+    _plotCulling.setEnabled(true);
+    _wallCompiler.setEnabled(true);
+    _regionCompiler.setEnabled(true);
+    return written;
 }
 
 void World::initBrick(void) {
@@ -280,6 +287,11 @@ void World::initBrick(void) {
 
 void World::deleteLego(void) {
     // Remove last Lego inserted
+    unselect(_constructionScene->getChild(_matTransIndexes.last()));
+    _spatialIndex.remove(static_cast<osg::MatrixTransform*>(_constructionScene->getChild(_matTransIndexes.last())));
+    _plotCulling.remove(static_cast<osg::MatrixTransform*>(_constructionScene->getChild(_matTransIndexes.last())));
+    _wallCompiler.invalidate(static_cast<osg::MatrixTransform*>(_constructionScene->getChild(_matTransIndexes.last())));
+    _regionCompiler.remove(static_cast<osg::MatrixTransform*>(_constructionScene->getChild(_matTransIndexes.last())));
     _constructionScene->removeChild(_matTransIndexes.last());
     // Pop the stack
     _matTransIndexes.pop_back();
@@ -297,14 +309,22 @@ void World::deleteLego(const std::string& matrixName) {
     }
 
     // If we found the right child, we delete it
-    if (concernedMatTrans)
+    if (concernedMatTrans) {
+        unselect(concernedMatTrans);
+        _spatialIndex.remove(static_cast<osg::MatrixTransform*>(concernedMatTrans));
+        _plotCulling.remove(static_cast<osg::MatrixTransform*>(concernedMatTrans));
+        _wallCompiler.invalidate(static_cast<osg::MatrixTransform*>(concernedMatTrans));
+        _regionCompiler.remove(static_cast<osg::MatrixTransform*>(concernedMatTrans));
         _constructionScene->removeChild(concernedMatTrans);
+    }
     // Else, we print a message...
     else
         qDebug() << "Cannot find the right child within World::deleteLego";
 }
 
 std::string World::addBrick(LegoNode* legoNode, Lego* /*lego*/) {
+    PROFILE_SCOPE("World::addBrick");
+
     // ClonelegoNode and Lego to create a new one in the scene
     //osg::ref_ptr<LegoNode> newLegoNode = legoNode->cloning();
     //osg::ref_ptr<Lego> newLego = lego->cloning();
@@ -327,6 +347,11 @@ std::string World::addBrick(LegoNode* legoNode, Lego* /*lego*/) {
     // Init brick, to place it at the right place
     initBrick();
 
+    // Index its box, for picking and selection, and its plots, to hide the covered ones
+    _spatialIndex.insert(_currMatrixTransform.get());
+    _plotCulling.insert(_currMatrixTransform.get());
+    _regionCompiler.insert(_currMatrixTransform.get());
+
     // Add curr matrix transform index in array
     _matTransIndexes << _constructionScene->getChildIndex(_currMatrixTransform);
 
@@ -359,6 +384,12 @@ void World::rotation(bool counterClockWise) {
     // NB: rotate * mat -> local rotation
     //     mat * rotate -> global rotation
     _currMatrixTransform->preMult(rotate);
+
+    // Move its box and plots too
+    _spatialIndex.update(_currMatrixTransform.get());
+    _plotCulling.update(_currMatrixTransform.get());
+    _wallCompiler.invalidate(_currMatrixTransform.get());
+    _regionCompiler.update(_currMatrixTransform.get());
 }
 
 void World::translationXYZ(double x, double y, double z) {
@@ -382,6 +413,12 @@ void World::translationXYZ(double x, double y, double z) {
         mat.makeTranslate(Lego::length_unit/2, -Lego::length_unit*1/2, 0);
         _currMatrixTransform->preMult(mat);
     }
+
+    // Move its box and plots too
+    _spatialIndex.update(_currMatrixTransform.get());
+    _plotCulling.update(_currMatrixTransform.get());
+    _wallCompiler.invalidate(_currMatrixTransform.get());
+    _regionCompiler.update(_currMatrixTransform.get());
 }
 
 void World::translation(double x, double y, double z) {
@@ -394,4 +431,187 @@ void World::translation(double x, double y, double z) {
     osg::Matrix mat = _currMatrixTransform->getMatrix();
     mat.makeTranslate(x, y, z);
     _currMatrixTransform->setMatrix(mat);
+
+    // Move its box and plots too
+    _spatialIndex.update(_currMatrixTransform.get());
+    _plotCulling.update(_currMatrixTransform.get());
+    _wallCompiler.invalidate(_currMatrixTransform.get());
+    _regionCompiler.update(_currMatrixTransform.get());
+}
+
+void World::setSelection(const QVector<osg::MatrixTransform*>& pieces) {
+    // Replace current selection
+    _selection.clear();
+    _selection.reserve(pieces.size());
+    for (int k = 0; k < pieces.size(); k++)
+        _selection << pieces.at(k);
+
+    // Viewers redraw selection boxes when the revision changes
+    _selectionRevision++;
+}
+
+void World::clearSelection(void) {
+    if (_selection.isEmpty())
+        return;
+
+    _selection.clear();
+    _selectionRevision++;
+}
+
+void World::unselect(osg::Node* piece) {
+    for (int k = 0; k < _selection.size(); k++) {
+        if (_selection.at(k).get() == piece) {
+            _selection.remove(k);
+            _selectionRevision++;
+            return;
+        }
+    }
+}
+
+osg::ref_ptr<osg::MatrixTransform> World::createPiece(LegoNode* legoNode, const osg::Matrix& matrix) {
+    // Same naming as addBrick, but the piece is only added to the scene by restorePieces,
+    // so that generators can add thousands of pieces at once
+    legoNode->setName(legoNode->getLego()->whoiam().toStdString() + " from LegoNode");
+    // No command holds the Lego of generated pieces, the node does
+    legoNode->setUserData(legoNode->getLego());
+
+    osg::ref_ptr<osg::MatrixTransform> matrixTransform = new osg::MatrixTransform(matrix);
+    matrixTransform->addChild(legoNode);
+    matrixTransform->setDataVariance(osg::Object::STATIC);
+
+    count++;
+    matrixTransform->setName(QString("MatrixTransform%1").arg(count).toStdString());
+
+    return matrixTransform;
+}
+
+void World::removePieces(const PieceList& pieces) {
+    QSet<osg::Node*> removed;
+    for (int k = 0; k < pieces.size(); k++)
+        removed.insert(pieces.at(k).get());
+
+    // Rebuild children in one pass: removing them one by one is quadratic on generated scenes
+    unsigned int nbChildren = _constructionScene->getNumChildren();
+    QVector<int> newIndexes(nbChildren, -1);
+    osg::NodeList kept;
+    kept.reserve(nbChildren);
+    int nbFound = 0;
+    for (unsigned int k = 0; k < nbChildren; k++) {
+        osg::Node* child = _constructionScene->getChild(k);
+        if (removed.contains(child)) {
+            // Forget piece within index
+            _spatialIndex.remove(static_cast<osg::MatrixTransform*>(child));
+            _plotCulling.remove(static_cast<osg::MatrixTransform*>(child));
+            _wallCompiler.invalidate(static_cast<osg::MatrixTransform*>(child));
+            _regionCompiler.remove(static_cast<osg::MatrixTransform*>(child));
+            nbFound++;
+        } else {
+            newIndexes[k] = kept.size();
+            kept.push_back(child);
+        }
+    }
+
+    if (nbFound < removed.size())
+        qDebug() << "Cannot find the right child within World::removePieces";
+
+    // Forget removed pieces within selection, in one pass too
+    PieceList selection;
+    selection.reserve(_selection.size());
+    for (int k = 0; k < _selection.size(); k++) {
+        if (!removed.contains(_selection.at(k).get()))
+            selection << _selection.at(k);
+    }
+    if (selection.size() != _selection.size()) {
+        _selection = selection;
+        _selectionRevision++;
+    }
+
+    _constructionScene->removeChildren(0, nbChildren);
+    for (unsigned int k = 0; k < kept.size(); k++)
+        _constructionScene->addChild(kept.at(k).get());
+
+    // Following children are shifted, so are their recorded indexes
+    QVector<unsigned int> matTransIndexes;
+    for (int k = 0; k < _matTransIndexes.size(); k++) {
+        int index = newIndexes.value(_matTransIndexes.at(k), -1);
+        if (index != -1)
+            matTransIndexes << index;
+    }
+    _matTransIndexes = matTransIndexes;
+}
+
+void World::restorePieces(const PieceList& pieces) {
+    // Pieces come back with their own matrix, so they are put as they were
+    for (int k = 0; k < pieces.size(); k++) {
+        osg::MatrixTransform* piece = pieces.at(k).get();
+        if (!_constructionScene->addChild(piece))
+            continue;
+        _spatialIndex.insert(piece);
+        _plotCulling.insert(piece);
+        _regionCompiler.insert(piece);
+        _matTransIndexes << _constructionScene->getNumChildren()-1;
+    }
+}
+
+void World::movePieces(const PieceList& pieces, int x, int y, int z) {
+    // Translation in Lego units, so pieces keep matching plots
+    osg::Matrix mat;
+    mat.makeTranslate(x*Lego::length_unit, y*Lego::length_unit, z*Lego::height_unit);
+
+    for (int k = 0; k < pieces.size(); k++) {
+        pieces.at(k)->postMult(mat);
+        _spatialIndex.update(pieces.at(k).get());
+        _plotCulling.update(pieces.at(k).get());
+        _wallCompiler.invalidate(pieces.at(k).get());
+        _regionCompiler.update(pieces.at(k).get());
+    }
+
+    // Selection boxes have moved
+    _selectionRevision++;
+}
+
+void World::colorPieces(const PieceList& pieces, const QVector<QColor>& colors) {
+    for (int k = 0; k < pieces.size() && k < colors.size(); k++) {
+        LegoNode* legoNode = dynamic_cast<LegoNode*>(pieces.at(k)->getChild(0));
+        if (!legoNode) {
+            qDebug() << "Not a lego node within World::colorPieces";
+            continue;
+        }
+
+        // Geometry is rebuilt with the new color, plots included
+        _plotCulling.remove(pieces.at(k).get());
+        _wallCompiler.invalidate(pieces.at(k).get());
+        legoNode->getLego()->setColor(colors.at(k));
+        legoNode->createGeode();
+        _spatialIndex.updateShape(pieces.at(k).get());
+        _plotCulling.insert(pieces.at(k).get());
+        _regionCompiler.update(pieces.at(k).get());
+    }
+}
+
+int World::compileWalls(const PieceList& pieces) {
+    PROFILE_SCOPE("World::compileWalls");
+
+    // Nothing given: the whole construction is compiled
+    QVector<osg::MatrixTransform*> compiled;
+    if (pieces.isEmpty()) {
+        compiled.reserve(_constructionScene->getNumChildren());
+        for (unsigned int k = 0; k < _constructionScene->getNumChildren(); k++) {
+            osg::MatrixTransform* piece = dynamic_cast<osg::MatrixTransform*>(_constructionScene->getChild(k));
+            if (piece)
+                compiled << piece;
+        }
+    } else {
+        compiled.reserve(pieces.size());
+        for (int k = 0; k < pieces.size(); k++)
+            compiled << pieces.at(k).get();
+    }
+
+    int nbCompiled = _wallCompiler.compile(compiled);
+
+    // Bodies are hidden from now on, within region meshes too
+    for (int k = 0; k < compiled.size(); k++)
+        _regionCompiler.update(compiled.at(k));
+
+    return nbCompiled;
 }
@@ -11,14 +11,26 @@
 #include <string>
 
 #include "LegoNode.h"
+#include "SpatialIndex.h"
+#include "PlotCulling.h"
+#include "WallCompiler.h"
+#include "RegionCompiler.h"
+#include "SkyBox.h"
 
 class World {
 
+public:
+    typedef QVector<osg::ref_ptr<osg::MatrixTransform> > PieceList;
+
 public:
     World();
     virtual ~World(void);
 
     osg::ref_ptr<osg::Group> getScene(void) const { return _scene.get(); }
+    SpatialIndex* getSpatialIndex(void) { return &_spatialIndex; }
+    PlotCulling* getPlotCulling(void) { return &_plotCulling; }
+    RegionCompiler* getRegionCompiler(void) { return &_regionCompiler; }
+    SkyBox* getSkybox(void) const { return _skybox.get(); }
 
     void createGuideLines(void);
     void removeGuideLines(void);
@@ -39,6 +51,18 @@ public:
     void translation(double x, double y, double z);
     void translationXYZ(double x, double y, double z);
 
+    void setSelection(const QVector<osg::MatrixTransform*>& pieces);
+    void clearSelection(void);
+    const PieceList& getSelection(void) const { return _selection; }
+    int getSelectionRevision(void) const { return _selectionRevision; }
+
+    osg::ref_ptr<osg::MatrixTransform> createPiece(LegoNode* legoNode, const osg::Matrix& matrix);
+    void removePieces(const PieceList& pieces);
+    void restorePieces(const PieceList& pieces);
+    void movePieces(const PieceList& pieces, int x, int y, int z);
+    void colorPieces(const PieceList& pieces, const QVector<QColor>& colors);
+    int compileWalls(const PieceList& pieces);
+
     static int minHeight;
     static int maxHeight;
     static int minWidth;
@@ -48,12 +72,22 @@ public:
 
     static int count;
 
+private:
+    void unselect(osg::Node* piece);
+
 private:
     osg::ref_ptr<osg::Group> _scene;
     osg::ref_ptr<osg::Group> _decorScene;
     osg::ref_ptr<osg::Group> _constructionScene;
+    osg::ref_ptr<SkyBox> _skybox;
     osg::ref_ptr<osg::MatrixTransform> _currMatrixTransform;
     QVector<unsigned int> _matTransIndexes;
+    SpatialIndex _spatialIndex;
+    PlotCulling _plotCulling;
+    WallCompiler _wallCompiler;
+    RegionCompiler _regionCompiler;
+    PieceList _selection;
+    int _selectionRevision;
     double _x;
     double _y;
     double _z;
@@ -29,6 +29,7 @@
 #include "CornerNode.h"
 #include "LDrawParser.h"
 #include "PhotoCallback.h"
+#include "ImageWriter.h"
 
 #if RANDOM
 int rand_a_b(int a, int b){
@@ -42,6 +43,10 @@ int rand_a_b(int a, int b){
 #include <QtGui>
 //#include <X11/Xlib.h>
 #include "MainWindow.h"
+#include "Profiler.h"
+
+// Startup benchmark fails when the first frame takes longer, in ms
+#define DEFAULT_STARTUP_BUDGET 3000
 
 #endif
 
@@ -521,15 +526,19 @@ int main(int argc, char** argv) {
         viewer.addView(mainView.get());
 
         osg::ref_ptr<osg::Image> thumbPic = new osg::Image;
-        osg::ref_ptr<PhotoCallback> pcb = new PhotoCallback(thumbPic.get(), allParts.at(k).toStdString());
+        osg::ref_ptr<PhotoCallback> pcb = new PhotoCallback(thumbPic.get(), "/home/shaolan/Images/LEGO/Parts/" + allParts.at(k).toStdString() + ".bmp");
 
         mainView->getCamera()->setPostDrawCallback(pcb.get());
         mainView->getCamera()->setClearColor(osg::Vec4(252.0/255.0, 254.0/255.0 ,234.0/255.0, 1.0));
 
         thumbPic->setUserValue("Capture", true);
         viewer.frame();
+        // Capture is read back asynchronously, next frame hands it to the writer
+        viewer.frame();
     }
 
+    ImageWriter::instance()->waitForDone();
+
     return 0;
 
     #endif
@@ -543,18 +552,45 @@ int main(int argc, char** argv) {
 
 #else
 
+    // Origin of the startup timeline
+    Profiler::markStartup("Application start");
+
     // Init srand to have pseudo-random numbers
     srand(time(NULL));
 
-//    // Init X11 threads, because I really wanted to use another thread to render OSG components but it does not work either
-//    QCoreApplication::setAttribute(Qt::AA_X11InitThreads);
+#if QT_VERSION >= 0x040800
+    // Init X11 threads, because OSG viewers cull and draw within their own threads
+    QCoreApplication::setAttribute(Qt::AA_X11InitThreads);
+#endif
 
     // Call QApplication
     QApplication app(argc, argv);
+    Profiler::markStartup("QApplication created");
+
+    // Startup benchmark: LEGO_Creator --startup-benchmark [budget in ms]
+    QStringList args = app.arguments();
+    int benchmarkIndex = args.indexOf("--startup-benchmark");
+    qint64 startupBudget = DEFAULT_STARTUP_BUDGET;
+    if (benchmarkIndex != -1 && benchmarkIndex+1 < args.size())
+        startupBudget = args.at(benchmarkIndex+1).toLongLong();
 
     // Create main window and display it
     MainWindow window;
     window.show();
+    Profiler::markStartup("Main window shown");
+
+    // Benchmark quits as soon as the scene is drawn
+    if (benchmarkIndex != -1) {
+        QObject::connect(&window, SIGNAL(started()), &app, SLOT(quit()));
+        app.exec();
+
+        qint64 startupTime = Profiler::getStartupTime()/1000;
+        if (startupTime > startupBudget) {
+            qDebug() << "Startup took" << startupTime << "ms, more than" << startupBudget << "ms";
+            return 1;
+        }
+        return 0;
+    }
 
     // Return application exec
     return app.exec();